@@ -5,28 +5,24 @@
 extern "C" {
 #endif
 
+#include <param/param.h>
+
 #include <csp_proc/proc_types.h>
 
 typedef struct {
 	int is_tail_call;
 } call_analysis_t;
 
-typedef struct {
-} block_analysis_t, ifelse_analysis_t, set_analysis_t, unop_analysis_t, binop_analysis_t;
-
 typedef struct {
 	proc_instruction_type_t type;
+	int target;            // If/else: instruction following the clause, where execution continues when it's skipped
 	union {
-		block_analysis_t block;
-		ifelse_analysis_t ifelse;
-		set_analysis_t set;
-		unop_analysis_t unop;
-		binop_analysis_t binop;
 		call_analysis_t call;
 	} analysis;
 } proc_instruction_analysis_t;
 
 typedef struct proc_analysis_t proc_analysis_t;
+typedef struct proc_op_t proc_op_t;  // See proc_runtime.h
 
 struct proc_analysis_t {
 	proc_t * proc;
@@ -35,7 +31,11 @@ struct proc_analysis_t {
 	uint8_t * procedure_slots;
 	size_t procedure_slot_count;
 	proc_instruction_analysis_t * instruction_analyses;
+	proc_op_t * code;  // Compiled procedure, NULL until compiled by the runtime
+	int code_length;
 	int deallocation_mark;
+	int is_bounded_nonblocking;  // No block or call instructions, loop periods or remote operands, so it can run inline
+	int refs;  // Runs sharing a root analysis, plus one while it's cached by the runtime
 };
 
 /**
@@ -52,6 +52,15 @@ void free_proc_analysis(proc_analysis_t * analysis);
 
 int proc_analyze(proc_t * proc, proc_analysis_t * analysis, proc_analysis_config_t * config);
 
+/**
+ * Get the instruction a jump or loop instruction continues at.
+ *
+ * @param proc The procedure
+ * @param index The index of the jump or loop instruction
+ * @return The index of the instruction, the instruction count if the procedure ends, or -1 if out of range
+ */
+int proc_jump_target(proc_t * proc, int index);
+
 #ifdef __cplusplus
 }
 #endif
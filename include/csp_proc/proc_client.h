@@ -29,6 +29,38 @@ int proc_slots_request(uint8_t * slots, uint8_t * slot_count, int host, int time
 
 int proc_run_request(uint8_t proc_slot, int host, int timeout);
 
+/**
+ * Run a procedure on a node, like proc_run_request, and report whether it already completed.
+ *
+ * @param status Set to PROC_RUN_COMPLETED if the procedure completed inline on the node, or PROC_RUN_STARTED
+ */
+int proc_run_request_status(uint8_t proc_slot, proc_run_status_e * status, int host, int timeout);
+
+int proc_cache_request(proc_cache_op_e op, uint16_t node, uint32_t * hits, uint32_t * misses, int host, int timeout);
+
+/**
+ * Ask the runtime on a node to evaluate a condition on its local parameters and notify this node
+ * (PROC_WATCH_NOTIFY) once it holds or the timeout is reached.
+ *
+ * @param condition The condition to watch
+ * @param timeout_ms How long the node watches the condition before giving up
+ * @param watch_id Id sent back in the notification
+ * @param host The node to evaluate the condition on
+ * @param timeout Timeout of the request
+ * @return 0 if the node is watching the condition, non-zero otherwise
+ */
+int proc_watch_request(proc_ifelse_t * condition, uint32_t timeout_ms, uint32_t watch_id, int host, int timeout);
+
+/**
+ * Notify a node that a condition it asked to be watched holds, or that the watch timed out.
+ *
+ * @param watch_id Id given in the watch request
+ * @param holds 1 if the condition holds, 0 if the watch timed out
+ * @param host The node that asked for the condition to be watched
+ * @return 0 on success, non-zero otherwise
+ */
+int proc_watch_notify(uint32_t watch_id, int holds, int host);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,27 @@ int pack_proc_into_csp_packet(proc_t * procedure, csp_packet_t * packet);
  */
 int unpack_proc_from_csp_packet(proc_t * procedure, csp_packet_t * packet);
 
+/**
+ * Pack the condition of a block or ifelse instruction (param_a, op, param_b) into a CSP packet.
+ *
+ * @param condition The condition to pack
+ * @param packet The packet to pack the condition into
+ * @param offset Where in the packet data to pack the condition
+ * @return The offset following the packed condition, or -1 if it doesn't fit into the packet
+ */
+int pack_condition_into_csp_packet(proc_ifelse_t * condition, csp_packet_t * packet, int offset);
+
+/**
+ * Unpack the condition of a block or ifelse instruction from a CSP packet.
+ * The parameter names are allocated and must be freed by the caller.
+ *
+ * @param condition The condition to unpack into
+ * @param packet The packet to unpack the condition from
+ * @param offset Where in the packet data the condition is packed
+ * @return The offset following the packed condition, or -1 if the packet is malformed
+ */
+int unpack_condition_from_csp_packet(proc_ifelse_t * condition, csp_packet_t * packet, int offset);
+
 void proc_free_instruction(proc_instruction_t * instruction);
 
 void free_proc(proc_t * procedure);
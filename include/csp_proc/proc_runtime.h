@@ -7,8 +7,12 @@ extern "C" {
 
 #include <stdint.h>
 
+#include <param/param_queue.h>
+#include <param/param_server.h>
+
 #include <csp_proc/proc_types.h>
 #include <csp_proc/proc_store.h>
+#include <csp_proc/proc_analyze.h>
 
 // TODO: configurable as libparam params
 
@@ -20,14 +24,74 @@ extern "C" {
 #define MIN_PROC_BLOCK_PERIOD_MS (250U)
 #endif
 
+#ifndef PROC_BLOCK_MAX_PERIOD_MS
+#define PROC_BLOCK_MAX_PERIOD_MS (60000U)
+#endif  // default upper bound of the polling period of a block backing off
+
+#ifndef PROC_BLOCK_BACKOFF_PERCENT
+#define PROC_BLOCK_BACKOFF_PERCENT (100U)
+#endif  // default growth of the polling period of a block after each evaluation (100 = fixed period)
+
+#ifndef PROC_NATIVE_WIDTH_ARITHMETIC
+#define PROC_NATIVE_WIDTH_ARITHMETIC (0U)
+#endif  // operate on parameters of up to 32 bits at their own width instead of widening them to 64 bits (on by default for FreeRTOS)
+
 #ifndef MAX_PROC_RECURSION_DEPTH
 #define MAX_PROC_RECURSION_DEPTH (1000U)
 #endif
 
+#ifndef PROC_RUNTIME_COROUTINE
+#define PROC_RUNTIME_COROUTINE (0U)
+#endif  // run procedures as coroutines on PROC_COROUTINE_THREADS threads/tasks, instead of on a thread/task each
+
+#ifndef PROC_COROUTINE_THREADS
+#define PROC_COROUTINE_THREADS (1U)
+#endif
+
+#ifndef PROC_COROUTINE_SLICE
+#define PROC_COROUTINE_SLICE (32U)
+#endif  // instructions a coroutine executes before yielding to the other ready runs
+
 #ifndef MAX_PROC_CONCURRENT
 #define MAX_PROC_CONCURRENT (16U)
 #endif
 
+#ifndef PROC_RUN_QUEUE_SIZE
+#define PROC_RUN_QUEUE_SIZE (16U)
+#endif  // max number of runs waiting for a free worker thread/task (POSIX and coroutine runtimes)
+
+#ifndef PROC_LIST_CACHE_TTL_MS
+#define PROC_LIST_CACHE_TTL_MS (60000U)
+#endif
+
+#ifndef PROC_LIST_CACHE_SIZE
+#define PROC_LIST_CACHE_SIZE (8U)
+#endif
+
+#ifndef PROC_PARAM_WATCH_MAX
+#define PROC_PARAM_WATCH_MAX (32U)
+#endif  // max number of local params waiting blocks can be woken by at once, blocks on further params fall back to polling
+
+#ifndef PROC_BLOCK_EVENT_RECHECK_MS
+#define PROC_BLOCK_EVENT_RECHECK_MS (1000U)
+#endif  // event-driven blocks still re-evaluate this often, to catch changes made without param_set
+
+#ifndef PROC_PARAM_INDEX_SIZE
+#define PROC_PARAM_INDEX_SIZE (1024U)
+#endif
+
+#ifndef PROC_BLOCK_POLLER_MAX
+#define PROC_BLOCK_POLLER_MAX (64U)
+#endif  // max number of runs parked on a block at once, further blocks keep their thread/task while waiting
+
+#ifndef PROC_BLOCK_WHEEL_SLOTS
+#define PROC_BLOCK_WHEEL_SLOTS (64U)
+#endif  // slots of MIN_PROC_BLOCK_PERIOD_MS each in the block poller timer wheel
+
+#ifndef PROC_INLINE_BUDGET
+#define PROC_INLINE_BUDGET (32U)
+#endif  // instructions a short non-blocking procedure runs in the server before it's handed to the runtime (0 = never inline)
+
 /**
  * Initialize the procedure runtime and any necessary resources.
  * This function should only be called once. Any per-procedure configuration should be done in `proc_runtime_run`.
@@ -45,6 +109,81 @@ int __attribute__((weak)) proc_runtime_init();
  */
 int __attribute__((weak)) proc_runtime_run(uint8_t proc_slot);
 
+/**
+ * Run a procedure stored in a given slot on the calling thread/task if it's bounded and non-blocking (see
+ * proc_analysis_t), i.e. without handing it to a worker. A run exceeding PROC_INLINE_BUDGET instructions is
+ * handed to the runtime to finish.
+ *
+ * @param proc_slot The slot of the procedure to run
+ *
+ * @return 0 if the run completed, PROC_RUN_YIELDED if the runtime continues it, PROC_RUN_NOT_INLINE if the
+ *         procedure must be run with proc_runtime_run instead, -1 on failure
+ */
+int __attribute__((weak)) proc_runtime_run_inline(uint8_t proc_slot);
+
+/**
+ * Check the operand types of a procedure before it's stored, as far as they can be known without contacting
+ * other nodes: operands of the same instruction must have the same type (unsigned, signed, floating point or
+ * string), the operation must be defined for it, and results must have that type too.
+ * Operands on other nodes, or not (yet) in the local parameter list, are checked when the instruction executes.
+ *
+ * @param proc The procedure to check
+ * @return 0 if no mismatch was found, -1 otherwise
+ */
+int __attribute__((weak)) proc_runtime_check(proc_t * proc);
+
+/**
+ * Drop the cached analyses of a procedure slot and of every procedure calling it, directly or indirectly.
+ * Called by the procedure store whenever a slot is set or deleted; runs already started are not affected.
+ *
+ * @param slot The slot that changed
+ */
+void __attribute__((weak)) proc_runtime_invalidate_slot(uint8_t slot);
+
+/**
+ * Invalidate all resolved parameter handles held by procedure runs.
+ * The runtime does so itself when it downloads or flushes the parameter list of a remote node; this must be
+ * called whenever local parameters are removed from (or replaced in) the libparam list by other means.
+ * Handles are then resolved again on their next use.
+ */
+void __attribute__((weak)) proc_runtime_invalidate_params();
+
+/**
+ * Flush the cached parameter lists of remote nodes, forcing the lists to be downloaded again on next use.
+ *
+ * @param node The node to flush the cached list of, or 0 to flush all nodes
+ */
+void __attribute__((weak)) proc_runtime_flush_list_cache(uint16_t node);
+
+/**
+ * Get the hit/miss counters of the remote parameter list cache, read together (both 0 before the runtime is initialized).
+ *
+ * @param hits Number of lookups served from the cache
+ * @param misses Number of lookups that required a list download
+ */
+void __attribute__((weak)) proc_runtime_list_cache_stats(uint32_t * hits, uint32_t * misses);
+
+/**
+ * Watch a condition on local parameters on behalf of the runtime of another node (offloaded block instruction).
+ * The node is sent a PROC_WATCH_NOTIFY once the condition holds or the timeout is reached.
+ *
+ * @param condition The condition to watch, copied
+ * @param timeout_ms How long to watch the condition before giving up
+ * @param node The node to notify
+ * @param watch_id Id to notify the node with
+ * @return 0 on success, -1 if the condition can't be watched
+ */
+int __attribute__((weak)) proc_runtime_watch(proc_ifelse_t * condition, uint32_t timeout_ms, uint16_t node, uint32_t watch_id);
+
+/**
+ * Handle a PROC_WATCH_NOTIFY from a node evaluating an offloaded block condition, resuming the waiting run.
+ *
+ * @param node The node the notification came from
+ * @param watch_id Id of the watch request
+ * @param holds 1 if the condition holds, 0 if the watch timed out
+ */
+void __attribute__((weak)) proc_runtime_watch_notify(uint16_t node, uint32_t watch_id, int holds);
+
 /**
  * Used to indicate the result of an if-else instruction in an instruction handler.
  */
@@ -56,6 +195,185 @@ typedef enum {
 	IF_ELSE_FLAG_ERR_TYPE = -3,
 } if_else_flag_t;
 
+/**
+ * Write-behind buffer coalescing consecutive remote writes to the same node into a single libparam queue push.
+ * Owned by the instruction execution loop and flushed before anything that may observe the writes.
+ */
+typedef struct {
+	param_queue_t queue;
+	char buffer[PARAM_SERVER_MTU];
+	uint16_t node;  // Node of the buffered writes, 0 if the buffer is empty
+} proc_write_buffer_t;
+
+#define PROC_RUN_PARKED (1)  // Returned by the instruction execution loop when the run was handed to the block poller
+#define PROC_RUN_YIELDED (2)  // Returned by the coroutine execution loop when the run should be queued again
+#define PROC_RUN_NOT_INLINE (3)  // Returned by proc_runtime_run_inline when the procedure may block or run long
+
+#define PROC_CODE_END (-1)  // Target of the ops ending their procedure
+#define PROC_OP_BRANCH (1)  // Returned by an op handler to continue at the branch target of the op
+
+/**
+ * Scratch register of a procedure frame (see PROC_OPERAND_REGISTER), holding an intermediate result as the
+ * runtime operated on it, so it's neither stored in nor looked up as a libparam parameter.
+ */
+typedef struct {
+	param_type_e source_type;  // Representation the value is written to parameters with
+	uint8_t type;              // Operand type of the value (see proc_runtime_instructions_common.c)
+	uint8_t written;           // 0 until the register is written in its frame
+	union {
+		uint64_t u64;
+		int64_t i64;
+		double d;
+		uint32_t u32;
+		int32_t i32;
+		float f;
+	} value;
+} proc_register_t;
+
+typedef struct operand_t operand_t;  // Kernel operand, private to the runtime
+
+/**
+ * Arithmetic/comparison kernel specialised for one operation and operand type, bound by the runtime.
+ * Comparison kernels return an if_else_flag_t, arithmetic kernels store their result in operand a and return 0 or -1.
+ */
+typedef int (*proc_kernel_t)(operand_t * a, operand_t * b);
+
+/**
+ * A parameter operand resolved to its libparam handle.
+ * Resolved on first use and reused until the parameter list generation changes (see proc_runtime_invalidate_params).
+ */
+typedef struct {
+	param_t * param;
+	int offset;     // Array index, -1 if the whole parameter is addressed
+	uint16_t node;  // Node to pull/push from, 0 if the parameter is local
+	unsigned int generation;
+	unsigned int refreshed;  // Generation after the remote list was last refreshed for a missing parameter, 0 if never
+} proc_param_handle_t;
+
+typedef struct {
+	proc_param_handle_t param_a;
+	proc_param_handle_t param_b;
+} block_handles_t, ifelse_handles_t;
+
+typedef struct {
+	proc_param_handle_t param;
+} set_handles_t, switch_handles_t;
+
+typedef struct {
+	proc_param_handle_t param;
+	proc_param_handle_t result;
+} unop_handles_t;
+
+typedef struct {
+	proc_param_handle_t param_a;
+	proc_param_handle_t param_b;
+	proc_param_handle_t result;
+} binop_handles_t;
+
+/**
+ * State of an instruction in a frame of a run. Kept in the run rather than in the analysis of the instruction,
+ * as the analysis is shared by concurrent runs of the procedure and isn't written once it's compiled.
+ */
+typedef struct {
+	proc_kernel_t kernel;  // Bound on first execution in the frame, NULL until then
+	int kernel_type;       // Operand type the kernel was bound for
+	uint32_t round_trips;  // Number of remote pulls/pushes done by the instruction
+	uint8_t prefetched;    // Operands pulled by a batched pull (see proc_prefetch_operands) and not used yet, one bit per operand
+	union {
+		block_handles_t block;
+		ifelse_handles_t ifelse;
+		set_handles_t set;
+		unop_handles_t unop;
+		binop_handles_t binop;
+		switch_handles_t switch_;
+	} handles;  // Parameter operands of the instruction, resolved on first use in the frame
+} proc_instruction_state_t;
+
+/**
+ * Local parameters a waiting block instruction is woken by (see proc_block_watch_operands), unwatched once it stops waiting.
+ */
+typedef struct {
+	param_t * params[2];  // NULL for operands that aren't watched
+	unsigned int epoch;   // Stale once proc_runtime_invalidate_params has dropped all watches
+} proc_param_watches_t;
+
+/**
+ * Get the number of remote round trips (parameter pulls and pushes) done by an instruction in a frame.
+ *
+ * @param state The state of the instruction
+ * @return The number of round trips
+ */
+uint32_t proc_instruction_round_trips(proc_instruction_state_t * state);
+
+/**
+ * Handler executing a compiled op.
+ *
+ * @param op The op to execute
+ * @param state State of the instruction in the executing frame
+ * @param registers Scratch registers of the executing frame, allocated by the handler writing the first one
+ * @param write_buffer Buffer for writes to remote parameters
+ * @return 0 to continue at op->next, PROC_OP_BRANCH to continue at op->branch, negative on error
+ */
+typedef int (*proc_op_handler_t)(proc_op_t * op, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer);
+
+/**
+ * An instruction of a compiled procedure (see proc_compile). Ops point into the procedure and its analysis
+ * rather than copying them, and carry the handler and branch targets resolved at compile time, so the
+ * execution loop neither decodes instructions nor tracks if-else state.
+ */
+struct proc_op_t {
+	proc_op_handler_t handler;  // NULL for block, call, jump, loop and switch instructions, which are executed by the execution loop
+	proc_instruction_t * instruction;
+	proc_instruction_analysis_t * instruction_analysis;
+	proc_analysis_t * callee;  // Call: analysis of the called procedure
+	int index;                 // Index of the instruction in its procedure
+	int next;                  // Op to continue with (if-else: when the condition holds), or PROC_CODE_END
+	int branch;                // If-else/if: op to continue with when the condition doesn't hold. Jump/loop: target. Or PROC_CODE_END
+};
+
+/**
+ * Caller of a procedure executing a non-tail call, to return to once the call completes.
+ */
+typedef struct {
+	proc_t * proc;
+	proc_analysis_t * analysis;
+	int pc;                             // Op to continue from in the caller
+	proc_register_t * registers;        // Scratch registers of the caller, restored on return
+	proc_instruction_state_t * states;  // Instruction states of the caller, restored on return
+} proc_frame_t;
+
+/**
+ * Iterations left of a counted loop being executed by a run, kept in the run as procedures are shared by runs.
+ */
+typedef struct {
+	int depth;           // Depth of the call stack the loop runs at
+	int index;           // Index of the loop instruction
+	int start;           // Index of the first instruction of the loop body
+	uint32_t remaining;  // Iterations left after the current one
+} proc_loop_state_t;
+
+/**
+ * State of a procedure run that doesn't hold a thread/task, e.g. while parked on a block instruction.
+ * The block poller evaluates the condition and resumes the run from this state on a thread/task again.
+ */
+typedef struct {
+	proc_t * root_proc;                 // Stored snapshot the run was started with, referenced by root_analysis
+	proc_analysis_t * root_analysis;    // Analysis of root_proc shared with other runs, released when the run ends
+	proc_t * proc;                      // Procedure to continue (differs from root_proc after tail calls)
+	proc_analysis_t * analysis;
+	int pc;                             // Op of the compiled procedure to continue from
+	proc_frame_t * frames;              // Callers of proc, owned by the run (NULL until the first non-tail call)
+	int depth;                          // Number of frames in use
+	int frame_capacity;
+	proc_loop_state_t * loops;          // Counted loops being executed, innermost last, owned by the run (NULL until the first)
+	int loop_count;
+	int loop_capacity;
+	proc_register_t * registers;        // Scratch registers of the executing frame, owned by the run (NULL until the first is written)
+	proc_instruction_state_t * states;  // States of the instructions of proc in the executing frame, owned by the run (NULL until the first executes)
+	uint8_t slot;                       // Slot the run was started from
+	uint8_t parked;                     // Set once the block poller took over the state above, which the run no longer owns
+} proc_continuation_t;
+
 #ifdef __cplusplus
 }
 #endif
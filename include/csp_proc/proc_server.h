@@ -34,9 +34,40 @@ typedef enum {
 	PROC_SLOTS_RESPONSE,
 	PROC_RUN_REQUEST,
 	PROC_RUN_RESPONSE,
+	PROC_CACHE_REQUEST,
+	PROC_CACHE_RESPONSE,
+	PROC_WATCH_REQUEST,
+	PROC_WATCH_RESPONSE,
+	PROC_WATCH_NOTIFY,
 
 } proc_packet_type_e;
 
+/**
+ * Operations of a PROC_CACHE_REQUEST (second byte of the packet).
+ * Both operations respond with the hit/miss counters of the remote parameter list cache.
+ */
+typedef enum {
+	PROC_CACHE_FLUSH,
+	PROC_CACHE_STATS,
+} proc_cache_op_e;
+
+/**
+ * Status of a successful PROC_RUN_RESPONSE (second byte of the packet).
+ * Short non-blocking procedures are run to completion by the server before it responds.
+ */
+typedef enum {
+	PROC_RUN_STARTED,
+	PROC_RUN_COMPLETED,
+} proc_run_status_e;
+
+/**
+ * A PROC_WATCH_REQUEST asks the runtime of a node to evaluate a condition on its local parameters on behalf
+ * of the requesting runtime (offloaded block instruction). It carries the watch id (uint32_t) and the timeout
+ * in ms (uint32_t) followed by the packed condition, and is answered with a PROC_WATCH_RESPONSE.
+ * Once the condition holds, or the timeout is reached (error flag set), the node sends a PROC_WATCH_NOTIFY
+ * carrying the watch id to the proc server of the requesting node. Notifications aren't answered.
+ */
+
 #define PROC_TYPE_MASK 0b00001111
 
 #define PROC_FLAG_END_MASK 0b10000000
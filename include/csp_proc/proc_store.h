@@ -9,6 +9,10 @@ extern "C" {
 #include <csp_proc/proc_mutex.h>
 #include <csp_proc/proc_types.h>
 
+#ifndef PROC_STORE_SPARE_SNAPSHOTS
+#define PROC_STORE_SPARE_SNAPSHOTS (8U)
+#endif  // replaced procedures the static store keeps alive for runs still using them
+
 extern proc_mutex_t * proc_store_mutex;
 
 /**
@@ -44,10 +48,29 @@ int __attribute__((weak)) set_proc(proc_t * proc, uint8_t slot, int overwrite);
  *
  * @param slot The slot to get the procedure from
  *
- * @return The procedure at the specified slot, or NULL if the slot is empty
+ * @return The procedure at the specified slot, or NULL if the slot is empty. It's freed when the procedure of the
+ * slot is replaced or deleted, use get_proc_ref to keep it.
  */
 proc_t * __attribute__((weak)) get_proc(uint8_t slot);
 
+/**
+ * Get a reference to a procedure from the procedure storage.
+ * Stored procedures are immutable: replacing or deleting the procedure of the slot doesn't affect the
+ * returned procedure, which stays valid until released with put_proc.
+ *
+ * @param slot The slot to get the procedure from
+ *
+ * @return The procedure at the specified slot, or NULL if the slot is empty
+ */
+proc_t * __attribute__((weak)) get_proc_ref(uint8_t slot);
+
+/**
+ * Release a procedure reference taken with get_proc_ref.
+ *
+ * @param proc The procedure, or NULL
+ */
+void __attribute__((weak)) put_proc(proc_t * proc);
+
 /**
  * Get the slots of the procedures in the procedure storage with an instruction count greater than 0.
  *
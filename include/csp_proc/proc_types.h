@@ -16,6 +16,8 @@ extern "C" {
 #define MAX_PROC_SLOT 255
 #endif
 
+#define PROC_REGISTER_COUNT 16  // scratch registers r0..r15 of a procedure frame
+
 #ifndef RESERVED_PROC_SLOTS
 #define RESERVED_PROC_SLOTS 0
 #endif
@@ -28,6 +30,12 @@ typedef enum {
 	PROC_BINOP,
 	PROC_CALL,
 	PROC_NOOP,
+	PROC_JUMP,
+	PROC_LOOP,
+	PROC_IF,
+	PROC_ELSE,
+	PROC_ENDIF,
+	PROC_SWITCH,
 } proc_instruction_type_t;
 
 typedef enum {
@@ -61,44 +69,131 @@ typedef enum {
 	OP_XOR,  // ^
 } binary_op_t;
 
+typedef enum {
+	PROC_OPERAND_PARAM,  // Parameter reference
+	PROC_OPERAND_UINT,   // Immediate constants, used by the runtime without any parameter access
+	PROC_OPERAND_INT,
+	PROC_OPERAND_FLOAT,
+	PROC_OPERAND_REGISTER,  // Scratch register of the executing procedure frame
+} proc_operand_kind_t;
+
+/**
+ * Operand of an instruction, either a parameter, an immediate constant or a scratch register.
+ * The array index is stored separately from the name, so the runtime never has to parse it out of the name.
+ * Integer immediates take the type of the operand they're combined with, e.g. `x > 0` works for any integer
+ * or floating point `x`. Results are parameters or registers.
+ */
+typedef struct {
+	char * name;     // Parameter name without array index, NULL for immediates and registers
+	int16_t offset;  // Array index, or -1 if none was given (i.e. all elements)
+	proc_operand_kind_t kind;
+	union {
+		uint64_t u;
+		int64_t i;
+		double f;
+	} value;  // Immediates: the constant. Registers: the register number (u)
+} proc_operand_t;
+
+/**
+ * Condition of an ifelse or if instruction.
+ * An if instruction runs the instructions up to its matching else or endif instruction when the condition holds,
+ * and those following the else instruction up to the matching endif otherwise. If/else/endif can be nested.
+ */
+typedef struct {
+	proc_operand_t param_a;
+	comparison_op_t op;
+	proc_operand_t param_b;
+} proc_ifelse_t;
+
+/**
+ * Block instruction. The condition is polled every `min_period_ms` at first, with the period growing by
+ * `backoff_percent` after each evaluation up to `max_period_ms`. Fields set to 0 use the runtime defaults.
+ * With `offload` set, the condition is instead evaluated by the runtime of the node owning the parameters,
+ * which notifies the procedure host once it holds.
+ */
 typedef struct {
-	char * param_a;
+	proc_operand_t param_a;
 	comparison_op_t op;
-	char * param_b;
-} proc_block_t, proc_ifelse_t;
+	proc_operand_t param_b;
+	uint32_t min_period_ms;
+	uint32_t max_period_ms;
+	uint16_t backoff_percent;  // Period after an evaluation in percent of the period before it (100 = fixed period)
+	uint32_t timeout_ms;
+	uint8_t offload;  // Evaluate the condition on the instruction node instead of polling it from the procedure host
+} proc_block_t;
 
 typedef struct {
-	char * param;
+	proc_operand_t param;
 	char * value;
 } proc_set_t;
 
 typedef struct {
-	char * param;
+	proc_operand_t param;
 	unary_op_t op;
-	char * result;
+	proc_operand_t result;
 } proc_unop_t;
 
 typedef struct {
-	char * param_a;
+	proc_operand_t param_a;
 	binary_op_t op;
-	char * param_b;
-	char * result;
+	proc_operand_t param_b;
+	proc_operand_t result;
 } proc_binop_t;
 
 typedef struct {
 	uint8_t procedure_slot;
 } proc_call_t;
 
+/**
+ * Jump instruction, continuing at instruction `target` of the procedure, or `target` instructions after the
+ * jump (negative to jump back) when `relative` is set. Jumping to the instruction count ends the procedure.
+ */
+typedef struct {
+	int16_t target;
+	uint8_t relative;
+} proc_jump_t;
+
+/**
+ * Counted loop instruction, closing the loop body starting at instruction `target`. The body runs `count` times
+ * (0 = until the procedure is stopped), waiting `period_ms` after each iteration before running it again.
+ */
+typedef struct {
+	uint8_t target;
+	uint32_t count;
+	uint32_t period_ms;
+} proc_loop_t;
+
+typedef struct {
+	int32_t value;
+	uint8_t target;
+} proc_switch_case_t;
+
+/**
+ * Switch instruction, continuing at the `target` instruction of the case matching the value of the integer
+ * parameter `param`, or at `default_target` if no case matches. Like jump targets, a target equal to the
+ * instruction count ends the procedure. Cases are sorted by value without duplicates (checked by proc_analyze),
+ * so the runtime finds the case with a binary search.
+ */
+typedef struct {
+	proc_operand_t param;
+	uint8_t default_target;
+	uint8_t case_count;
+	proc_switch_case_t * cases;
+} proc_switch_t;
+
 typedef struct {
 	uint16_t node;
 	proc_instruction_type_t type;
 	union {
 		proc_block_t block;
-		proc_ifelse_t ifelse;
+		proc_ifelse_t ifelse;  // Also used by PROC_IF
 		proc_set_t set;
 		proc_unop_t unop;
 		proc_binop_t binop;
 		proc_call_t call;
+		proc_jump_t jump;
+		proc_loop_t loop;
+		proc_switch_t switch_;
 	} instruction;
 } proc_instruction_t;
 
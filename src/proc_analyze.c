@@ -3,22 +3,54 @@
 #include <csp_proc/proc_memory.h>
 
 /**
- * Free all memory associated with a proc_analysis_t.
+ * Collect an analysis and the sub-analyses reachable from it, each once, marking them for deallocation.
  *
- * @param analysis The proc_analysis_t to free
+ * @return 0 on success, -1 if memory ran out
  */
-void free_proc_analysis(proc_analysis_t * analysis) {
+static int collect_proc_analyses(proc_analysis_t * analysis, proc_analysis_t *** analyses, size_t * analysis_count) {
+	proc_analysis_t ** grown = proc_realloc(*analyses, (*analysis_count + 1) * sizeof(proc_analysis_t *));
+	if (grown == NULL) {
+		return -1;
+	}
+	*analyses = grown;
+	(*analyses)[(*analysis_count)++] = analysis;
 	analysis->deallocation_mark = 1;
+
 	for (size_t i = 0; i < analysis->sub_analysis_count; i++) {
-		if (analysis->sub_analyses[i] != NULL && analysis->sub_analyses[i] != analysis && analysis->sub_analyses[i]->deallocation_mark == 0) {
-			free_proc_analysis(analysis->sub_analyses[i]);
+		if (analysis->sub_analyses[i] != NULL && analysis->sub_analyses[i]->deallocation_mark == 0) {
+			if (collect_proc_analyses(analysis->sub_analyses[i], analyses, analysis_count) != 0) {
+				return -1;
+			}
 		}
 	}
+	return 0;
+}
+
+/**
+ * Free all memory associated with a proc_analysis_t, and release the stored procedures of its sub-analyses.
+ * The procedure of the analysis itself belongs to the caller.
+ * Sub-analyses can be shared by several callers, so all of them are collected before any is freed.
+ *
+ * @param analysis The proc_analysis_t to free
+ */
+void free_proc_analysis(proc_analysis_t * analysis) {
+	proc_analysis_t ** analyses = NULL;
+	size_t analysis_count = 0;
+	if (collect_proc_analyses(analysis, &analyses, &analysis_count) != 0) {
+		printf("Error allocating memory for freeing analysis\n");
+	}
 
-	proc_free(analysis->sub_analyses);
-	proc_free(analysis->procedure_slots);
-	proc_free(analysis->instruction_analyses);
-	proc_free(analysis);
+	for (size_t i = 0; i < analysis_count; i++) {
+		if (i > 0) {
+			put_proc(analyses[i]->proc);
+		}
+		proc_free(analyses[i]->sub_analyses);
+		proc_free(analyses[i]->procedure_slots);
+		proc_free(analyses[i]->instruction_analyses);
+		proc_free(analyses[i]->code);
+		proc_free(analyses[i]);
+	}
+	proc_free(analyses);
 }
 
 int analyze_tail_call(proc_t * proc, uint8_t i, proc_instruction_analysis_t * instruction_analysis) {
@@ -28,7 +60,7 @@ int analyze_tail_call(proc_t * proc, uint8_t i, proc_instruction_analysis_t * in
 	// If the previous instruction is PROC_IFELSE and there are more than one instruction left, check the remaining instructions
 	if (i > 0 && proc->instructions[i - 1].type == PROC_IFELSE && i + 1 < proc->instruction_count) {
 		for (uint8_t j = i + 2; j < proc->instruction_count; j++) {
-			if (proc->instructions[j].type != PROC_NOOP) {
+			if (proc->instructions[j].type != PROC_NOOP && proc->instructions[j].type != PROC_ENDIF) {
 				instruction_analysis->analysis.call.is_tail_call = 0;
 				break;
 			}
@@ -37,7 +69,7 @@ int analyze_tail_call(proc_t * proc, uint8_t i, proc_instruction_analysis_t * in
 	// If the previous instruction is not PROC_IFELSE, check the remaining instructions
 	else if (i == 0 || proc->instructions[i - 1].type != PROC_IFELSE) {
 		for (uint8_t j = i + 1; j < proc->instruction_count; j++) {
-			if (proc->instructions[j].type != PROC_NOOP) {
+			if (proc->instructions[j].type != PROC_NOOP && proc->instructions[j].type != PROC_ENDIF) {
 				instruction_analysis->analysis.call.is_tail_call = 0;
 				break;
 			}
@@ -47,18 +79,199 @@ int analyze_tail_call(proc_t * proc, uint8_t i, proc_instruction_analysis_t * in
 	return 0;
 }
 
+/**
+ * Find the else or endif instruction closing the clause opened by the if or else instruction at an index,
+ * skipping over nested if/else/endif instructions.
+ *
+ * @return The index of the closing instruction, or -1 if the clause isn't closed
+ */
+static int find_clause_end(proc_t * proc, int index) {
+	int depth = 0;
+	for (int j = index + 1; j < proc->instruction_count; j++) {
+		switch (proc->instructions[j].type) {
+			case PROC_IF:
+				depth++;
+				break;
+			case PROC_ELSE:
+				if (depth == 0) {
+					return j;
+				}
+				break;
+			case PROC_ENDIF:
+				if (depth == 0) {
+					return j;
+				}
+				depth--;
+				break;
+			default:
+				break;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Resolve the branch targets of the if/else/endif instructions of a procedure, checking that they're balanced.
+ * An if instruction continues after its else instruction (or endif) when the condition doesn't hold, and an else
+ * instruction, reached at the end of the if-clause, continues after its endif.
+ *
+ * @return 0 on success, -1 if the instructions aren't balanced or are used as the clause of an ifelse instruction
+ */
+static int analyze_branches(proc_t * proc, proc_analysis_t * analysis) {
+	int depth = 0;
+	for (int i = 0; i < proc->instruction_count; i++) {
+		proc_instruction_type_t type = proc->instructions[i].type;
+		if (type != PROC_IF && type != PROC_ELSE && type != PROC_ENDIF) {
+			continue;
+		}
+
+		if ((i > 0 && proc->instructions[i - 1].type == PROC_IFELSE) || (i > 1 && proc->instructions[i - 2].type == PROC_IFELSE)) {
+			printf("If, else and endif instructions can't be the clause of an ifelse instruction\n");
+			return -1;
+		}
+
+		if (type == PROC_ENDIF) {
+			if (--depth < 0) {
+				printf("Endif instruction %d without if\n", i);
+				return -1;
+			}
+			continue;
+		}
+
+		if (type == PROC_IF) {
+			depth++;
+		} else if (depth == 0) {
+			printf("Else instruction %d without if\n", i);
+			return -1;
+		}
+
+		int end = find_clause_end(proc, i);
+		if (end < 0 || (type == PROC_ELSE && proc->instructions[end].type != PROC_ENDIF)) {
+			printf("Instruction %d isn't closed by an endif\n", i);
+			return -1;
+		}
+		analysis->instruction_analyses[i].target = end + 1;
+	}
+	return 0;
+}
+
+int proc_jump_target(proc_t * proc, int index) {
+	proc_instruction_t * instruction = &proc->instructions[index];
+	int target;
+	switch (instruction->type) {
+		case PROC_JUMP:
+			target = instruction->instruction.jump.target + (instruction->instruction.jump.relative ? index : 0);
+			break;
+		case PROC_LOOP:
+			target = instruction->instruction.loop.target;
+			if (target > index) {
+				return -1;  // The loop body must precede the loop instruction
+			}
+			break;
+		default:
+			return -1;
+	}
+	return (target >= 0 && target <= proc->instruction_count) ? target : -1;
+}
+
+/**
+ * Validate the jump table of a switch instruction: all targets must be in range, and the case values sorted
+ * without duplicates so the runtime can binary search them.
+ *
+ * @return 0 if the table is valid, -1 otherwise
+ */
+static int analyze_switch(proc_t * proc, proc_switch_t * switch_) {
+	if (switch_->default_target > proc->instruction_count) {
+		printf("Switch default target %d out of range\n", switch_->default_target);
+		return -1;
+	}
+	if (switch_->case_count > 0 && switch_->cases == NULL) {
+		printf("Switch cases missing\n");
+		return -1;
+	}
+	for (int j = 0; j < switch_->case_count; j++) {
+		if (switch_->cases[j].target > proc->instruction_count) {
+			printf("Switch case target %d out of range\n", switch_->cases[j].target);
+			return -1;
+		}
+		if (j > 0 && switch_->cases[j].value <= switch_->cases[j - 1].value) {
+			printf("Switch case values must be sorted and unique\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Check that an operand is a named parameter, an existing register or an immediate of a known kind.
+ */
+static int operand_is_valid(proc_operand_t * operand) {
+	switch (operand->kind) {
+		case PROC_OPERAND_PARAM:
+			return operand->name != NULL;
+		case PROC_OPERAND_REGISTER:
+			return operand->value.u < PROC_REGISTER_COUNT;
+		case PROC_OPERAND_UINT:
+		case PROC_OPERAND_INT:
+		case PROC_OPERAND_FLOAT:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Check that an operand can hold a result, i.e. is a named parameter or an existing register.
+ */
+static int operand_is_writable(proc_operand_t * operand) {
+	return (operand->kind == PROC_OPERAND_PARAM || operand->kind == PROC_OPERAND_REGISTER) && operand_is_valid(operand);
+}
+
 int analyze_instruction(proc_t * proc, uint8_t instruction_index, proc_instruction_analysis_t * instruction_analysis) {
 	proc_instruction_t * instruction = &proc->instructions[instruction_index];
 	switch (instruction->type) {
 		case PROC_BLOCK:
+			if (!operand_is_valid(&instruction->instruction.block.param_a) || !operand_is_valid(&instruction->instruction.block.param_b)) {
+				printf("Invalid operand\n");
+				return -1;
+			}
+			if (instruction->instruction.block.param_a.kind == PROC_OPERAND_REGISTER || instruction->instruction.block.param_b.kind == PROC_OPERAND_REGISTER) {
+				printf("Block conditions can't use registers\n");  // The condition is evaluated outside of the run
+				return -1;
+			}
 			break;
 		case PROC_IFELSE:
+		case PROC_IF:
+			if (!operand_is_valid(&instruction->instruction.ifelse.param_a) || !operand_is_valid(&instruction->instruction.ifelse.param_b)) {
+				printf("Invalid operand\n");
+				return -1;
+			}
 			break;
 		case PROC_SET:
+			if (instruction->instruction.set.param.kind != PROC_OPERAND_PARAM) {
+				printf("Set instruction must write a parameter\n");
+				return -1;
+			}
 			break;
 		case PROC_UNOP:
+			if (!operand_is_writable(&instruction->instruction.unop.param) || !operand_is_writable(&instruction->instruction.unop.result)) {
+				printf("Unary operation operands must be parameters or registers\n");
+				return -1;
+			}
 			break;
 		case PROC_BINOP:
+			if (!operand_is_valid(&instruction->instruction.binop.param_a) || !operand_is_valid(&instruction->instruction.binop.param_b)) {
+				printf("Invalid operand\n");
+				return -1;
+			}
+			if (!operand_is_writable(&instruction->instruction.binop.result)) {
+				printf("Binary operation result must be a parameter or register\n");
+				return -1;
+			}
+			if (!operand_is_writable(&instruction->instruction.binop.param_a) && !operand_is_writable(&instruction->instruction.binop.param_b)) {
+				printf("Binary operation needs at least one parameter or register operand\n");
+				return -1;
+			}
 			break;
 		case PROC_CALL:
 			if (analyze_tail_call(proc, instruction_index, instruction_analysis) != 0) {
@@ -66,6 +279,22 @@ int analyze_instruction(proc_t * proc, uint8_t instruction_index, proc_instructi
 				return -1;
 			}
 			break;
+		case PROC_JUMP:
+		case PROC_LOOP:
+			if (proc_jump_target(proc, instruction_index) < 0) {
+				printf("Jump target out of range\n");
+				return -1;
+			}
+			break;
+		case PROC_SWITCH:
+			if (instruction->instruction.switch_.param.kind != PROC_OPERAND_PARAM) {
+				printf("Switch instruction must switch on a parameter\n");
+				return -1;
+			}
+			if (analyze_switch(proc, &instruction->instruction.switch_) != 0) {
+				return -1;
+			}
+			break;
 		default:
 			break;
 	}
@@ -84,6 +313,8 @@ int proc_analyze(proc_t * proc, proc_analysis_t * analysis, proc_analysis_config
 	printf("Analyzing procedure\n");
 	analysis->proc = proc;
 	analysis->deallocation_mark = 0;
+	analysis->is_bounded_nonblocking = 1;
+	analysis->refs = 0;
 
 	analysis->sub_analyses = NULL;
 	analysis->sub_analysis_count = 0;
@@ -91,6 +322,9 @@ int proc_analyze(proc_t * proc, proc_analysis_t * analysis, proc_analysis_config
 	analysis->procedure_slots = NULL;
 	analysis->procedure_slot_count = 0;
 
+	analysis->code = NULL;
+	analysis->code_length = 0;
+
 	analysis->instruction_analyses = proc_calloc(proc->instruction_count, sizeof(proc_instruction_analysis_t));
 	if (analysis->instruction_analyses == NULL) {
 		printf("Error allocating memory for instruction_analyses\n");
@@ -107,6 +341,11 @@ int proc_analyze(proc_t * proc, proc_analysis_t * analysis, proc_analysis_config
 			return -1;
 		}
 
+		// Blocks, calls and loop periods may take arbitrarily long, and remote operands wait for other nodes
+		if (instruction->type == PROC_BLOCK || instruction->type == PROC_CALL || instruction->node != 0 || (instruction->type == PROC_LOOP && instruction->instruction.loop.period_ms != 0)) {
+			analysis->is_bounded_nonblocking = 0;
+		}
+
 		if (instruction->type == PROC_CALL) {
 			// Special handling for call instructions which require recursive analysis
 
@@ -125,21 +364,23 @@ int proc_analyze(proc_t * proc, proc_analysis_t * analysis, proc_analysis_config
 				return -1;
 			}
 
-			proc_t * sub_proc = get_proc(instruction->instruction.call.procedure_slot);
-			if (sub_proc == NULL) {
-				printf("Error fetching sub-procedure from procedure store\n");
-				return -1;
-			}
-
 			proc_analysis_t * sub_analysis = NULL;
 
 			if (config->analyzed_procs[instruction->instruction.call.procedure_slot] == 1) {
 				// Procedure is already in the call stack
 				sub_analysis = config->analyses[instruction->instruction.call.procedure_slot];
 			} else {
+				// The sub-analysis holds a reference to the stored procedure, released by free_proc_analysis
+				proc_t * sub_proc = get_proc_ref(instruction->instruction.call.procedure_slot);
+				if (sub_proc == NULL) {
+					printf("Error fetching sub-procedure from procedure store\n");
+					return -1;
+				}
+
 				sub_analysis = proc_malloc(sizeof(proc_analysis_t));
 				if (sub_analysis == NULL) {
 					printf("Error allocating memory for sub_analysis\n");
+					put_proc(sub_proc);
 					return -1;
 				}
 
@@ -154,6 +395,11 @@ int proc_analyze(proc_t * proc, proc_analysis_t * analysis, proc_analysis_config
 		}
 	}
 
+	if (analyze_branches(proc, analysis) != 0) {
+		printf("Error analyzing if/else/endif instructions\n");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -126,6 +126,15 @@ int proc_slots_request(uint8_t * slots, uint8_t * slot_count, int host, int time
 	return ret;
 }
 
+int process_run_response(csp_packet_t * packet, void * arg) {
+	proc_run_status_e * status = (proc_run_status_e *)arg;
+
+	// Servers predating inline runs respond without a status
+	*status = (packet->length >= 2) ? (proc_run_status_e)packet->data[1] : PROC_RUN_STARTED;
+
+	return 0;
+}
+
 int proc_run_request(uint8_t proc_slot, int host, int timeout) {
 	csp_packet_t * packet = csp_buffer_get(0);
 	if (packet == NULL)
@@ -139,3 +148,92 @@ int proc_run_request(uint8_t proc_slot, int host, int timeout) {
 
 	return proc_transaction(packet, NULL, NULL, host, timeout);
 }
+
+int proc_run_request_status(uint8_t proc_slot, proc_run_status_e * status, int host, int timeout) {
+	csp_packet_t * packet = csp_buffer_get(0);
+	if (packet == NULL)
+		return -2;
+
+	packet->data[0] = PROC_RUN_REQUEST;
+	packet->data[0] |= PROC_FLAG_END;
+	packet->data[1] = proc_slot;
+	packet->id.pri = CSP_PRIO_HIGH;
+	packet->length = 2;
+
+	return proc_transaction(packet, process_run_response, status, host, timeout);
+}
+
+int process_cache_response(csp_packet_t * packet, void * arg) {
+	uint32_t * hits = ((uint32_t **)arg)[0];
+	uint32_t * misses = ((uint32_t **)arg)[1];
+
+	if (packet->length < 1 + 2 * sizeof(uint32_t)) {
+		return -1;
+	}
+	memcpy(hits, packet->data + 1, sizeof(uint32_t));
+	memcpy(misses, packet->data + 1 + sizeof(uint32_t), sizeof(uint32_t));
+
+	return 0;
+}
+
+int proc_cache_request(proc_cache_op_e op, uint16_t node, uint32_t * hits, uint32_t * misses, int host, int timeout) {
+	csp_packet_t * packet = csp_buffer_get(0);
+	if (packet == NULL)
+		return -2;
+
+	packet->data[0] = PROC_CACHE_REQUEST;
+	packet->data[0] |= PROC_FLAG_END;
+	packet->data[1] = (uint8_t)op;
+	memcpy(packet->data + 2, &node, sizeof(uint16_t));
+	packet->id.pri = CSP_PRIO_NORM;
+	packet->length = 2 + sizeof(uint16_t);
+
+	void * callback_arg[] = {hits, misses};
+	return proc_transaction(packet, process_cache_response, callback_arg, host, timeout);
+}
+
+int proc_watch_request(proc_ifelse_t * condition, uint32_t timeout_ms, uint32_t watch_id, int host, int timeout) {
+	csp_packet_t * packet = csp_buffer_get(0);
+	if (packet == NULL)
+		return -2;
+
+	packet->data[0] = PROC_WATCH_REQUEST;
+	packet->data[0] |= PROC_FLAG_END;
+	memcpy(packet->data + 1, &watch_id, sizeof(uint32_t));
+	memcpy(packet->data + 1 + sizeof(uint32_t), &timeout_ms, sizeof(uint32_t));
+	int length = pack_condition_into_csp_packet(condition, packet, 1 + 2 * sizeof(uint32_t));
+	if (length < 0) {
+		printf("Condition too large to fit into packet\n");
+		csp_buffer_free(packet);
+		return -1;
+	}
+	packet->id.pri = CSP_PRIO_NORM;
+	packet->length = length;
+
+	return proc_transaction(packet, NULL, NULL, host, timeout);
+}
+
+int proc_watch_notify(uint32_t watch_id, int holds, int host) {
+	csp_packet_t * packet = csp_buffer_get(0);
+	if (packet == NULL)
+		return -2;
+
+	packet->data[0] = PROC_WATCH_NOTIFY;
+	packet->data[0] |= PROC_FLAG_END;
+	if (!holds) {
+		packet->data[0] |= PROC_FLAG_ERROR;
+	}
+	memcpy(packet->data + 1, &watch_id, sizeof(uint32_t));
+	packet->id.pri = CSP_PRIO_NORM;
+	packet->length = 1 + sizeof(uint32_t);
+
+	csp_conn_t * conn = csp_connect(packet->id.pri, host, PROC_PORT_SERVER, 0, CSP_O_CRC32);
+	if (conn == NULL) {
+		printf("proc watch notify failure\n");
+		csp_buffer_free(packet);
+		return -1;
+	}
+	csp_send(conn, packet);
+	csp_close(conn);
+	return 0;
+}
@@ -5,6 +5,60 @@
 #include <string.h>
 #include <stdint.h>
 
+/**
+ * Parameter operands are packed as the null-terminated parameter name followed by the array index (int16_t).
+ * Immediates are packed as an empty name followed by their kind (uint8_t) and value (8 bytes), so packed
+ * parameter operands are the same as before immediates were introduced.
+ */
+#define IMMEDIATE_OPERAND_SIZE (1 + sizeof(uint8_t) + sizeof(uint64_t))
+
+static int calc_operand_size(proc_operand_t * operand) {
+	if (operand->kind != PROC_OPERAND_PARAM) {
+		return IMMEDIATE_OPERAND_SIZE;
+	}
+	return strlen(operand->name) + 1 + sizeof(int16_t);
+}
+
+static int pack_operand(proc_operand_t * operand, void * dst) {
+	if (operand->kind != PROC_OPERAND_PARAM) {
+		uint8_t kind = (uint8_t)operand->kind;
+		*(uint8_t *)dst = '\0';
+		memcpy((uint8_t *)dst + 1, &kind, sizeof(uint8_t));
+		memcpy((uint8_t *)dst + 1 + sizeof(uint8_t), &operand->value, sizeof(uint64_t));
+		return IMMEDIATE_OPERAND_SIZE;
+	}
+
+	int name_size = strlen(operand->name) + 1;
+	memcpy(dst, operand->name, name_size);
+	memcpy((uint8_t *)dst + name_size, &operand->offset, sizeof(int16_t));
+	return name_size + sizeof(int16_t);
+}
+
+static int unpack_operand(proc_operand_t * operand, void * src) {
+	if (*(char *)src == '\0') {
+		uint8_t kind;
+		memcpy(&kind, (uint8_t *)src + 1, sizeof(uint8_t));
+		operand->name = NULL;
+		operand->offset = -1;
+		operand->kind = (proc_operand_kind_t)kind;
+		memcpy(&operand->value, (uint8_t *)src + 1 + sizeof(uint8_t), sizeof(uint64_t));
+		return IMMEDIATE_OPERAND_SIZE;
+	}
+
+	int name_size = strlen((char *)src) + 1;
+	operand->name = proc_strdup((char *)src);
+	memcpy(&operand->offset, (uint8_t *)src + name_size, sizeof(int16_t));
+	operand->kind = PROC_OPERAND_PARAM;
+	return name_size + sizeof(int16_t);
+}
+
+static void proc_copy_operand(proc_operand_t * operand, proc_operand_t * copy) {
+	*copy = *operand;
+	if (operand->kind == PROC_OPERAND_PARAM) {
+		copy->name = proc_strdup(operand->name);
+	}
+}
+
 /**
  * Calculate the size of a proc_t procedure in bytes
  *
@@ -22,29 +76,54 @@ int calc_proc_size(proc_t * procedure) {
 		switch (procedure->instructions[i].type) {
 			case PROC_BLOCK:
 			case PROC_IFELSE:
+			case PROC_IF:
 				total_size += sizeof(procedure->instructions[i].instruction.block.op);
-				total_size += strlen(procedure->instructions[i].instruction.block.param_a) + 1;
-				total_size += strlen(procedure->instructions[i].instruction.block.param_b) + 1;
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.block.param_a);
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.block.param_b);
+				if (procedure->instructions[i].type == PROC_BLOCK) {
+					total_size += sizeof(procedure->instructions[i].instruction.block.min_period_ms);
+					total_size += sizeof(procedure->instructions[i].instruction.block.max_period_ms);
+					total_size += sizeof(procedure->instructions[i].instruction.block.backoff_percent);
+					total_size += sizeof(procedure->instructions[i].instruction.block.timeout_ms);
+					total_size += sizeof(procedure->instructions[i].instruction.block.offload);
+				}
 				break;
 			case PROC_SET:
-				total_size += strlen(procedure->instructions[i].instruction.set.param) + 1;
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.set.param);
 				total_size += strlen(procedure->instructions[i].instruction.set.value) + 1;
 				break;
 			case PROC_UNOP:
 				total_size += sizeof(procedure->instructions[i].instruction.unop.op);
-				total_size += strlen(procedure->instructions[i].instruction.unop.param) + 1;
-				total_size += strlen(procedure->instructions[i].instruction.unop.result) + 1;
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.unop.param);
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.unop.result);
 				break;
 			case PROC_BINOP:
 				total_size += sizeof(procedure->instructions[i].instruction.binop.op);
-				total_size += strlen(procedure->instructions[i].instruction.binop.param_a) + 1;
-				total_size += strlen(procedure->instructions[i].instruction.binop.param_b) + 1;
-				total_size += strlen(procedure->instructions[i].instruction.binop.result) + 1;
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.binop.param_a);
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.binop.param_b);
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.binop.result);
 				break;
 			case PROC_CALL:
 				total_size += sizeof(procedure->instructions[i].instruction.call.procedure_slot);
 				break;
+			case PROC_JUMP:
+				total_size += sizeof(procedure->instructions[i].instruction.jump.target);
+				total_size += sizeof(procedure->instructions[i].instruction.jump.relative);
+				break;
+			case PROC_LOOP:
+				total_size += sizeof(procedure->instructions[i].instruction.loop.target);
+				total_size += sizeof(procedure->instructions[i].instruction.loop.count);
+				total_size += sizeof(procedure->instructions[i].instruction.loop.period_ms);
+				break;
+			case PROC_SWITCH:
+				total_size += calc_operand_size(&procedure->instructions[i].instruction.switch_.param);
+				total_size += sizeof(procedure->instructions[i].instruction.switch_.default_target);
+				total_size += sizeof(procedure->instructions[i].instruction.switch_.case_count);
+				total_size += procedure->instructions[i].instruction.switch_.case_count * (sizeof(int32_t) + sizeof(uint8_t));
+				break;
 			case PROC_NOOP:
+			case PROC_ELSE:
+			case PROC_ENDIF:
 				break;
 			default:
 				printf("Unknown instruction type %d\n", procedure->instructions[i].type);
@@ -55,6 +134,49 @@ int calc_proc_size(proc_t * procedure) {
 	return total_size;
 }
 
+int pack_condition_into_csp_packet(proc_ifelse_t * condition, csp_packet_t * packet, int offset) {
+	int size = calc_operand_size(&condition->param_a) + sizeof(comparison_op_t) + calc_operand_size(&condition->param_b);
+	if (offset + size > CSP_BUFFER_SIZE) {
+		return -1;  // Condition is too large to fit into the packet
+	}
+
+	offset += pack_operand(&condition->param_a, packet->data + offset);
+	memcpy(packet->data + offset, &condition->op, sizeof(comparison_op_t));
+	offset += sizeof(comparison_op_t);
+	offset += pack_operand(&condition->param_b, packet->data + offset);
+	return offset;
+}
+
+/**
+ * Check that a packed operand starting at `offset` lies within the packet.
+ */
+static int operand_in_packet(csp_packet_t * packet, int offset) {
+	if (offset >= packet->length) {
+		return 0;
+	}
+	if (packet->data[offset] == '\0') {
+		return offset + (int)IMMEDIATE_OPERAND_SIZE <= packet->length;
+	}
+	uint8_t * name_end = memchr(packet->data + offset, '\0', packet->length - offset);
+	return name_end != NULL && (name_end - packet->data) + 1 + (int)sizeof(int16_t) <= packet->length;
+}
+
+int unpack_condition_from_csp_packet(proc_ifelse_t * condition, csp_packet_t * packet, int offset) {
+	if (!operand_in_packet(packet, offset)) {
+		return -1;
+	}
+	offset += unpack_operand(&condition->param_a, packet->data + offset);
+
+	if (offset + (int)sizeof(comparison_op_t) > packet->length || !operand_in_packet(packet, offset + sizeof(comparison_op_t))) {
+		proc_free(condition->param_a.name);
+		return -1;
+	}
+	memcpy(&condition->op, packet->data + offset, sizeof(comparison_op_t));
+	offset += sizeof(comparison_op_t);
+	offset += unpack_operand(&condition->param_b, packet->data + offset);
+	return offset;
+}
+
 int pack_proc_into_csp_packet(proc_t * procedure, csp_packet_t * packet) {
 	int total_size = calc_proc_size(procedure);
 
@@ -84,42 +206,76 @@ int pack_proc_into_csp_packet(proc_t * procedure, csp_packet_t * packet) {
 			// Ensure all strings are null-terminated !
 			case PROC_BLOCK:
 			case PROC_IFELSE:
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.block.param_a, strlen(procedure->instructions[i].instruction.block.param_a) + 1);
-				offset += strlen(procedure->instructions[i].instruction.block.param_a) + 1;
+			case PROC_IF:
+				offset += pack_operand(&procedure->instructions[i].instruction.block.param_a, packet->data + offset);
 				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.block.op), sizeof(comparison_op_t));
 				offset += sizeof(comparison_op_t);
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.block.param_b, strlen(procedure->instructions[i].instruction.block.param_b) + 1);
-				offset += strlen(procedure->instructions[i].instruction.block.param_b) + 1;
+				offset += pack_operand(&procedure->instructions[i].instruction.block.param_b, packet->data + offset);
+				if (procedure->instructions[i].type == PROC_BLOCK) {
+					memcpy(packet->data + offset, &(procedure->instructions[i].instruction.block.min_period_ms), sizeof(uint32_t));
+					offset += sizeof(uint32_t);
+					memcpy(packet->data + offset, &(procedure->instructions[i].instruction.block.max_period_ms), sizeof(uint32_t));
+					offset += sizeof(uint32_t);
+					memcpy(packet->data + offset, &(procedure->instructions[i].instruction.block.backoff_percent), sizeof(uint16_t));
+					offset += sizeof(uint16_t);
+					memcpy(packet->data + offset, &(procedure->instructions[i].instruction.block.timeout_ms), sizeof(uint32_t));
+					offset += sizeof(uint32_t);
+					memcpy(packet->data + offset, &(procedure->instructions[i].instruction.block.offload), sizeof(uint8_t));
+					offset += sizeof(uint8_t);
+				}
 				break;
 			case PROC_SET:
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.set.param, strlen(procedure->instructions[i].instruction.set.param) + 1);
-				offset += strlen(procedure->instructions[i].instruction.set.param) + 1;
+				offset += pack_operand(&procedure->instructions[i].instruction.set.param, packet->data + offset);
 				memcpy(packet->data + offset, procedure->instructions[i].instruction.set.value, strlen(procedure->instructions[i].instruction.set.value) + 1);
 				offset += strlen(procedure->instructions[i].instruction.set.value) + 1;
 				break;
 			case PROC_UNOP:
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.unop.param, strlen(procedure->instructions[i].instruction.unop.param) + 1);
-				offset += strlen(procedure->instructions[i].instruction.unop.param) + 1;
+				offset += pack_operand(&procedure->instructions[i].instruction.unop.param, packet->data + offset);
 				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.unop.op), sizeof(unary_op_t));
 				offset += sizeof(unary_op_t);
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.unop.result, strlen(procedure->instructions[i].instruction.unop.result) + 1);
-				offset += strlen(procedure->instructions[i].instruction.unop.result) + 1;
+				offset += pack_operand(&procedure->instructions[i].instruction.unop.result, packet->data + offset);
 				break;
 			case PROC_BINOP:
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.binop.param_a, strlen(procedure->instructions[i].instruction.binop.param_a) + 1);
-				offset += strlen(procedure->instructions[i].instruction.binop.param_a) + 1;
+				offset += pack_operand(&procedure->instructions[i].instruction.binop.param_a, packet->data + offset);
 				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.binop.op), sizeof(binary_op_t));
 				offset += sizeof(binary_op_t);
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.binop.param_b, strlen(procedure->instructions[i].instruction.binop.param_b) + 1);
-				offset += strlen(procedure->instructions[i].instruction.binop.param_b) + 1;
-				memcpy(packet->data + offset, procedure->instructions[i].instruction.binop.result, strlen(procedure->instructions[i].instruction.binop.result) + 1);
-				offset += strlen(procedure->instructions[i].instruction.binop.result) + 1;
+				offset += pack_operand(&procedure->instructions[i].instruction.binop.param_b, packet->data + offset);
+				offset += pack_operand(&procedure->instructions[i].instruction.binop.result, packet->data + offset);
 				break;
 			case PROC_CALL:
 				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.call.procedure_slot), sizeof(uint8_t));
 				offset += sizeof(uint8_t);
 				break;
+			case PROC_JUMP:
+				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.jump.target), sizeof(int16_t));
+				offset += sizeof(int16_t);
+				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.jump.relative), sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				break;
+			case PROC_LOOP:
+				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.loop.target), sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.loop.count), sizeof(uint32_t));
+				offset += sizeof(uint32_t);
+				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.loop.period_ms), sizeof(uint32_t));
+				offset += sizeof(uint32_t);
+				break;
+			case PROC_SWITCH:
+				offset += pack_operand(&procedure->instructions[i].instruction.switch_.param, packet->data + offset);
+				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.switch_.default_target), sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				memcpy(packet->data + offset, &(procedure->instructions[i].instruction.switch_.case_count), sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				for (int j = 0; j < procedure->instructions[i].instruction.switch_.case_count; j++) {
+					memcpy(packet->data + offset, &(procedure->instructions[i].instruction.switch_.cases[j].value), sizeof(int32_t));
+					offset += sizeof(int32_t);
+					memcpy(packet->data + offset, &(procedure->instructions[i].instruction.switch_.cases[j].target), sizeof(uint8_t));
+					offset += sizeof(uint8_t);
+				}
+				break;
 			case PROC_NOOP:
+			case PROC_ELSE:
+			case PROC_ENDIF:
 				break;
 			default:
 				printf("Unknown instruction type %d\n", procedure->instructions[i].type);
@@ -154,42 +310,83 @@ int unpack_proc_from_csp_packet(proc_t * procedure, csp_packet_t * packet) {
 		switch (procedure->instructions[i].type) {
 			case PROC_BLOCK:
 			case PROC_IFELSE:
-				procedure->instructions[i].instruction.block.param_a = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
+			case PROC_IF:
+				offset += unpack_operand(&procedure->instructions[i].instruction.block.param_a, packet->data + offset);
 				memcpy(&procedure->instructions[i].instruction.block.op, packet->data + offset, sizeof(comparison_op_t));
 				offset += sizeof(comparison_op_t);
-				procedure->instructions[i].instruction.block.param_b = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
+				offset += unpack_operand(&procedure->instructions[i].instruction.block.param_b, packet->data + offset);
+				if (procedure->instructions[i].type == PROC_BLOCK) {
+					memcpy(&procedure->instructions[i].instruction.block.min_period_ms, packet->data + offset, sizeof(uint32_t));
+					offset += sizeof(uint32_t);
+					memcpy(&procedure->instructions[i].instruction.block.max_period_ms, packet->data + offset, sizeof(uint32_t));
+					offset += sizeof(uint32_t);
+					memcpy(&procedure->instructions[i].instruction.block.backoff_percent, packet->data + offset, sizeof(uint16_t));
+					offset += sizeof(uint16_t);
+					memcpy(&procedure->instructions[i].instruction.block.timeout_ms, packet->data + offset, sizeof(uint32_t));
+					offset += sizeof(uint32_t);
+					memcpy(&procedure->instructions[i].instruction.block.offload, packet->data + offset, sizeof(uint8_t));
+					offset += sizeof(uint8_t);
+				}
 				break;
 			case PROC_SET:
-				procedure->instructions[i].instruction.set.param = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
+				offset += unpack_operand(&procedure->instructions[i].instruction.set.param, packet->data + offset);
 				procedure->instructions[i].instruction.set.value = proc_strdup(packet->data + offset);
 				offset += strlen(packet->data + offset) + 1;
 				break;
 			case PROC_UNOP:
-				procedure->instructions[i].instruction.unop.param = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
+				offset += unpack_operand(&procedure->instructions[i].instruction.unop.param, packet->data + offset);
 				memcpy(&procedure->instructions[i].instruction.unop.op, packet->data + offset, sizeof(unary_op_t));
 				offset += sizeof(unary_op_t);
-				procedure->instructions[i].instruction.unop.result = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
+				offset += unpack_operand(&procedure->instructions[i].instruction.unop.result, packet->data + offset);
 				break;
 			case PROC_BINOP:
-				procedure->instructions[i].instruction.binop.param_a = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
+				offset += unpack_operand(&procedure->instructions[i].instruction.binop.param_a, packet->data + offset);
 				memcpy(&procedure->instructions[i].instruction.binop.op, packet->data + offset, sizeof(binary_op_t));
 				offset += sizeof(binary_op_t);
-				procedure->instructions[i].instruction.binop.param_b = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
-				procedure->instructions[i].instruction.binop.result = proc_strdup(packet->data + offset);
-				offset += strlen(packet->data + offset) + 1;
+				offset += unpack_operand(&procedure->instructions[i].instruction.binop.param_b, packet->data + offset);
+				offset += unpack_operand(&procedure->instructions[i].instruction.binop.result, packet->data + offset);
 				break;
 			case PROC_CALL:
 				memcpy(&procedure->instructions[i].instruction.call.procedure_slot, packet->data + offset, sizeof(uint8_t));
 				offset += sizeof(uint8_t);
 				break;
+			case PROC_JUMP:
+				memcpy(&procedure->instructions[i].instruction.jump.target, packet->data + offset, sizeof(int16_t));
+				offset += sizeof(int16_t);
+				memcpy(&procedure->instructions[i].instruction.jump.relative, packet->data + offset, sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				break;
+			case PROC_LOOP:
+				memcpy(&procedure->instructions[i].instruction.loop.target, packet->data + offset, sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				memcpy(&procedure->instructions[i].instruction.loop.count, packet->data + offset, sizeof(uint32_t));
+				offset += sizeof(uint32_t);
+				memcpy(&procedure->instructions[i].instruction.loop.period_ms, packet->data + offset, sizeof(uint32_t));
+				offset += sizeof(uint32_t);
+				break;
+			case PROC_SWITCH:
+				offset += unpack_operand(&procedure->instructions[i].instruction.switch_.param, packet->data + offset);
+				memcpy(&procedure->instructions[i].instruction.switch_.default_target, packet->data + offset, sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				memcpy(&procedure->instructions[i].instruction.switch_.case_count, packet->data + offset, sizeof(uint8_t));
+				offset += sizeof(uint8_t);
+				// One spare entry, so an empty table isn't mistaken for a failed allocation
+				procedure->instructions[i].instruction.switch_.cases = proc_calloc(procedure->instructions[i].instruction.switch_.case_count + 1, sizeof(proc_switch_case_t));
+				if (procedure->instructions[i].instruction.switch_.cases == NULL) {
+					printf("Error allocating memory for switch cases\n");
+					procedure->instructions[i].instruction.switch_.case_count = 0;
+					return -1;
+				}
+				for (int j = 0; j < procedure->instructions[i].instruction.switch_.case_count; j++) {
+					memcpy(&procedure->instructions[i].instruction.switch_.cases[j].value, packet->data + offset, sizeof(int32_t));
+					offset += sizeof(int32_t);
+					memcpy(&procedure->instructions[i].instruction.switch_.cases[j].target, packet->data + offset, sizeof(uint8_t));
+					offset += sizeof(uint8_t);
+				}
+				break;
 			case PROC_NOOP:
+			case PROC_ELSE:
+			case PROC_ENDIF:
 				break;
 			default:
 				printf("Unknown instruction type %d\n", procedure->instructions[i].type);
@@ -204,24 +401,33 @@ void proc_free_instruction(proc_instruction_t * instruction) {
 	switch (instruction->type) {
 		case PROC_BLOCK:
 		case PROC_IFELSE:
-			proc_free(instruction->instruction.block.param_a);
-			proc_free(instruction->instruction.block.param_b);
+		case PROC_IF:
+			proc_free(instruction->instruction.block.param_a.name);
+			proc_free(instruction->instruction.block.param_b.name);
 			break;
 		case PROC_SET:
-			proc_free(instruction->instruction.set.param);
+			proc_free(instruction->instruction.set.param.name);
 			proc_free(instruction->instruction.set.value);
 			break;
 		case PROC_UNOP:
-			proc_free(instruction->instruction.unop.param);
-			proc_free(instruction->instruction.unop.result);
+			proc_free(instruction->instruction.unop.param.name);
+			proc_free(instruction->instruction.unop.result.name);
 			break;
 		case PROC_BINOP:
-			proc_free(instruction->instruction.binop.param_a);
-			proc_free(instruction->instruction.binop.param_b);
-			proc_free(instruction->instruction.binop.result);
+			proc_free(instruction->instruction.binop.param_a.name);
+			proc_free(instruction->instruction.binop.param_b.name);
+			proc_free(instruction->instruction.binop.result.name);
+			break;
+		case PROC_SWITCH:
+			proc_free(instruction->instruction.switch_.param.name);
+			proc_free(instruction->instruction.switch_.cases);
 			break;
 		case PROC_CALL:
 		case PROC_NOOP:
+		case PROC_JUMP:
+		case PROC_LOOP:
+		case PROC_ELSE:
+		case PROC_ENDIF:
 			break;
 		default:
 			printf("Unknown instruction type %d\n", instruction->type);
@@ -248,29 +454,57 @@ int proc_copy_instruction(proc_instruction_t * instruction, proc_instruction_t *
 	switch (instruction->type) {
 		case PROC_BLOCK:
 		case PROC_IFELSE:
-			copy->instruction.block.param_a = proc_strdup(instruction->instruction.block.param_a);
-			copy->instruction.block.param_b = proc_strdup(instruction->instruction.block.param_b);
+		case PROC_IF:
+			proc_copy_operand(&instruction->instruction.block.param_a, &copy->instruction.block.param_a);
+			proc_copy_operand(&instruction->instruction.block.param_b, &copy->instruction.block.param_b);
 			copy->instruction.block.op = instruction->instruction.block.op;
+			if (instruction->type == PROC_BLOCK) {
+				copy->instruction.block.min_period_ms = instruction->instruction.block.min_period_ms;
+				copy->instruction.block.max_period_ms = instruction->instruction.block.max_period_ms;
+				copy->instruction.block.backoff_percent = instruction->instruction.block.backoff_percent;
+				copy->instruction.block.timeout_ms = instruction->instruction.block.timeout_ms;
+				copy->instruction.block.offload = instruction->instruction.block.offload;
+			}
 			break;
 		case PROC_SET:
-			copy->instruction.set.param = proc_strdup(instruction->instruction.set.param);
+			proc_copy_operand(&instruction->instruction.set.param, &copy->instruction.set.param);
 			copy->instruction.set.value = proc_strdup(instruction->instruction.set.value);
 			break;
 		case PROC_UNOP:
-			copy->instruction.unop.param = proc_strdup(instruction->instruction.unop.param);
-			copy->instruction.unop.result = proc_strdup(instruction->instruction.unop.result);
+			proc_copy_operand(&instruction->instruction.unop.param, &copy->instruction.unop.param);
+			proc_copy_operand(&instruction->instruction.unop.result, &copy->instruction.unop.result);
 			copy->instruction.unop.op = instruction->instruction.unop.op;
 			break;
 		case PROC_BINOP:
-			copy->instruction.binop.param_a = proc_strdup(instruction->instruction.binop.param_a);
-			copy->instruction.binop.param_b = proc_strdup(instruction->instruction.binop.param_b);
-			copy->instruction.binop.result = proc_strdup(instruction->instruction.binop.result);
+			proc_copy_operand(&instruction->instruction.binop.param_a, &copy->instruction.binop.param_a);
+			proc_copy_operand(&instruction->instruction.binop.param_b, &copy->instruction.binop.param_b);
+			proc_copy_operand(&instruction->instruction.binop.result, &copy->instruction.binop.result);
 			copy->instruction.binop.op = instruction->instruction.binop.op;
 			break;
 		case PROC_CALL:
 			copy->instruction.call.procedure_slot = instruction->instruction.call.procedure_slot;
 			break;
+		case PROC_JUMP:
+			copy->instruction.jump = instruction->instruction.jump;
+			break;
+		case PROC_LOOP:
+			copy->instruction.loop = instruction->instruction.loop;
+			break;
+		case PROC_SWITCH:
+			proc_copy_operand(&instruction->instruction.switch_.param, &copy->instruction.switch_.param);
+			copy->instruction.switch_.default_target = instruction->instruction.switch_.default_target;
+			copy->instruction.switch_.case_count = instruction->instruction.switch_.case_count;
+			copy->instruction.switch_.cases = proc_calloc(instruction->instruction.switch_.case_count + 1, sizeof(proc_switch_case_t));
+			if (copy->instruction.switch_.cases == NULL) {
+				printf("proc_copy_instruction: error allocating memory for switch cases\n");
+				copy->instruction.switch_.case_count = 0;
+				return -1;
+			}
+			memcpy(copy->instruction.switch_.cases, instruction->instruction.switch_.cases, instruction->instruction.switch_.case_count * sizeof(proc_switch_case_t));
+			break;
 		case PROC_NOOP:
+		case PROC_ELSE:
+		case PROC_ENDIF:
 			break;
 		default:
 			printf("Unknown instruction type %d\n", instruction->type);
@@ -5,6 +5,7 @@
 #include <csp_proc/proc_memory.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <csp/csp_types.h>
 #include <csp/csp.h>
 
@@ -43,7 +44,8 @@ static void proc_serve_del_request(csp_packet_t * packet) {
 
 static void proc_serve_pull_request(csp_packet_t * packet) {
 	uint8_t slot = packet->data[1];
-	proc_t * procedure = get_proc(slot);
+	// Held until packed, so a concurrent push can't free the procedure meanwhile
+	proc_t * procedure = get_proc_ref(slot);
 	if (procedure == NULL) {
 		printf("Procedure not found\n");
 		packet->data[0] = PROC_PULL_RESPONSE;
@@ -55,6 +57,7 @@ static void proc_serve_pull_request(csp_packet_t * packet) {
 	}
 
 	int ret = pack_proc_into_csp_packet(procedure, packet);
+	put_proc(procedure);
 	if (ret < 0) {
 		printf("Failed to pack procedure to packet\n");
 		packet->data[0] = PROC_PULL_RESPONSE;
@@ -94,6 +97,17 @@ static void proc_serve_push_request(csp_packet_t * packet) {
 		return;
 	}
 
+	if (proc_runtime_check != NULL && proc_runtime_check(procedure) != 0) {
+		printf("Procedure rejected by type check\n");
+		free_proc(procedure);
+		packet->data[0] = PROC_PUSH_RESPONSE;
+		packet->data[0] |= PROC_FLAG_END;
+		packet->data[0] |= PROC_FLAG_ERROR;
+		packet->length = 1;
+		csp_sendto_reply(packet, packet, CSP_O_SAME);
+		return;
+	}
+
 	ret = set_proc(procedure, packet->data[1], 0);
 	if (ret < 0) {
 		printf("Failed to set procedure\n");
@@ -142,7 +156,16 @@ static void proc_serve_run_request(csp_packet_t * packet) {
 		return;
 	}
 
-	int ret = proc_runtime_run(slot);
+	// Short non-blocking procedures complete before the response, instead of being handed to a worker
+	proc_run_status_e status = PROC_RUN_STARTED;
+	int ret = (proc_runtime_run_inline != NULL) ? proc_runtime_run_inline(slot) : PROC_RUN_NOT_INLINE;
+	if (ret == 0) {
+		status = PROC_RUN_COMPLETED;
+	} else if (ret == PROC_RUN_YIELDED) {
+		ret = 0;  // Exceeded the inline budget, the runtime finishes it
+	} else if (ret == PROC_RUN_NOT_INLINE) {
+		ret = proc_runtime_run(slot);
+	}
 	if (ret != 0) {
 		printf("Failed to run procedure\n");
 		packet->data[0] = PROC_RUN_RESPONSE;
@@ -155,11 +178,79 @@ static void proc_serve_run_request(csp_packet_t * packet) {
 
 	packet->data[0] = PROC_RUN_RESPONSE;
 	packet->data[0] |= PROC_FLAG_END;
+	packet->data[1] = status;
+	packet->length = 2;
+
+	csp_sendto_reply(packet, packet, CSP_O_SAME);
+}
+
+static void proc_serve_cache_request(csp_packet_t * packet) {
+	uint8_t op = packet->data[1];
+	uint16_t node;
+	memcpy(&node, packet->data + 2, sizeof(uint16_t));
+
+	if (proc_runtime_flush_list_cache == NULL || proc_runtime_list_cache_stats == NULL) {
+		printf("No csp_proc runtime available\n");
+		packet->data[0] = PROC_CACHE_RESPONSE;
+		packet->data[0] |= PROC_FLAG_END;
+		packet->data[0] |= PROC_FLAG_ERROR;
+		packet->length = 1;
+		csp_sendto_reply(packet, packet, CSP_O_SAME);
+		return;
+	}
+
+	if (op == PROC_CACHE_FLUSH) {
+		proc_runtime_flush_list_cache(node);
+	}
+
+	uint32_t hits, misses;
+	proc_runtime_list_cache_stats(&hits, &misses);
+
+	packet->data[0] = PROC_CACHE_RESPONSE;
+	packet->data[0] |= PROC_FLAG_END;
+	memcpy(packet->data + 1, &hits, sizeof(uint32_t));
+	memcpy(packet->data + 1 + sizeof(uint32_t), &misses, sizeof(uint32_t));
+	packet->length = 1 + 2 * sizeof(uint32_t);
+
+	csp_sendto_reply(packet, packet, CSP_O_SAME);
+}
+
+static void proc_serve_watch_request(csp_packet_t * packet) {
+	uint32_t watch_id, timeout_ms;
+	memcpy(&watch_id, packet->data + 1, sizeof(uint32_t));
+	memcpy(&timeout_ms, packet->data + 1 + sizeof(uint32_t), sizeof(uint32_t));
+
+	int ret = -1;
+	proc_ifelse_t condition;
+	if (proc_runtime_watch == NULL) {
+		printf("No csp_proc runtime available\n");
+	} else if (packet->length < 1 + 2 * sizeof(uint32_t) || unpack_condition_from_csp_packet(&condition, packet, 1 + 2 * sizeof(uint32_t)) < 0) {
+		printf("Failed to unpack condition from packet\n");
+	} else {
+		ret = proc_runtime_watch(&condition, timeout_ms, packet->id.src, watch_id);
+		proc_free(condition.param_a.name);
+		proc_free(condition.param_b.name);
+	}
+
+	packet->data[0] = PROC_WATCH_RESPONSE;
+	packet->data[0] |= PROC_FLAG_END;
+	if (ret != 0) {
+		packet->data[0] |= PROC_FLAG_ERROR;
+	}
 	packet->length = 1;
 
 	csp_sendto_reply(packet, packet, CSP_O_SAME);
 }
 
+static void proc_serve_watch_notify(csp_packet_t * packet) {
+	if (proc_runtime_watch_notify != NULL && packet->length >= 1 + sizeof(uint32_t)) {
+		uint32_t watch_id;
+		memcpy(&watch_id, packet->data + 1, sizeof(uint32_t));
+		proc_runtime_watch_notify(packet->id.src, watch_id, (packet->data[0] & PROC_FLAG_ERROR_MASK) == 0);
+	}
+	csp_buffer_free(packet);
+}
+
 void proc_serve(csp_packet_t * packet) {
 	switch (packet->data[0] & PROC_TYPE_MASK) {
 		case PROC_DEL_REQUEST:
@@ -177,6 +268,15 @@ void proc_serve(csp_packet_t * packet) {
 		case PROC_RUN_REQUEST:
 			proc_serve_run_request(packet);
 			break;
+		case PROC_CACHE_REQUEST:
+			proc_serve_cache_request(packet);
+			break;
+		case PROC_WATCH_REQUEST:
+			proc_serve_watch_request(packet);
+			break;
+		case PROC_WATCH_NOTIFY:
+			proc_serve_watch_notify(packet);
+			break;
 		default:
 			printf("Unknown procedure request\n");
 			csp_buffer_free(packet);
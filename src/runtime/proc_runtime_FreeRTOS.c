@@ -7,6 +7,7 @@
 #include <csp/csp.h>
 
 #include <FreeRTOS.h>
+#include <queue.h>
 #include <semphr.h>
 #include <task.h>
 
@@ -18,26 +19,280 @@
 #define PROC_RUNTIME_TASK_PRIORITY (tskIDLE_PRIORITY + 2U)
 #endif
 
-// forward declaration
-int proc_instructions_exec(proc_t * proc, proc_analysis_t * analysis);
+#ifndef PROC_BLOCK_POLLER_TASK_SIZE
+#define PROC_BLOCK_POLLER_TASK_SIZE (512U)
+#endif
+
+// forward declarations
+int proc_instructions_run(proc_continuation_t * continuation);
+int proc_list_cache_init();
+int proc_param_index_init();
+int proc_param_watch_init();
+int proc_block_poller_init();
+int proc_analysis_cache_init();
+proc_analysis_t * proc_analysis_acquire(uint8_t slot);
+void proc_analysis_release(proc_analysis_t * analysis);
+void proc_registers_free(proc_continuation_t * continuation);
+uint32_t proc_block_poller_process(int params_changed);
+void proc_block_poller_cancel_all();
+void proc_block_poller_release_reserved(proc_continuation_t * continuation);
+int proc_param_change_subscribe(TaskHandle_t task);
+
+#if PROC_RUNTIME_COROUTINE
+/**
+ * A scheduler task runs the queued runs a slice at a time, see proc_instructions_run in proc_runtime_exec.c
+ */
+typedef struct {
+	TaskHandle_t task_handle;
+	proc_continuation_t * continuation;  // Run being executed, NULL while idle
+} scheduler_t;
+
+static scheduler_t schedulers[PROC_COROUTINE_THREADS];
+static QueueHandle_t run_queue = NULL;  // Runs waiting for a scheduler task: new, resumed and yielded runs
 
+static int schedulers_start();
+#else
 typedef struct {
-	proc_t * proc;
+	proc_continuation_t * continuation;
 	TaskHandle_t task_handle;
 } task_t;
 
 task_t * running_tasks = NULL;
 volatile size_t running_tasks_count = 0;
+#endif
 SemaphoreHandle_t running_tasks_mutex;
 
+TaskHandle_t block_poller_task_handle = NULL;
+
+uint32_t proc_runtime_now_ms() {
+	return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+/**
+ * Evaluates the block conditions of all parked runs, see proc_runtime_block_poller.c
+ */
+void block_poller_task(void * pvParameters) {
+	// Notified whenever a watched local parameter is set; notifications given while processing are kept by the task
+	proc_param_change_subscribe(xTaskGetCurrentTaskHandle());
+
+	int params_changed = 0;
+	while (1) {
+		uint32_t wait_ms = proc_block_poller_process(params_changed);
+		params_changed = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) > 0;
+	}
+}
+
 int proc_runtime_init() {
 	running_tasks_mutex = xSemaphoreCreateMutex();
 	if (running_tasks_mutex == NULL) {
 		return -1;
 	}
+	if (proc_list_cache_init() != 0 || proc_param_index_init() != 0 || proc_param_watch_init() != 0 || proc_analysis_cache_init() != 0) {
+		return -1;
+	}
+	if (proc_block_poller_init() != 0) {
+		return -1;
+	}
+#if PROC_RUNTIME_COROUTINE
+	if (run_queue == NULL) {
+		run_queue = xQueueCreate(PROC_RUN_QUEUE_SIZE, sizeof(proc_continuation_t *));
+		if (run_queue == NULL) {
+			return -1;
+		}
+	}
+	xSemaphoreTake(running_tasks_mutex, portMAX_DELAY);
+	int ret = schedulers_start();
+	xSemaphoreGive(running_tasks_mutex);
+	if (ret != 0) {
+		return -1;
+	}
+#endif
+	if (block_poller_task_handle == NULL) {
+		if (xTaskCreate(block_poller_task, "RNTMPOLL", PROC_BLOCK_POLLER_TASK_SIZE, NULL, PROC_RUNTIME_TASK_PRIORITY, &block_poller_task_handle) != pdPASS) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Free a run. Once parked, the state of the run is owned by the block poller, which frees it instead;
+ * this also holds for a run stopped while it was being parked. A run stopped before it was parked may
+ * still hold a reserved wait of the poller, which is returned.
+ */
+static void continuation_free(proc_continuation_t * continuation) {
+	if (!continuation->parked) {
+		proc_block_poller_release_reserved(continuation);
+		proc_analysis_release(continuation->root_analysis);
+		proc_registers_free(continuation);
+		proc_free(continuation->frames);
+		proc_free(continuation->loops);
+	}
+	proc_free(continuation);
+}
+
+#if PROC_RUNTIME_COROUTINE
+/**
+ * Scheduler task: continues runs from the run queue a slice at a time, queueing them again when they yield,
+ * until each finishes or is parked on a block.
+ */
+void scheduler_task(void * pvParameters) {
+	scheduler_t * scheduler = (scheduler_t *)pvParameters;
+
+	while (1) {
+		proc_continuation_t * continuation;
+		if (xQueueReceive(run_queue, &continuation, portMAX_DELAY) != pdTRUE) {
+			continue;
+		}
+		if (xSemaphoreTake(running_tasks_mutex, portMAX_DELAY) != pdTRUE) {
+			continuation_free(continuation);
+			continue;
+		}
+		scheduler->continuation = continuation;
+		xSemaphoreGive(running_tasks_mutex);
+
+		int ret = proc_instructions_run(continuation);  // TODO: set error flag param
+
+		// Queued with the mutex taken, so proc_stop_all_runtime_tasks either drops the run from the queue or deletes this task
+		int queued = 0;
+		while (ret == PROC_RUN_YIELDED && !queued) {
+			if (xSemaphoreTake(running_tasks_mutex, portMAX_DELAY) == pdTRUE) {
+				queued = (xQueueSendToBack(run_queue, &continuation, 0) == pdTRUE);
+				if (queued) {
+					scheduler->continuation = NULL;
+				}
+				xSemaphoreGive(running_tasks_mutex);
+			}
+			if (!queued) {
+				ret = proc_instructions_run(continuation);  // The run queue is full, so there are no runs to yield to
+			}
+		}
+		if (queued) {
+			continue;
+		}
+
+		if (xSemaphoreTake(running_tasks_mutex, portMAX_DELAY) == pdTRUE) {
+			scheduler->continuation = NULL;
+			xSemaphoreGive(running_tasks_mutex);
+		}
+		if (ret == PROC_RUN_PARKED) {  // a parked run is owned by the block poller until it's resumed
+			proc_free(continuation);
+		} else {
+			csp_print("Procedure finished (%s)\n", pcTaskGetName(NULL));
+			continuation_free(continuation);
+		}
+	}
+}
+
+/**
+ * Start the scheduler tasks that aren't running. Must be called with running_tasks_mutex taken.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int schedulers_start() {
+	for (size_t i = 0; i < PROC_COROUTINE_THREADS; i++) {
+		if (schedulers[i].task_handle != NULL) {
+			continue;
+		}
+		schedulers[i].continuation = NULL;
+		char task_name[configMAX_TASK_NAME_LEN];
+		sprintf(task_name, "RNTMCO%d", (int)i);
+		if (xTaskCreate(scheduler_task, task_name, PROC_RUNTIME_TASK_SIZE, &schedulers[i], PROC_RUNTIME_TASK_PRIORITY, &schedulers[i].task_handle) != pdPASS) {
+			csp_print("Failed to create scheduler task\n");
+			schedulers[i].task_handle = NULL;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Stop all procedure runs: queued runs are dropped, and the scheduler tasks executing a run are deleted and replaced.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int proc_stop_all_runtime_tasks() {
+	proc_block_poller_cancel_all();  // parked runs hold no task, but would otherwise be resumed on one
+
+	if (xSemaphoreTake(running_tasks_mutex, portMAX_DELAY) != pdTRUE) {
+		return -1;
+	}
+	proc_continuation_t * continuation;
+	while (xQueueReceive(run_queue, &continuation, 0) == pdTRUE) {
+		continuation_free(continuation);
+	}
+	for (size_t i = 0; i < PROC_COROUTINE_THREADS; i++) {
+		if (schedulers[i].task_handle != NULL && schedulers[i].continuation != NULL) {
+			vTaskDelete(schedulers[i].task_handle);
+			continuation_free(schedulers[i].continuation);
+			schedulers[i].task_handle = NULL;
+		}
+	}
+	int ret = schedulers_start();
+	xSemaphoreGive(running_tasks_mutex);
+
+	proc_block_poller_cancel_all();  // runs parked while their tasks were being stopped
+	return ret;
+}
+
+/**
+ * Queue a parked run to be resumed by a scheduler task. Called by the block poller once the condition holds.
+ *
+ * @param continuation State to resume the run from, copied
+ * @return 0 on success, -1 if the run queue is full right now
+ */
+int proc_runtime_resume(proc_continuation_t * continuation) {
+	proc_continuation_t * resumed = proc_malloc(sizeof(proc_continuation_t));
+	if (resumed == NULL) {
+		return -1;
+	}
+	*resumed = *continuation;
+
+	if (xQueueSendToBack(run_queue, &resumed, 0) != pdTRUE) {
+		proc_free(resumed);
+		return -1;
+	}
+	return 0;
+}
+
+int proc_runtime_run(uint8_t proc_slot) {
+	csp_print("Running procedure %d\n", proc_slot);
+
+	// The run holds the (cached) analysis of the procedure from here on, and with it the stored snapshot it runs,
+	// so replacing the procedure before the run starts doesn't change what it runs
+	proc_analysis_t * analysis = proc_analysis_acquire(proc_slot);
+	if (analysis == NULL) {
+		return -1;
+	}
+	if (analysis->proc->instruction_count == 0) {
+		csp_print("Procedure in slot %d has no instructions\n", proc_slot);
+		proc_analysis_release(analysis);
+		return -1;
+	}
+
+	proc_continuation_t * continuation = proc_malloc(sizeof(proc_continuation_t));
+	if (continuation == NULL) {
+		proc_analysis_release(analysis);
+		return -1;
+	}
+	*continuation = (proc_continuation_t){
+		.root_proc = analysis->proc,
+		.root_analysis = analysis,
+		.proc = analysis->proc,
+		.analysis = analysis,
+		.pc = 0,
+		.slot = proc_slot};
+
+	if (xQueueSendToBack(run_queue, &continuation, 0) != pdTRUE) {
+		csp_print("Maximum number of queued procedures reached\n");
+		continuation_free(continuation);
+		return -1;
+	}
+
 	return 0;
 }
 
+#else
 /**
  * Stop a runtime task and free its resources.
  *
@@ -53,7 +308,7 @@ int proc_stop_runtime_task(TaskHandle_t task_handle) {
 	for (size_t i = 0; i < running_tasks_count; i++) {
 		if (running_tasks[i].task_handle == task_handle) {
 			vTaskDelete(running_tasks[i].task_handle);
-			free_proc(running_tasks[i].proc);
+			continuation_free(running_tasks[i].continuation);
 			running_tasks[i] = running_tasks[running_tasks_count - 1];
 			running_tasks = proc_realloc(running_tasks, --running_tasks_count * sizeof(task_t));
 			break;
@@ -70,40 +325,34 @@ int proc_stop_runtime_task(TaskHandle_t task_handle) {
  * @return 0 on success, -1 on failure
  */
 int proc_stop_all_runtime_tasks() {
+	proc_block_poller_cancel_all();  // parked runs hold no task, but would otherwise be resumed on one
 	int inf_loop_guard = 0;
 	while (running_tasks_count > 0 && (inf_loop_guard++ < 1000)) {
-		if (proc_stop_runtime_task(&running_tasks[0]) != 0) {
+		if (proc_stop_runtime_task(running_tasks[0].task_handle) != 0) {
 			return -1;
 		}
 	}
+	proc_block_poller_cancel_all();  // runs parked while their tasks were being stopped
 	return inf_loop_guard < 1000 ? 0 : -1;
 }
 
-void runtime_task(void * pvParameters) {
-	proc_t * proc = (proc_t *)pvParameters;
-
-	// Perform static analysis
-	proc_analysis_config_t analysis_config = {
-		.analyzed_procs = proc_calloc(MAX_PROC_SLOT + 1, sizeof(int)),
-		.analyses = proc_calloc(MAX_PROC_SLOT + 1, sizeof(proc_analysis_t *)),
-		.analyzed_proc_count = 0};
-	proc_analysis_t * analysis = proc_malloc(sizeof(proc_analysis_t));
-	if (analysis == NULL) {
-		csp_print("Error allocating memory for analysis\n");
-		return -1;
-	}
-
-	if (proc_analyze(proc, analysis, &analysis_config) != 0) {
-		csp_print("Error analyzing procedure\n");
-		return -1;
-	}
+/**
+ * Run (or continue) a procedure run on the calling task until it finishes or is parked on a block.
+ * Takes ownership of the continuation and deletes the task when done.
+ */
+void continuation_task(void * pvParameters) {
+	proc_continuation_t * continuation = (proc_continuation_t *)pvParameters;
 
-	int ret = proc_instructions_exec(proc, analysis);  // TODO: set error flag param
+	int ret = proc_instructions_run(continuation);  // TODO: set error flag param
 
-	// Procedure finished, clean up
+	// Procedure finished or parked, clean up
+	int owned = (ret != PROC_RUN_PARKED);  // a parked run is owned by the block poller until it's resumed
 	if (xSemaphoreTake(running_tasks_mutex, portMAX_DELAY) != pdTRUE) {
-		free_proc_analysis(analysis);
-		free_proc(proc);
+		if (owned) {
+			continuation_free(continuation);
+		} else {
+			proc_free(continuation);
+		}
 		vTaskDelete(NULL);
 		return;
 	}
@@ -116,12 +365,53 @@ void runtime_task(void * pvParameters) {
 		}
 	}
 	xSemaphoreGive(running_tasks_mutex);
-	csp_print("Procedure finished (%s)\n", pcTaskGetName(task_handle));
-	free_proc_analysis(analysis);
-	free_proc(proc);
+	if (owned) {
+		csp_print("Procedure finished (%s)\n", pcTaskGetName(task_handle));
+		continuation_free(continuation);
+	} else {
+		proc_free(continuation);
+	}
 	vTaskDelete(NULL);
 }
 
+/**
+ * Resume a run parked on a block instruction on a new task. Called by the block poller once the condition holds.
+ *
+ * @param continuation State to resume the run from, copied
+ * @return 0 on success, -1 if no task can be started for the run right now
+ */
+int proc_runtime_resume(proc_continuation_t * continuation) {
+	if (xSemaphoreTake(running_tasks_mutex, portMAX_DELAY) != pdTRUE) {
+		return -1;
+	}
+	if (running_tasks_count >= MAX_PROC_CONCURRENT) {
+		xSemaphoreGive(running_tasks_mutex);
+		return -1;
+	}
+
+	proc_continuation_t * resumed = proc_malloc(sizeof(proc_continuation_t));
+	if (resumed == NULL) {
+		xSemaphoreGive(running_tasks_mutex);
+		return -1;
+	}
+	*resumed = *continuation;
+
+	TaskHandle_t task_handle;
+	char task_name[configMAX_TASK_NAME_LEN];
+	sprintf(task_name, "RNTM%d", continuation->slot);
+	if (xTaskCreate(continuation_task, task_name, PROC_RUNTIME_TASK_SIZE, resumed, PROC_RUNTIME_TASK_PRIORITY, &task_handle) != pdPASS) {
+		proc_free(resumed);
+		xSemaphoreGive(running_tasks_mutex);
+		return -1;
+	}
+
+	running_tasks = proc_realloc(running_tasks, ++running_tasks_count * sizeof(task_t));
+	running_tasks[running_tasks_count - 1] = (task_t){.continuation = resumed, .task_handle = task_handle};
+	xSemaphoreGive(running_tasks_mutex);
+
+	return 0;
+}
+
 int proc_runtime_run(uint8_t proc_slot) {
 	csp_print("Running procedure %d\n", proc_slot);
 	if (running_tasks_count >= MAX_PROC_CONCURRENT) {
@@ -129,27 +419,34 @@ int proc_runtime_run(uint8_t proc_slot) {
 		return -1;
 	}
 
-	proc_t * stored_proc = get_proc(proc_slot);
-
-	if (stored_proc == NULL) {
-		csp_print("Procedure in slot %d not found\n", proc_slot);
+	// The run holds the (cached) analysis of the procedure from here on, and with it the stored snapshot it runs,
+	// so replacing the procedure before the run starts doesn't change what it runs
+	proc_analysis_t * analysis = proc_analysis_acquire(proc_slot);
+	if (analysis == NULL) {
 		return -1;
 	}
-	if (stored_proc->instruction_count == 0) {
+	if (analysis->proc->instruction_count == 0) {
 		csp_print("Procedure in slot %d has no instructions\n", proc_slot);
+		proc_analysis_release(analysis);
 		return -1;
 	}
 
-	// Copy procedure to detach from proc store
-	proc_t * detached_proc = proc_malloc(sizeof(proc_t));
-	if (deepcopy_proc(stored_proc, detached_proc) != 0) {
-		csp_print("Failed to copy procedure\n");
+	proc_continuation_t * continuation = proc_malloc(sizeof(proc_continuation_t));
+	if (continuation == NULL) {
+		proc_analysis_release(analysis);
 		return -1;
 	}
+	*continuation = (proc_continuation_t){
+		.root_proc = analysis->proc,
+		.root_analysis = analysis,
+		.proc = analysis->proc,
+		.analysis = analysis,
+		.pc = 0,
+		.slot = proc_slot};
 
 	// Create task
 	if (xSemaphoreTake(running_tasks_mutex, portMAX_DELAY) != pdTRUE) {  // taking mutex early to prevent clean-up from the newly spawned task before it's added to the task array
-		free_proc(detached_proc);
+		continuation_free(continuation);
 		return -1;
 	}
 
@@ -157,19 +454,21 @@ int proc_runtime_run(uint8_t proc_slot) {
 	char task_name[configMAX_TASK_NAME_LEN];
 	sprintf(task_name, "RNTM%d", proc_slot);
 	BaseType_t task_create_ret;
-	task_create_ret = xTaskCreate(runtime_task, task_name, PROC_RUNTIME_TASK_SIZE, detached_proc, PROC_RUNTIME_TASK_PRIORITY, &task_handle);
+	task_create_ret = xTaskCreate(continuation_task, task_name, PROC_RUNTIME_TASK_SIZE, continuation, PROC_RUNTIME_TASK_PRIORITY, &task_handle);
 
 	if (task_create_ret != pdPASS) {
 		csp_print("Failed to create task\n");
-		free_proc(detached_proc);
+		continuation_free(continuation);
 		xSemaphoreGive(running_tasks_mutex);
 		return -1;
 	}
 
 	// Add task to array
 	running_tasks = proc_realloc(running_tasks, ++running_tasks_count * sizeof(task_t));
-	running_tasks[running_tasks_count - 1] = (task_t){.proc = detached_proc, .task_handle = task_handle};
+	running_tasks[running_tasks_count - 1] = (task_t){.continuation = continuation, .task_handle = task_handle};
 	xSemaphoreGive(running_tasks_mutex);
 
 	return 0;
 }
+
+#endif
@@ -8,152 +8,314 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <time.h>
 
-// forward declaration
-int proc_instructions_exec(proc_t * proc, proc_analysis_t * analysis);
+// forward declarations
+int proc_instructions_run(proc_continuation_t * continuation);
+int proc_list_cache_init();
+int proc_param_index_init();
+int proc_param_watch_init();
+int proc_block_poller_init();
+int proc_analysis_cache_init();
+proc_analysis_t * proc_analysis_acquire(uint8_t slot);
+void proc_analysis_release(proc_analysis_t * analysis);
+void proc_registers_free(proc_continuation_t * continuation);
+uint32_t proc_block_poller_process(int params_changed);
+void proc_block_poller_cancel_all();
+void proc_block_poller_release_reserved(proc_continuation_t * continuation);
+unsigned int proc_param_change_seq();
+int proc_wait_param_change(unsigned int seq, struct timespec * deadline);
 
+#if PROC_RUNTIME_COROUTINE
+#define PROC_RUNTIME_WORKERS PROC_COROUTINE_THREADS  // Runs yield to each other, so a few workers serve all of them
+#else
+#define PROC_RUNTIME_WORKERS MAX_PROC_CONCURRENT
+#endif
+
+/**
+ * A worker thread of the pool runs one procedure run at a time, taken from the run queue.
+ * Workers are only started (again) by proc_runtime_init and proc_stop_all_runtime_threads.
+ */
 typedef struct {
-	proc_t * proc;
 	pthread_t thread;
-} thread_t;
+	proc_continuation_t * continuation;  // Run being executed, NULL while idle
+	int stopping;                        // Set by proc_stop_all_runtime_threads, the worker exits after its run
+	int running;
+} worker_t;
 
-thread_t * running_threads = NULL;
-volatile size_t running_threads_count = 0;
-pthread_mutex_t running_threads_mutex;
+static worker_t workers[PROC_RUNTIME_WORKERS];
 
-pthread_key_t recursion_depth_key;
+// Runs waiting for a worker: new runs, parked runs resumed by the block poller, and runs that yielded
+static proc_continuation_t * run_queue[PROC_RUN_QUEUE_SIZE];
+static size_t run_queue_head = 0;
+static size_t run_queue_count = 0;
 
-int proc_runtime_init() {
-	if (pthread_mutex_init(&running_threads_mutex, NULL) != 0) {
-		return -1;
+static pthread_mutex_t runtime_mutex = PTHREAD_MUTEX_INITIALIZER;  // Guards the workers and the run queue
+static pthread_cond_t run_queue_cond = PTHREAD_COND_INITIALIZER;
+
+pthread_t block_poller_thread;
+int block_poller_started = 0;
+
+uint32_t proc_runtime_now_ms() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)now.tv_sec * 1000U + (uint32_t)(now.tv_nsec / 1000000);
+}
+
+/**
+ * Evaluates the block conditions of all parked runs, see proc_runtime_block_poller.c
+ */
+void * block_poller(void * pvParameters) {
+	int params_changed = 0;
+	while (1) {
+		unsigned int change_seq = proc_param_change_seq();  // read before processing, so changes during processing aren't missed
+		uint32_t wait_ms = proc_block_poller_process(params_changed);
+
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += wait_ms / 1000;
+		deadline.tv_nsec += (wait_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		params_changed = proc_wait_param_change(change_seq, &deadline);
 	}
-	return 0;
+	return NULL;
+}
+
+/**
+ * Free a run. Once parked, the state of the run is owned by the block poller, which frees it instead;
+ * this also holds for a run stopped while it was being parked. A run stopped before it was parked may
+ * still hold a reserved wait of the poller, which is returned.
+ */
+static void continuation_free(proc_continuation_t * continuation) {
+	if (!continuation->parked) {
+		proc_block_poller_release_reserved(continuation);
+		proc_analysis_release(continuation->root_analysis);
+		proc_registers_free(continuation);
+		proc_free(continuation->frames);
+		proc_free(continuation->loops);
+	}
+	proc_free(continuation);
 }
 
 /**
- * Stop a runtime thread and free its resources.
+ * Queue a run for the next idle worker. Takes ownership of the continuation on success.
+ * Must be called with runtime_mutex taken.
  *
- * @param thread The thread to stop
- * @return 0 on success, -1 on failure
+ * @return 0 on success, -1 if the run queue is full
  */
-int proc_stop_runtime_thread(pthread_t thread) {
-	int ret = pthread_mutex_lock(&running_threads_mutex);  // Prevent race condition on running_threads array
-	if (ret != 0) {
+static int run_queue_push(proc_continuation_t * continuation) {
+	if (run_queue_count >= PROC_RUN_QUEUE_SIZE) {
 		return -1;
 	}
+	run_queue[(run_queue_head + run_queue_count) % PROC_RUN_QUEUE_SIZE] = continuation;
+	run_queue_count++;
+	pthread_cond_signal(&run_queue_cond);
+	return 0;
+}
+
+/**
+ * Worker thread: runs (or continues) procedure runs from the run queue until each finishes, is parked on a block,
+ * or yields to the other queued runs (coroutine runtime).
+ * Runs are only cancellable while executing, so a stopped worker never holds runtime_mutex.
+ */
+void * worker_thread(void * pvParameters) {
+	worker_t * worker = (worker_t *)pvParameters;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	while (1) {
+		pthread_mutex_lock(&runtime_mutex);
+		proc_continuation_t * continuation = worker->continuation;  // Kept by a run that yielded with the run queue full
+		if (continuation == NULL) {
+			while (run_queue_count == 0) {
+				pthread_cond_wait(&run_queue_cond, &runtime_mutex);
+			}
+			continuation = run_queue[run_queue_head];
+			run_queue_head = (run_queue_head + 1) % PROC_RUN_QUEUE_SIZE;
+			run_queue_count--;
+			worker->continuation = continuation;
+		}
+		pthread_mutex_unlock(&runtime_mutex);
+
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		int ret = proc_instructions_run(continuation);  // TODO: set error flag param
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		pthread_mutex_lock(&runtime_mutex);
+		int stopping = worker->stopping;
+		int yielded = (ret == PROC_RUN_YIELDED && !stopping);
+		if (yielded && run_queue_push(continuation) != 0) {
+			pthread_mutex_unlock(&runtime_mutex);
+			continue;  // The run queue is full, so there are no runs to yield to
+		}
+		worker->continuation = NULL;
+		pthread_mutex_unlock(&runtime_mutex);
+
+		if (ret == PROC_RUN_PARKED) {  // a parked run is owned by the block poller until it's resumed
+			proc_free(continuation);
+		} else if (!yielded) {  // a yielded run is owned by the run queue again
+			csp_print("Procedure finished\n");
+			continuation_free(continuation);
+		}
 
-	for (size_t i = 0; i < running_threads_count; i++) {
-		if (pthread_equal(running_threads[i].thread, thread)) {
-			pthread_cancel(running_threads[i].thread);
-			pthread_join(running_threads[i].thread, NULL);
-			free_proc(running_threads[i].proc);
-			running_threads[i] = running_threads[running_threads_count - 1];
-			running_threads = proc_realloc(running_threads, --running_threads_count * sizeof(thread_t));
+		if (stopping) {
 			break;
 		}
 	}
-	pthread_mutex_unlock(&running_threads_mutex);
-
-	return 0;
+	return NULL;
 }
 
 /**
- * Stop all currently running runtime threads.
+ * Start the worker threads that aren't running. Must be called with runtime_mutex taken.
  *
  * @return 0 on success, -1 on failure
  */
-int proc_stop_all_runtime_threads() {
-	int inf_loop_guard = 0;
-	while (running_threads_count > 0 && (inf_loop_guard++ < 1000)) {
-		if (proc_stop_runtime_thread(running_threads[0].thread) != 0) {
+static int workers_start() {
+	for (size_t i = 0; i < PROC_RUNTIME_WORKERS; i++) {
+		if (workers[i].running) {
+			continue;
+		}
+		workers[i].continuation = NULL;
+		workers[i].stopping = 0;
+		if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) != 0) {
+			csp_print("Failed to create worker thread\n");
 			return -1;
 		}
+		workers[i].running = 1;
 	}
-	return inf_loop_guard < 1000 ? 0 : -1;
+	return 0;
 }
 
-void * runtime_thread(void * pvParameters) {
-	proc_t * proc = (proc_t *)pvParameters;
+int proc_runtime_init() {
+	if (proc_list_cache_init() != 0 || proc_param_index_init() != 0 || proc_param_watch_init() != 0 || proc_analysis_cache_init() != 0) {
+		return -1;
+	}
+	if (proc_block_poller_init() != 0) {
+		return -1;
+	}
 
-	// Perform static analysis
-	proc_analysis_config_t analysis_config = {
-		.analyzed_procs = proc_calloc(MAX_PROC_SLOT + 1, sizeof(int)),
-		.analyses = proc_calloc(MAX_PROC_SLOT + 1, sizeof(proc_analysis_t *)),
-		.analyzed_proc_count = 0};
-	proc_analysis_t * analysis = proc_malloc(sizeof(proc_analysis_t));
-	if (analysis == NULL) {
-		csp_print("Error allocating memory for analysis\n");
-		return NULL;
+	pthread_mutex_lock(&runtime_mutex);
+	int ret = workers_start();
+	pthread_mutex_unlock(&runtime_mutex);
+	if (ret != 0) {
+		return -1;
 	}
 
-	if (proc_analyze(proc, analysis, &analysis_config) != 0) {
-		csp_print("Error analyzing procedure\n");
-		return NULL;
+	if (!block_poller_started) {
+		if (pthread_create(&block_poller_thread, NULL, block_poller, NULL) != 0) {
+			return -1;
+		}
+		block_poller_started = 1;
 	}
+	return 0;
+}
 
-	if (pthread_key_create(&recursion_depth_key, NULL) != 0) {
-		csp_print("Error creating pthread key\n");
-		return NULL;
+/**
+ * Stop all procedure runs: queued runs are dropped, and the workers executing a run are cancelled and replaced.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int proc_stop_all_runtime_threads() {
+	proc_block_poller_cancel_all();  // parked runs hold no thread, but would otherwise be resumed on one
+
+	pthread_mutex_lock(&runtime_mutex);
+	while (run_queue_count > 0) {
+		continuation_free(run_queue[run_queue_head]);
+		run_queue_head = (run_queue_head + 1) % PROC_RUN_QUEUE_SIZE;
+		run_queue_count--;
+	}
+	for (size_t i = 0; i < PROC_RUNTIME_WORKERS; i++) {
+		if (workers[i].running && workers[i].continuation != NULL) {
+			workers[i].stopping = 1;
+			pthread_cancel(workers[i].thread);  // only takes effect while the run is executing
+		}
 	}
+	pthread_mutex_unlock(&runtime_mutex);
 
-	int ret = proc_instructions_exec(proc, analysis);  // TODO: set error flag param
+	for (size_t i = 0; i < PROC_RUNTIME_WORKERS; i++) {
+		if (!workers[i].stopping) {
+			continue;
+		}
+		pthread_join(workers[i].thread, NULL);
 
-	// Procedure finished, clean up
-	pthread_mutex_lock(&running_threads_mutex);
-	pthread_t thread = pthread_self();
-	for (size_t i = 0; i < running_threads_count; i++) {
-		if (pthread_equal(running_threads[i].thread, thread)) {
-			running_threads[i] = running_threads[running_threads_count - 1];
-			running_threads = proc_realloc(running_threads, --running_threads_count * sizeof(thread_t));
-			break;
+		pthread_mutex_lock(&runtime_mutex);
+		if (workers[i].continuation != NULL) {  // cancelled before the run finished, possibly while being parked
+			continuation_free(workers[i].continuation);
 		}
+		workers[i].running = 0;
+		pthread_mutex_unlock(&runtime_mutex);
 	}
-	pthread_mutex_unlock(&running_threads_mutex);
-	csp_print("Procedure finished\n");
-	free_proc_analysis(analysis);
-	free_proc(proc);
-	return NULL;
+
+	pthread_mutex_lock(&runtime_mutex);
+	int ret = workers_start();
+	pthread_mutex_unlock(&runtime_mutex);
+
+	proc_block_poller_cancel_all();  // runs parked while their workers were being stopped
+	return ret;
 }
 
-int proc_runtime_run(uint8_t proc_slot) {
-	csp_print("Running procedure %d\n", proc_slot);
-	if (running_threads_count >= MAX_PROC_CONCURRENT) {
-		csp_print("Maximum number of concurrent procedures reached\n");
+/**
+ * Resume a run parked on a block instruction on a worker. Called by the block poller once the condition holds.
+ *
+ * @param continuation State to resume the run from, copied
+ * @return 0 on success, -1 if the run queue is full right now
+ */
+int proc_runtime_resume(proc_continuation_t * continuation) {
+	proc_continuation_t * resumed = proc_malloc(sizeof(proc_continuation_t));
+	if (resumed == NULL) {
 		return -1;
 	}
+	*resumed = *continuation;
+
+	pthread_mutex_lock(&runtime_mutex);
+	int ret = run_queue_push(resumed);
+	pthread_mutex_unlock(&runtime_mutex);
+
+	if (ret != 0) {
+		proc_free(resumed);
+	}
+	return ret;
+}
 
-	proc_t * stored_proc = get_proc(proc_slot);
+int proc_runtime_run(uint8_t proc_slot) {
+	csp_print("Running procedure %d\n", proc_slot);
 
-	if (stored_proc == NULL) {
-		csp_print("Procedure in slot %d not found\n", proc_slot);
+	// The run holds the (cached) analysis of the procedure from here on, and with it the stored snapshot it runs,
+	// so replacing the procedure before the run starts doesn't change what it runs
+	proc_analysis_t * analysis = proc_analysis_acquire(proc_slot);
+	if (analysis == NULL) {
 		return -1;
 	}
-	if (stored_proc->instruction_count == 0) {
+	if (analysis->proc->instruction_count == 0) {
 		csp_print("Procedure in slot %d has no instructions\n", proc_slot);
+		proc_analysis_release(analysis);
 		return -1;
 	}
 
-	// Copy procedure to detach from proc store
-	proc_t * detached_proc = proc_malloc(sizeof(proc_t));
-	if (deepcopy_proc(stored_proc, detached_proc) != 0) {
-		csp_print("Failed to copy procedure\n");
+	proc_continuation_t * continuation = proc_malloc(sizeof(proc_continuation_t));
+	if (continuation == NULL) {
+		proc_analysis_release(analysis);
 		return -1;
 	}
+	*continuation = (proc_continuation_t){
+		.root_proc = analysis->proc,
+		.root_analysis = analysis,
+		.proc = analysis->proc,
+		.analysis = analysis,
+		.pc = 0,
+		.slot = proc_slot};
 
-	// Create thread
-	pthread_mutex_lock(&running_threads_mutex);  // taking mutex early to prevent clean-up from the newly spawned thread before it's added to the thread array
-	pthread_t thread;
-	if (pthread_create(&thread, NULL, runtime_thread, detached_proc) != 0) {
-		csp_print("Failed to create thread\n");
-		free_proc(detached_proc);
-		pthread_mutex_unlock(&running_threads_mutex);
+	pthread_mutex_lock(&runtime_mutex);
+	int ret = run_queue_push(continuation);
+	pthread_mutex_unlock(&runtime_mutex);
+
+	if (ret != 0) {
+		csp_print("Maximum number of queued procedures reached\n");
+		continuation_free(continuation);
 		return -1;
 	}
 
-	// Add thread to array
-	running_threads = proc_realloc(running_threads, ++running_threads_count * sizeof(thread_t));
-	running_threads[running_threads_count - 1] = (thread_t){.proc = detached_proc, .thread = thread};
-	pthread_mutex_unlock(&running_threads_mutex);
-
 	return 0;
 }
@@ -0,0 +1,203 @@
+// Analyses of stored procedures shared by their runs, dropped when the store changes a procedure they depend on
+
+#include <csp/csp.h>
+
+#include <csp_proc/proc_types.h>
+#include <csp_proc/proc_runtime.h>
+#include <csp_proc/proc_analyze.h>
+#include <csp_proc/proc_memory.h>
+#include <csp_proc/proc_mutex.h>
+#include <csp_proc/proc_store.h>
+
+// forward declarations
+int proc_compile(proc_analysis_t * analysis);
+
+typedef struct {
+	proc_analysis_t * analysis;  // Analysis of a snapshot of the stored procedure, NULL if not cached
+	uint8_t * slots;             // Slots called by the procedure, directly or indirectly
+	size_t slot_count;
+} analysis_cache_entry_t;
+
+static analysis_cache_entry_t analysis_cache[MAX_PROC_SLOT + 1];
+
+// Reverse call graph of the cached analyses: the cached procedures calling each slot, directly or indirectly
+static uint8_t * callers[MAX_PROC_SLOT + 1];
+static size_t caller_counts[MAX_PROC_SLOT + 1];
+
+static proc_mutex_t * analysis_cache_mutex = NULL;
+
+int proc_analysis_cache_init() {
+	if (analysis_cache_mutex == NULL) {
+		analysis_cache_mutex = proc_mutex_create();
+	}
+	return (analysis_cache_mutex != NULL) ? 0 : -1;
+}
+
+/**
+ * Drop a reference to a root analysis, freeing it and releasing its procedure once unreferenced.
+ * Must be called with analysis_cache_mutex taken.
+ */
+static void analysis_unref(proc_analysis_t * analysis) {
+	if (--analysis->refs == 0) {
+		proc_t * proc = analysis->proc;
+		free_proc_analysis(analysis);
+		put_proc(proc);
+	}
+}
+
+/**
+ * Collect the slots called by an analysis and its sub-analyses, each slot once.
+ */
+static void collect_called_slots(proc_analysis_t * analysis, uint8_t * seen, uint8_t * slots, size_t * slot_count) {
+	for (size_t i = 0; i < analysis->procedure_slot_count; i++) {
+		uint8_t slot = analysis->procedure_slots[i];
+		if (seen[slot / 8] & (1U << (slot % 8))) {
+			continue;
+		}
+		seen[slot / 8] |= (1U << (slot % 8));
+		slots[(*slot_count)++] = slot;
+		if (i < analysis->sub_analysis_count && analysis->sub_analyses[i] != NULL) {
+			collect_called_slots(analysis->sub_analyses[i], seen, slots, slot_count);
+		}
+	}
+}
+
+/**
+ * Remove a cached analysis from the cache and the reverse call graph. Runs still holding it keep it alive.
+ * Must be called with analysis_cache_mutex taken.
+ */
+static void analysis_cache_drop(uint8_t slot) {
+	analysis_cache_entry_t * entry = &analysis_cache[slot];
+	if (entry->analysis == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < entry->slot_count; i++) {
+		uint8_t callee = entry->slots[i];
+		for (size_t j = 0; j < caller_counts[callee]; j++) {
+			if (callers[callee][j] == slot) {
+				callers[callee][j] = callers[callee][--caller_counts[callee]];
+				break;
+			}
+		}
+	}
+
+	proc_free(entry->slots);
+	analysis_unref(entry->analysis);
+	*entry = (analysis_cache_entry_t){0};
+}
+
+/**
+ * Analyze and compile the stored procedure of a slot, and add it to the cache.
+ * Must be called with analysis_cache_mutex taken.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int analysis_cache_add(uint8_t slot) {
+	// Stored procedures are immutable, the analysis keeps the snapshot alive if the slot is replaced meanwhile
+	proc_t * proc = get_proc_ref(slot);
+	if (proc == NULL) {
+		csp_print("Procedure in slot %d not found\n", slot);
+		return -1;
+	}
+
+	proc_analysis_config_t analysis_config = {
+		.analyzed_procs = proc_calloc(MAX_PROC_SLOT + 1, sizeof(int)),
+		.analyses = proc_calloc(MAX_PROC_SLOT + 1, sizeof(proc_analysis_t *)),
+		.analyzed_proc_count = 0};
+	proc_analysis_t * analysis = proc_malloc(sizeof(proc_analysis_t));
+	uint8_t * slots = proc_malloc(MAX_PROC_SLOT + 1);
+	if (analysis == NULL || slots == NULL || analysis_config.analyzed_procs == NULL || analysis_config.analyses == NULL) {
+		csp_print("Error allocating memory for analysis\n");
+		proc_free(analysis_config.analyzed_procs);
+		proc_free(analysis_config.analyses);
+		proc_free(analysis);
+		proc_free(slots);
+		put_proc(proc);
+		return -1;
+	}
+
+	int ret = proc_analyze(proc, analysis, &analysis_config);
+	proc_free(analysis_config.analyzed_procs);
+	proc_free(analysis_config.analyses);
+	analysis->refs = 1;  // Held by the cache
+	if (ret != 0 || proc_compile(analysis) != 0) {
+		csp_print("Error analyzing procedure\n");
+		analysis_unref(analysis);
+		proc_free(slots);
+		return -1;
+	}
+
+	uint8_t seen[(MAX_PROC_SLOT + 8) / 8] = {0};
+	size_t slot_count = 0;
+	collect_called_slots(analysis, seen, slots, &slot_count);
+	uint8_t * shrunk_slots = proc_realloc(slots, (slot_count > 0) ? slot_count : 1);
+	if (shrunk_slots != NULL) {
+		slots = shrunk_slots;
+	}
+
+	for (size_t i = 0; i < slot_count; i++) {
+		uint8_t * slot_callers = proc_realloc(callers[slots[i]], (caller_counts[slots[i]] + 1) * sizeof(uint8_t));
+		if (slot_callers == NULL) {
+			// Unregister the callees added so far by dropping the entry, the procedure just isn't cached
+			analysis_cache[slot] = (analysis_cache_entry_t){analysis, slots, i};
+			analysis_cache_drop(slot);
+			return -1;
+		}
+		callers[slots[i]] = slot_callers;
+		callers[slots[i]][caller_counts[slots[i]]++] = slot;
+	}
+
+	analysis_cache[slot] = (analysis_cache_entry_t){analysis, slots, slot_count};
+	return 0;
+}
+
+/**
+ * Get the analysis of a stored procedure for a run, analyzing it only if it isn't cached yet.
+ * The returned analysis and its procedure (a snapshot of the stored one, unaffected by later pushes) are shared
+ * with other runs and must not be freed; release them with proc_analysis_release instead.
+ *
+ * @param slot The slot of the procedure
+ * @return The compiled analysis, or NULL on failure
+ */
+proc_analysis_t * proc_analysis_acquire(uint8_t slot) {
+	if (proc_mutex_take(analysis_cache_mutex) != PROC_MUTEX_OK) {
+		return NULL;
+	}
+
+	proc_analysis_t * analysis = NULL;
+	if (analysis_cache[slot].analysis != NULL || analysis_cache_add(slot) == 0) {
+		analysis = analysis_cache[slot].analysis;
+		analysis->refs++;
+	}
+
+	proc_mutex_give(analysis_cache_mutex);
+	return analysis;
+}
+
+/**
+ * Release an analysis acquired with proc_analysis_acquire.
+ *
+ * @param analysis The analysis, or NULL
+ */
+void proc_analysis_release(proc_analysis_t * analysis) {
+	if (analysis == NULL || proc_mutex_take(analysis_cache_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+	analysis_unref(analysis);
+	proc_mutex_give(analysis_cache_mutex);
+}
+
+void proc_runtime_invalidate_slot(uint8_t slot) {
+	if (analysis_cache_mutex == NULL || proc_mutex_take(analysis_cache_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+
+	// Dropping a caller removes it from the callers of the slot
+	while (caller_counts[slot] > 0) {
+		analysis_cache_drop(callers[slot][caller_counts[slot] - 1]);
+	}
+	analysis_cache_drop(slot);
+
+	proc_mutex_give(analysis_cache_mutex);
+}
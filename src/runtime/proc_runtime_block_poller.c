@@ -0,0 +1,652 @@
+// Shared poller evaluating the block conditions of parked procedure runs (and of conditions watched for other nodes) on a timer wheel
+
+#include <string.h>
+
+#include <csp/csp.h>
+
+#include <csp_proc/proc_runtime.h>
+#include <csp_proc/proc_analyze.h>
+#include <csp_proc/proc_client.h>
+#include <csp_proc/proc_memory.h>
+#include <csp_proc/proc_pack.h>
+#include <csp_proc/proc_mutex.h>
+
+#ifndef PARAM_REMOTE_TIMEOUT_MS
+#define PARAM_REMOTE_TIMEOUT_MS (1000)
+#endif
+
+// forward declarations
+int proc_runtime_ifelse(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t * registers);
+int proc_runtime_block(proc_instruction_t * instruction, proc_instruction_state_t * state);
+int proc_prefetch_operands(proc_instruction_t * instructions, proc_instruction_state_t * states, int count, int after_ifelse);
+int proc_block_watch_operands(proc_instruction_state_t * state, proc_param_watches_t * watches);
+void proc_block_unwatch_operands(proc_param_watches_t * watches);
+int proc_block_watches_stale(proc_param_watches_t * watches);
+void proc_block_condition(proc_instruction_t * instruction, proc_instruction_t * ifelse_instruction);
+void proc_block_schedule(proc_block_t * block, proc_block_t * schedule);
+uint32_t proc_block_next_period(proc_block_t * schedule, uint32_t period_ms);
+uint32_t proc_runtime_now_ms();
+int proc_runtime_resume(proc_continuation_t * continuation);
+void proc_runtime_sleep(uint32_t ms);
+void proc_analysis_release(proc_analysis_t * analysis);
+void proc_registers_free(proc_continuation_t * continuation);
+
+typedef enum {
+	BLOCK_WAIT_RUN,     // A run parked on a block instruction
+	BLOCK_WAIT_REMOTE,  // A condition watched on behalf of the runtime of another node
+} block_wait_kind_e;
+
+typedef enum {
+	BLOCK_WAIT_FREE,
+	BLOCK_WAIT_RESERVED,  // Taken by a run evaluating its block for the first time
+	BLOCK_WAIT_PENDING,   // Parked, condition is evaluated when due
+	BLOCK_WAIT_READY,     // Condition was true, waiting for a thread/task to resume the run on
+} block_wait_state_e;
+
+typedef struct block_wait_t {
+	block_wait_kind_e kind;
+	block_wait_state_e state;
+	proc_continuation_t continuation;  // Run waits only
+	proc_continuation_t * owner;       // Run waits: run the wait is reserved by, which releases it if stopped while reserving
+	proc_instruction_t * instruction;  // The block instruction, in continuation.proc or remote_instruction
+	proc_instruction_state_t * instruction_state;  // In continuation.states or remote_state
+	proc_instruction_t remote_instruction;         // Remote waits only, owns the operand names
+	proc_instruction_state_t remote_state;
+	proc_block_t schedule;  // Resolved polling schedule of the block instruction
+	uint32_t period_ms;     // Current polling period, grows with the backoff of the schedule
+	uint32_t due_ms;
+	uint32_t deadline_ms;
+	int event_driven;     // -1 until the operands have been resolved by the first evaluation
+	proc_param_watches_t param_watches;  // Local parameters the wait is woken by while event-driven
+	uint16_t watch_node;  // Run waits: node evaluating the offloaded condition. Remote waits: node to notify
+	uint32_t watch_id;    // Run waits: id of the offloaded condition, 0 if it's polled. Remote waits: id to notify with
+	int busy;             // Taken out of the wheel by a thread evaluating or resuming it without block_poller_mutex
+	int cancelled;        // Run waits: dropped by proc_block_poller_cancel_all while busy, released once no longer busy
+	struct block_wait_t * next;  // Next wait in the same wheel slot, or in the list of due waits being polled
+} block_wait_t;
+
+// Outcome of polling a busy wait, applied by block_wait_finish
+typedef enum {
+	BLOCK_POLL_AGAIN,    // Schedule the wait again
+	BLOCK_POLL_READY,    // The condition holds, but the run couldn't be resumed yet
+	BLOCK_POLL_RESUMED,  // The run was handed to the runtime, which owns it now
+	BLOCK_POLL_ENDED,    // Free the wait
+} block_poll_e;
+
+static block_wait_t block_waits[PROC_BLOCK_POLLER_MAX];
+static block_wait_t * block_wheel[PROC_BLOCK_WHEEL_SLOTS];
+static uint32_t block_wheel_ms;  // Start of the next wheel slot to be processed
+static proc_mutex_t * block_poller_mutex = NULL;
+static uint32_t next_watch_id = 1;
+
+static int time_before(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b) < 0;
+}
+
+static block_wait_t ** wheel_slot(uint32_t ms) {
+	return &block_wheel[(ms / MIN_PROC_BLOCK_PERIOD_MS) % PROC_BLOCK_WHEEL_SLOTS];
+}
+
+/**
+ * Must be called with block_poller_mutex taken.
+ */
+static void wheel_insert(block_wait_t * wait) {
+	if (time_before(wait->due_ms, block_wheel_ms)) {
+		wait->due_ms = block_wheel_ms;  // The slot of the due time has already been processed
+	}
+	block_wait_t ** slot = wheel_slot(wait->due_ms);
+	wait->next = *slot;
+	*slot = wait;
+}
+
+/**
+ * Must be called with block_poller_mutex taken.
+ */
+static void wheel_remove(block_wait_t * wait) {
+	for (block_wait_t ** link = wheel_slot(wait->due_ms); *link != NULL; link = &(*link)->next) {
+		if (*link == wait) {
+			*link = wait->next;
+			break;
+		}
+	}
+	wait->next = NULL;
+}
+
+int proc_block_poller_init() {
+	if (block_poller_mutex == NULL) {
+		uint32_t now = proc_runtime_now_ms();
+		block_wheel_ms = now - (now % MIN_PROC_BLOCK_PERIOD_MS);
+		block_poller_mutex = proc_mutex_create();
+	}
+	return (block_poller_mutex != NULL) ? 0 : -1;
+}
+
+/**
+ * Evaluate the condition of a block instruction once.
+ *
+ * @return IF_ELSE_FLAG_TRUE, IF_ELSE_FLAG_FALSE or an error flag
+ */
+static int block_evaluate(proc_instruction_t * instruction, proc_instruction_state_t * state) {
+	// Create a temporary ifelse instruction from the block instruction for compatibility with proc_runtime_ifelse
+	proc_instruction_t ifelse_instruction;
+	proc_block_condition(instruction, &ifelse_instruction);
+
+	proc_prefetch_operands(&ifelse_instruction, state, 1, 0);
+	return proc_runtime_ifelse(&ifelse_instruction, state, NULL);
+}
+
+/**
+ * Take a free wait, or NULL if the poller is full.
+ *
+ * @param owner Run reserving the wait, NULL for conditions watched for other nodes
+ */
+static block_wait_t * block_wait_reserve(proc_continuation_t * owner) {
+	block_wait_t * wait = NULL;
+	if (block_poller_mutex != NULL && proc_mutex_take(block_poller_mutex) == PROC_MUTEX_OK) {
+		for (size_t i = 0; i < PROC_BLOCK_POLLER_MAX; i++) {
+			if (block_waits[i].state == BLOCK_WAIT_FREE) {
+				wait = &block_waits[i];
+				wait->state = BLOCK_WAIT_RESERVED;
+				wait->owner = owner;
+				wait->event_driven = 0;
+				wait->busy = 0;
+				wait->cancelled = 0;
+				break;
+			}
+		}
+		proc_mutex_give(block_poller_mutex);
+	}
+	return wait;
+}
+
+/**
+ * Stop watching the parameters of a wait that's no longer woken by their changes.
+ */
+static void block_wait_unwatch(block_wait_t * wait) {
+	if (wait->event_driven == 1) {
+		proc_block_unwatch_operands(&wait->param_watches);
+		wait->event_driven = 0;
+	}
+}
+
+/**
+ * Free a wait that isn't in the wheel, along with the run or condition it owns.
+ * Must be called with block_poller_mutex taken.
+ */
+static void block_wait_release(block_wait_t * wait) {
+	block_wait_unwatch(wait);
+	if (wait->kind == BLOCK_WAIT_RUN) {
+		proc_analysis_release(wait->continuation.root_analysis);
+		proc_registers_free(&wait->continuation);
+		proc_free(wait->continuation.frames);
+		proc_free(wait->continuation.loops);
+	} else {
+		proc_free(wait->remote_instruction.instruction.block.param_a.name);
+		proc_free(wait->remote_instruction.instruction.block.param_b.name);
+	}
+	wait->state = BLOCK_WAIT_FREE;
+}
+
+/**
+ * End a busy pending wait whose condition holds, failed or timed out. Remote waits notify their node and are freed,
+ * run waits whose condition holds become ready to be resumed, other run waits are freed.
+ * Must be called without block_poller_mutex, as notifying a node sends a packet.
+ *
+ * @return BLOCK_POLL_READY or BLOCK_POLL_ENDED
+ */
+static block_poll_e block_wait_end(block_wait_t * wait, int holds) {
+	if (wait->kind == BLOCK_WAIT_REMOTE) {
+		proc_watch_notify(wait->watch_id, holds, wait->watch_node);
+		return BLOCK_POLL_ENDED;
+	}
+	return holds ? BLOCK_POLL_READY : BLOCK_POLL_ENDED;
+}
+
+/**
+ * Schedule the next evaluation of a pending wait, or retry resuming a ready one on the next tick.
+ * Must be called with block_poller_mutex taken.
+ */
+static void block_wait_schedule(block_wait_t * wait, uint32_t now) {
+	if (wait->state == BLOCK_WAIT_READY) {
+		wait->due_ms = now + MIN_PROC_BLOCK_PERIOD_MS;
+	} else if (wait->kind == BLOCK_WAIT_RUN && wait->watch_id != 0) {
+		wait->due_ms = wait->deadline_ms + PARAM_REMOTE_TIMEOUT_MS;  // Offloaded, the notification of the node is given time to arrive
+	} else {
+		wait->due_ms = now + ((wait->event_driven == 1) ? PROC_BLOCK_EVENT_RECHECK_MS : wait->period_ms);
+		if (time_before(wait->deadline_ms, wait->due_ms)) {
+			wait->due_ms = wait->deadline_ms;
+		}
+	}
+	wheel_insert(wait);
+}
+
+/**
+ * Evaluate a busy wait, then resume its run or end it. Must be called without block_poller_mutex, as evaluating
+ * the condition may pull remote parameters, and resuming a run or notifying a node takes other locks or sends
+ * a packet. The outcome is applied with block_wait_finish.
+ */
+static block_poll_e block_wait_poll(block_wait_t * wait, uint32_t now) {
+	block_poll_e outcome = (wait->state == BLOCK_WAIT_READY) ? BLOCK_POLL_READY : BLOCK_POLL_AGAIN;
+
+	if (wait->state == BLOCK_WAIT_PENDING) {
+		if (!time_before(now, wait->deadline_ms)) {
+			csp_print("Timeout reached in proc_runtime_block\n");
+			return block_wait_end(wait, 0);
+		}
+
+		// Offloaded conditions are ended by proc_runtime_watch_notify
+		if (wait->kind == BLOCK_WAIT_REMOTE || wait->watch_id == 0) {
+			if (wait->event_driven == 1 && proc_block_watches_stale(&wait->param_watches)) {
+				wait->event_driven = -1;  // The parameters may have been replaced, watch them again once resolved
+			}
+			int ifelse_result = block_evaluate(wait->instruction, wait->instruction_state);
+			if (ifelse_result == IF_ELSE_FLAG_FALSE && wait->event_driven == -1) {
+				// Local operands are woken by their set hook; re-evaluate once, as they may have changed before being watched
+				wait->event_driven = proc_block_watch_operands(wait->instruction_state, &wait->param_watches);
+				if (wait->event_driven) {
+					ifelse_result = block_evaluate(wait->instruction, wait->instruction_state);
+				}
+			}
+
+			if (ifelse_result <= IF_ELSE_FLAG_ERR) {
+				csp_print("Error in if-else condition %d\n", ifelse_result);
+				return block_wait_end(wait, 0);
+			} else if (ifelse_result == IF_ELSE_FLAG_TRUE) {
+				outcome = block_wait_end(wait, 1);
+			} else {
+				wait->period_ms = proc_block_next_period(&wait->schedule, wait->period_ms);
+			}
+		}
+	}
+
+	// The condition only has to hold once, so a ready run isn't re-evaluated while no thread/task is available for it
+	if (outcome == BLOCK_POLL_READY && proc_runtime_resume(&wait->continuation) == 0) {
+		return BLOCK_POLL_RESUMED;
+	}
+	return outcome;
+}
+
+/**
+ * Apply the outcome of polling a busy wait: free it, or put it back in the wheel.
+ * Must be called with block_poller_mutex taken.
+ */
+static void block_wait_finish(block_wait_t * wait, block_poll_e outcome) {
+	wait->busy = 0;
+	if (outcome == BLOCK_POLL_RESUMED || outcome == BLOCK_POLL_READY) {
+		block_wait_unwatch(wait);  // The condition held, its parameters no longer matter
+	}
+	if (outcome == BLOCK_POLL_RESUMED) {
+		wait->state = BLOCK_WAIT_FREE;
+	} else if (outcome == BLOCK_POLL_ENDED || wait->cancelled) {
+		block_wait_release(wait);
+	} else {
+		if (outcome == BLOCK_POLL_READY) {
+			wait->state = BLOCK_WAIT_READY;
+		}
+		block_wait_schedule(wait, proc_runtime_now_ms());
+	}
+}
+
+/**
+ * Park a run on an offloaded block instruction: the condition is sent to the runtime of the instruction node,
+ * which notifies this node once it holds. Falls back to polling the condition if the node doesn't watch it.
+ *
+ * @return PROC_RUN_PARKED, or -1 on error
+ */
+static int block_park_offloaded(block_wait_t * wait, proc_instruction_t * instruction, proc_block_t * schedule, proc_continuation_t * continuation) {
+	if (proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		wait->state = BLOCK_WAIT_FREE;
+		return -1;
+	}
+
+	// Pending before the request is sent, as the notification may arrive before the request returns
+	uint32_t watch_id = next_watch_id++;
+	if (next_watch_id == 0) {
+		next_watch_id = 1;
+	}
+	wait->watch_node = instruction->node;
+	wait->watch_id = watch_id;
+	wait->state = BLOCK_WAIT_PENDING;
+	block_wait_schedule(wait, proc_runtime_now_ms());
+	continuation->parked = 1;
+	proc_mutex_give(block_poller_mutex);
+
+	proc_ifelse_t condition = {instruction->instruction.block.param_a, instruction->instruction.block.op, instruction->instruction.block.param_b};
+	if (proc_watch_request(&condition, schedule->timeout_ms, watch_id, instruction->node, PARAM_REMOTE_TIMEOUT_MS) == 0) {
+		return PROC_RUN_PARKED;
+	}
+
+	csp_print("Node %d can't watch the block condition, polling it instead\n", instruction->node);
+	if (proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		return PROC_RUN_PARKED;  // Still times out
+	}
+	if (wait->kind == BLOCK_WAIT_RUN && wait->state == BLOCK_WAIT_PENDING && !wait->busy && wait->watch_id == watch_id) {
+		wheel_remove(wait);
+		wait->watch_id = 0;
+		block_wait_schedule(wait, proc_runtime_now_ms());
+	}
+	proc_mutex_give(block_poller_mutex);
+	return PROC_RUN_PARKED;
+}
+
+/**
+ * Execute a block instruction of a run, parking the run on the block poller if the condition doesn't hold yet.
+ * Falls back to waiting in place when the poller is full, or to yielding in the coroutine runtime, where
+ * waiting in place would stall the other runs.
+ *
+ * @param instruction The block instruction
+ * @param state The state of the instruction in the executing frame, in continuation->states, holding the resolved parameter handles
+ * @param continuation State to resume the run from, copied by the poller when the run is parked (setting parked)
+ * @return 0 if the condition holds, PROC_RUN_PARKED if the run was parked, PROC_RUN_YIELDED if the block must
+ *         be retried later, -1 on error
+ */
+int proc_block_park(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_continuation_t * continuation) {
+	if (instruction->type != PROC_BLOCK) {
+		csp_print("Invalid instruction type, expected PROC_BLOCK\n");
+		return -1;
+	}
+
+	block_wait_t * wait = block_wait_reserve(continuation);
+	if (wait == NULL) {
+#if PROC_RUNTIME_COROUTINE
+		return PROC_RUN_YIELDED;
+#else
+		return proc_runtime_block(instruction, state);
+#endif
+	}
+
+	proc_block_t schedule;
+	proc_block_schedule(&instruction->instruction.block, &schedule);
+
+	wait->kind = BLOCK_WAIT_RUN;
+	wait->continuation = *continuation;
+	wait->instruction = instruction;  // Owned by the run, like the rest of the continuation
+	wait->instruction_state = state;  // Owned by the run along with its other instruction states
+	wait->schedule = schedule;
+	wait->period_ms = schedule.min_period_ms;
+	wait->deadline_ms = proc_runtime_now_ms() + schedule.timeout_ms;
+	wait->event_driven = 0;
+	wait->watch_id = 0;
+
+	if (instruction->instruction.block.offload && instruction->node != 0) {
+		return block_park_offloaded(wait, instruction, &schedule, continuation);
+	}
+
+	// Most blocks are already satisfied, so evaluate on the calling thread/task before handing the run over
+	int ifelse_result = block_evaluate(instruction, state);
+	if (ifelse_result == IF_ELSE_FLAG_FALSE) {
+		// Local operands are woken by their set hook; re-evaluate once, as they may have changed before being watched
+		wait->event_driven = proc_block_watch_operands(state, &wait->param_watches);
+		if (wait->event_driven) {
+			ifelse_result = block_evaluate(instruction, state);
+		}
+	}
+
+	if (proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		block_wait_unwatch(wait);
+		wait->state = BLOCK_WAIT_FREE;
+		return -1;
+	}
+
+	int ret;
+	if (ifelse_result == IF_ELSE_FLAG_FALSE) {
+		wait->state = BLOCK_WAIT_PENDING;
+		block_wait_schedule(wait, proc_runtime_now_ms());
+		continuation->parked = 1;
+		ret = PROC_RUN_PARKED;
+	} else {
+		block_wait_unwatch(wait);
+		wait->state = BLOCK_WAIT_FREE;
+		if (ifelse_result <= IF_ELSE_FLAG_ERR) {
+			csp_print("Error in if-else condition %d\n", ifelse_result);
+			ret = -1;
+		} else {
+			ret = 0;
+		}
+	}
+
+	proc_mutex_give(block_poller_mutex);
+	return ret;
+}
+
+/**
+ * Park a run for the period of a loop instruction, resuming it once the period has passed. Falls back to
+ * sleeping in place when the poller is full, or to yielding in the coroutine runtime (shortening the period to
+ * a turn of the other runs).
+ *
+ * @param period_ms How long to wait before the run continues
+ * @param continuation State to resume the run from, copied by the poller when the run is parked (setting parked)
+ * @return 0 once the period has passed, PROC_RUN_PARKED if the run was parked, PROC_RUN_YIELDED if the run
+ *         should continue once the other runs had their turn, -1 on error
+ */
+int proc_loop_park(uint32_t period_ms, proc_continuation_t * continuation) {
+	block_wait_t * wait = block_wait_reserve(continuation);
+	if (wait == NULL) {
+#if PROC_RUNTIME_COROUTINE
+		return PROC_RUN_YIELDED;
+#else
+		proc_runtime_sleep(period_ms);
+		return 0;
+#endif
+	}
+
+	wait->kind = BLOCK_WAIT_RUN;
+	wait->continuation = *continuation;
+	wait->instruction = NULL;
+	wait->instruction_state = NULL;
+	wait->event_driven = 0;
+	wait->watch_id = 0;
+
+	if (proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		wait->state = BLOCK_WAIT_FREE;
+		return -1;
+	}
+
+	// There's no condition to evaluate, the run is resumed as soon as it's due
+	wait->state = BLOCK_WAIT_READY;
+	wait->due_ms = proc_runtime_now_ms() + period_ms;
+	wheel_insert(wait);
+	continuation->parked = 1;
+
+	proc_mutex_give(block_poller_mutex);
+	return PROC_RUN_PARKED;
+}
+
+int proc_runtime_watch(proc_ifelse_t * condition, uint32_t timeout_ms, uint16_t node, uint32_t watch_id) {
+	block_wait_t * wait = block_wait_reserve(NULL);
+	if (wait == NULL) {
+		csp_print("Block poller full, can't watch condition for node %d\n", node);
+		return -1;
+	}
+
+	wait->kind = BLOCK_WAIT_REMOTE;
+	memset(&wait->remote_instruction, 0, sizeof(proc_instruction_t));
+	memset(&wait->remote_state, 0, sizeof(proc_instruction_state_t));
+	wait->remote_instruction.type = PROC_BLOCK;
+	wait->remote_instruction.node = 0;  // The operands are local to this node
+	wait->remote_instruction.instruction.block.param_a = condition->param_a;
+	wait->remote_instruction.instruction.block.param_a.name = (condition->param_a.name != NULL) ? proc_strdup(condition->param_a.name) : NULL;
+	wait->remote_instruction.instruction.block.op = condition->op;
+	wait->remote_instruction.instruction.block.param_b = condition->param_b;
+	wait->remote_instruction.instruction.block.param_b.name = (condition->param_b.name != NULL) ? proc_strdup(condition->param_b.name) : NULL;
+	wait->remote_instruction.instruction.block.timeout_ms = timeout_ms;
+	wait->instruction = &wait->remote_instruction;
+	wait->instruction_state = &wait->remote_state;
+
+	proc_block_schedule(&wait->remote_instruction.instruction.block, &wait->schedule);
+	wait->period_ms = wait->schedule.min_period_ms;
+	wait->deadline_ms = proc_runtime_now_ms() + wait->schedule.timeout_ms;
+	wait->event_driven = -1;
+	wait->watch_node = node;
+	wait->watch_id = watch_id;
+
+	if (proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		block_wait_release(wait);
+		return -1;
+	}
+	wait->state = BLOCK_WAIT_PENDING;
+	wait->due_ms = proc_runtime_now_ms();  // Evaluated on the next poller tick
+	wheel_insert(wait);
+	proc_mutex_give(block_poller_mutex);
+
+	return 0;
+}
+
+void proc_runtime_watch_notify(uint16_t node, uint32_t watch_id, int holds) {
+	if (block_poller_mutex == NULL || proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+
+	block_wait_t * wait = NULL;
+	for (size_t i = 0; i < PROC_BLOCK_POLLER_MAX; i++) {
+		block_wait_t * candidate = &block_waits[i];
+		if (candidate->kind == BLOCK_WAIT_RUN && candidate->state == BLOCK_WAIT_PENDING && !candidate->busy && candidate->watch_id == watch_id && candidate->watch_node == node) {
+			wait = candidate;
+			wheel_remove(wait);
+			if (holds) {
+				wait->busy = 1;
+			} else {
+				block_wait_release(wait);
+			}
+			break;
+		}
+	}
+
+	proc_mutex_give(block_poller_mutex);
+
+	if (wait == NULL) {
+		return;
+	}
+	if (!holds) {
+		csp_print("Timeout reached in proc_runtime_block (offloaded to node %d)\n", node);
+		return;
+	}
+
+	// Resumed on the thread/task serving the notification, without holding up the other waits
+	block_poll_e outcome = (proc_runtime_resume(&wait->continuation) == 0) ? BLOCK_POLL_RESUMED : BLOCK_POLL_READY;
+	if (proc_mutex_take(block_poller_mutex) == PROC_MUTEX_OK) {
+		block_wait_finish(wait, outcome);
+		proc_mutex_give(block_poller_mutex);
+	}
+}
+
+/**
+ * Process the block poller: evaluate the waits that are due and, if watched local parameters have changed,
+ * all event-driven waits. Called repeatedly by the platform poller thread/task.
+ *
+ * @param params_changed Whether a watched local parameter has been set since the last call
+ * @return Time in ms until the poller should be processed again (unless parameters change before)
+ */
+uint32_t proc_block_poller_process(int params_changed) {
+	if (proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		return MIN_PROC_BLOCK_PERIOD_MS;
+	}
+
+	uint32_t now = proc_runtime_now_ms();
+
+	// Take the waits to poll out of the wheel, then poll them without the mutex
+	block_wait_t * due = NULL;
+	if (params_changed) {
+		for (size_t i = 0; i < PROC_BLOCK_POLLER_MAX; i++) {
+			block_wait_t * wait = &block_waits[i];
+			if (wait->state == BLOCK_WAIT_PENDING && !wait->busy && wait->event_driven == 1) {
+				wheel_remove(wait);
+				wait->busy = 1;
+				wait->next = due;
+				due = wait;
+			}
+		}
+	}
+
+	// Each slot that has passed is processed at most once
+	block_wait_t * passed = NULL;
+	for (size_t n = 0; n < PROC_BLOCK_WHEEL_SLOTS && !time_before(now, block_wheel_ms); n++) {
+		block_wait_t ** slot = wheel_slot(block_wheel_ms);
+		while (*slot != NULL) {
+			block_wait_t * wait = *slot;
+			*slot = wait->next;
+			wait->next = passed;
+			passed = wait;
+		}
+		block_wheel_ms += MIN_PROC_BLOCK_PERIOD_MS;
+	}
+	if (!time_before(now, block_wheel_ms)) {
+		block_wheel_ms = now - (now % MIN_PROC_BLOCK_PERIOD_MS) + MIN_PROC_BLOCK_PERIOD_MS;
+	}
+
+	while (passed != NULL) {
+		block_wait_t * wait = passed;
+		passed = wait->next;
+		if (time_before(now, wait->due_ms)) {
+			wheel_insert(wait);  // Due in a later revolution of the wheel
+		} else {
+			wait->busy = 1;
+			wait->next = due;
+			due = wait;
+		}
+	}
+
+	proc_mutex_give(block_poller_mutex);
+
+	while (due != NULL) {
+		block_wait_t * wait = due;
+		due = wait->next;
+		wait->next = NULL;
+		block_poll_e outcome = block_wait_poll(wait, now);
+		if (proc_mutex_take(block_poller_mutex) == PROC_MUTEX_OK) {
+			block_wait_finish(wait, outcome);
+			proc_mutex_give(block_poller_mutex);
+		}
+	}
+
+	uint32_t next = block_wheel_ms - proc_runtime_now_ms();  // Only changed by this thread/task
+	return (next > MIN_PROC_BLOCK_PERIOD_MS) ? 0 : next;
+}
+
+/**
+ * Drop all parked runs, freeing their procedures. Used when all procedures are stopped.
+ * Conditions watched for other nodes are kept.
+ */
+void proc_block_poller_cancel_all() {
+	if (block_poller_mutex == NULL || proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+
+	for (size_t i = 0; i < PROC_BLOCK_POLLER_MAX; i++) {
+		block_wait_t * wait = &block_waits[i];
+		if (wait->kind != BLOCK_WAIT_RUN || (wait->state != BLOCK_WAIT_PENDING && wait->state != BLOCK_WAIT_READY)) {
+			continue;
+		}
+		if (wait->busy) {
+			wait->cancelled = 1;  // Released by the thread/task polling it, unless its run was resumed meanwhile
+		} else {
+			wheel_remove(wait);
+			block_wait_release(wait);
+		}
+	}
+
+	proc_mutex_give(block_poller_mutex);
+}
+
+/**
+ * Return the wait a run had reserved to the poller, if it was stopped while evaluating its block for the first time
+ * (e.g. cancelled during a remote pull). Called when a run that isn't parked is freed; the wait's copy of the run
+ * isn't freed, as the run still owned its state.
+ *
+ * @param continuation The run being freed
+ */
+void proc_block_poller_release_reserved(proc_continuation_t * continuation) {
+	if (block_poller_mutex == NULL || proc_mutex_take(block_poller_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+
+	for (size_t i = 0; i < PROC_BLOCK_POLLER_MAX; i++) {
+		block_wait_t * wait = &block_waits[i];
+		if (wait->state == BLOCK_WAIT_RESERVED && wait->owner == continuation) {
+			block_wait_unwatch(wait);
+			wait->state = BLOCK_WAIT_FREE;
+		}
+	}
+
+	proc_mutex_give(block_poller_mutex);
+}
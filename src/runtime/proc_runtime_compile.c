@@ -0,0 +1,191 @@
+// Lowering of analyzed procedures into a pre-decoded op stream for the execution loops
+
+#include <csp/csp.h>
+
+#include <csp_proc/proc_types.h>
+#include <csp_proc/proc_runtime.h>
+#include <csp_proc/proc_analyze.h>
+#include <csp_proc/proc_memory.h>
+
+// forward declarations
+int proc_runtime_ifelse(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t * registers);
+int proc_runtime_set(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_write_buffer_t * write_buffer);
+int proc_runtime_unop(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer);
+int proc_runtime_binop(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer);
+
+static int op_ifelse(proc_op_t * op, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
+	int ifelse_result = proc_runtime_ifelse(op->instruction, state, *registers);
+	if (ifelse_result <= IF_ELSE_FLAG_ERR) {
+		return ifelse_result;
+	}
+	return (ifelse_result == IF_ELSE_FLAG_TRUE) ? 0 : PROC_OP_BRANCH;
+}
+
+static int op_set(proc_op_t * op, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
+	return proc_runtime_set(op->instruction, state, write_buffer);
+}
+
+static int op_unop(proc_op_t * op, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
+	return proc_runtime_unop(op->instruction, state, registers, write_buffer);
+}
+
+static int op_binop(proc_op_t * op, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
+	return proc_runtime_binop(op->instruction, state, registers, write_buffer);
+}
+
+static int op_noop(proc_op_t * op, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
+	return 0;
+}
+
+/**
+ * Whether the instruction at an index is the if-clause of an if-else instruction, i.e. must skip the
+ * else-clause when it's reached because the condition holds.
+ * If-else instructions in an if-clause don't skip anything themselves, as their own result decides what follows.
+ */
+static int is_if_clause(proc_t * proc, int index) {
+	return index > 0 && index < proc->instruction_count && proc->instructions[index - 1].type == PROC_IFELSE && proc->instructions[index].type != PROC_IFELSE;
+}
+
+static int code_target(proc_t * proc, int index) {
+	return (index < proc->instruction_count) ? index : PROC_CODE_END;
+}
+
+/**
+ * Find the analysis of the procedure called by a call instruction.
+ */
+static proc_analysis_t * call_callee(proc_analysis_t * analysis, proc_instruction_t * instruction) {
+	for (size_t j = 0; j < analysis->procedure_slot_count; j++) {
+		if (analysis->procedure_slots[j] == instruction->instruction.call.procedure_slot) {
+			return analysis->sub_analyses[j];
+		}
+	}
+	return NULL;
+}
+
+static int compile_op(proc_analysis_t * analysis, int index, proc_op_t * op) {
+	proc_instruction_t * instruction = &analysis->proc->instructions[index];
+
+	op->instruction = instruction;
+	op->instruction_analysis = &analysis->instruction_analyses[index];
+	op->callee = NULL;
+	op->index = index;
+	op->next = code_target(analysis->proc, index + 1);
+	op->branch = PROC_CODE_END;
+
+	switch (instruction->type) {
+		case PROC_BLOCK:
+			op->handler = NULL;
+			break;
+		case PROC_IFELSE:
+			op->handler = op_ifelse;
+			op->branch = code_target(analysis->proc, index + 2);  // The else-clause
+			break;
+		case PROC_SET:
+			op->handler = op_set;
+			break;
+		case PROC_UNOP:
+			op->handler = op_unop;
+			break;
+		case PROC_BINOP:
+			op->handler = op_binop;
+			break;
+		case PROC_CALL:
+			op->handler = NULL;
+			op->callee = call_callee(analysis, instruction);
+			if (op->callee == NULL) {
+				csp_print("Error: procedure not found %d\n", instruction->instruction.call.procedure_slot);
+				return -1;
+			}
+			break;
+		case PROC_JUMP:
+		case PROC_LOOP:
+			op->handler = NULL;
+			op->branch = proc_jump_target(analysis->proc, index);  // Loops: the start of the loop body
+			if (op->branch < 0) {
+				csp_print("Error: jump target out of range at instruction %d\n", index);
+				return -1;
+			}
+			op->branch = code_target(analysis->proc, op->branch);
+			break;
+		case PROC_SWITCH:
+			op->handler = NULL;  // The target is looked up in the jump table of the instruction when it's executed
+			break;
+		case PROC_IF:
+			op->handler = op_ifelse;
+			op->branch = code_target(analysis->proc, op->instruction_analysis->target);  // The else-clause, or past the endif
+			break;
+		case PROC_ELSE:
+			op->handler = op_noop;
+			op->next = code_target(analysis->proc, op->instruction_analysis->target);  // End of the if-clause, skip the else-clause
+			break;
+		case PROC_NOOP:
+		case PROC_ENDIF:
+			op->handler = op_noop;
+			break;
+		default:
+			csp_print("Invalid instruction type %d\n", instruction->type);
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Compile an analyzed procedure, and the procedures it calls, into a stream of ops.
+ *
+ * The first instruction_count ops are the instructions in order. If-clauses (instructions directly following
+ * an if-else instruction) get a second op appended after those, continuing past the else-clause; the if-else
+ * op branches to it when its condition holds. If instructions branch to the clause after their else instruction
+ * (or past their endif) and else instructions continue past their endif, as resolved by proc_analyze, however
+ * long and deeply nested the clauses are. Jumps and loops branch to their resolved target instruction, and
+ * switches to the target instruction found in their jump table.
+ * Which instruction runs next is thus decided at compile time.
+ *
+ * @param analysis The analysis of the procedure, its code is set on success
+ * @return 0 on success, -1 on failure
+ */
+int proc_compile(proc_analysis_t * analysis) {
+	if (analysis->code != NULL) {
+		return 0;
+	}
+
+	proc_t * proc = analysis->proc;
+	int if_clause_count = 0;
+	for (int i = 0; i < proc->instruction_count; i++) {
+		if_clause_count += is_if_clause(proc, i);
+	}
+
+	int code_length = proc->instruction_count + if_clause_count;
+	proc_op_t * code = proc_calloc((code_length > 0) ? code_length : 1, sizeof(proc_op_t));
+	if (code == NULL) {
+		csp_print("Error allocating memory for compiled procedure\n");
+		return -1;
+	}
+
+	int if_clause_op = proc->instruction_count;
+	for (int i = 0; i < proc->instruction_count; i++) {
+		if (compile_op(analysis, i, &code[i]) != 0) {
+			proc_free(code);
+			return -1;
+		}
+
+		if (is_if_clause(proc, i)) {
+			code[if_clause_op] = code[i];
+			code[if_clause_op].next = code_target(proc, i + 2);
+			code[i - 1].next = if_clause_op;
+			if_clause_op++;
+		}
+	}
+
+	// Set before compiling the callees, as they may call back into this procedure
+	analysis->code = code;
+	analysis->code_length = code_length;
+
+	for (size_t j = 0; j < analysis->sub_analysis_count; j++) {
+		if (proc_compile(analysis->sub_analyses[j]) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,203 @@
+// Execution loop of the runtimes: runs keep their call stack in their continuation instead of on the stack of
+// the executing thread/task, so a run can be suspended at any instruction and continued later on another one
+
+#include <csp/csp.h>
+
+#include <csp_proc/proc_types.h>
+#include <csp_proc/proc_runtime.h>
+#include <csp_proc/proc_analyze.h>
+#include <csp_proc/proc_memory.h>
+
+// forward declarations
+int proc_runtime_call(proc_op_t * op, proc_continuation_t * continuation, proc_analysis_t ** analysis, proc_t ** proc, int * pc);
+int proc_compile(proc_analysis_t * analysis);
+int proc_prefetch_operands(proc_instruction_t * instructions, proc_instruction_state_t * states, int count, int after_ifelse);
+void proc_write_buffer_init(proc_write_buffer_t * write_buffer);
+int proc_write_buffer_flush(proc_write_buffer_t * write_buffer);
+int proc_write_buffer_needs_flush(proc_write_buffer_t * write_buffer, proc_instruction_t * instruction);
+int proc_block_park(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_continuation_t * continuation);
+int proc_runtime_resume(proc_continuation_t * continuation);
+int proc_runtime_jump(proc_op_t * op, proc_continuation_t * continuation, proc_analysis_t * analysis, int * next);
+int proc_loop_park(uint32_t period_ms, proc_continuation_t * continuation);
+void proc_loops_unwind(proc_continuation_t * continuation, int depth);
+void proc_registers_free(proc_continuation_t * continuation);
+int proc_states_ensure(proc_continuation_t * continuation, proc_t * proc);
+proc_analysis_t * proc_analysis_acquire(uint8_t slot);
+void proc_analysis_release(proc_analysis_t * analysis);
+
+/**
+ * Continue a run from its continuation, until it ends, is parked on a block instruction, or has executed
+ * budget instructions. Calls and returns only update the continuation, so deep call chains cost a frame on the
+ * heap each rather than native stack.
+ *
+ * @param continuation State to continue the run from, updated unless the run ends
+ * @param budget Number of instructions to execute before yielding, 0 for no limit
+ * @return 0 when the run is done, PROC_RUN_PARKED if the run was parked on a block instruction,
+ *         PROC_RUN_YIELDED if the run should be queued to continue later, -1 on error
+ */
+static int instructions_run(proc_continuation_t * continuation, unsigned int budget) {
+	proc_t * proc = continuation->proc;
+	proc_analysis_t * analysis = continuation->analysis;
+	int pc = continuation->pc;
+
+	int ret = 0;
+	unsigned int executed = 0;
+	int prefetch_end = -1;  // Last instruction whose remote operands have been pulled ahead
+	proc_write_buffer_t write_buffer;
+	proc_write_buffer_init(&write_buffer);
+
+	if (proc_compile(analysis) != 0) {
+		csp_print("Error compiling procedure\n");
+		ret = -1;
+	}
+
+	while (ret == 0) {
+		if (pc == PROC_CODE_END) {
+			if (continuation->depth == 0) {
+				break;
+			}
+			// Return to the caller, flushing the writes of the called procedure first
+			if (proc_write_buffer_flush(&write_buffer) != 0) {
+				ret = -1;
+				break;
+			}
+			proc_loops_unwind(continuation, continuation->depth);
+			proc_frame_t * frame = &continuation->frames[--continuation->depth];
+			proc = frame->proc;
+			analysis = frame->analysis;
+			pc = frame->pc;
+			proc_free(continuation->registers);  // The registers and instruction states of the called procedure are done with its frame
+			continuation->registers = frame->registers;
+			proc_free(continuation->states);
+			continuation->states = frame->states;
+			prefetch_end = -1;
+			continue;
+		}
+
+		if (budget != 0 && executed++ == budget) {
+			ret = PROC_RUN_YIELDED;
+			break;
+		}
+
+		if (proc_states_ensure(continuation, proc) != 0) {
+			ret = -1;
+			break;
+		}
+
+		proc_op_t * op = &analysis->code[pc];
+		proc_instruction_state_t * state = &continuation->states[op->index];
+		int next = op->next;
+
+		if (proc_write_buffer_needs_flush(&write_buffer, op->instruction) && proc_write_buffer_flush(&write_buffer) != 0) {
+			ret = -1;
+			break;
+		}
+
+		if (op->index > prefetch_end) {
+			int after_ifelse = (op->index > 0 && proc->instructions[op->index - 1].type == PROC_IFELSE);
+			prefetch_end = op->index + proc_prefetch_operands(op->instruction, state, proc->instruction_count - op->index, after_ifelse) - 1;
+		}
+
+		if (op->handler != NULL) {
+			ret = op->handler(op, state, &continuation->registers, &write_buffer);
+			if (ret == PROC_OP_BRANCH) {
+				next = op->branch;
+				ret = 0;
+			}
+		} else if (op->instruction->type == PROC_BLOCK) {
+			continuation->proc = proc;
+			continuation->analysis = analysis;
+			continuation->pc = next;
+			ret = proc_block_park(op->instruction, state, continuation);
+			if (ret == PROC_RUN_YIELDED) {
+				next = pc;  // The poller is full (coroutine runtime), retry the block once the other runs had their turn
+			}
+		} else if (op->instruction->type == PROC_JUMP || op->instruction->type == PROC_LOOP || op->instruction->type == PROC_SWITCH) {
+			ret = proc_runtime_jump(op, continuation, analysis, &next);
+			if (ret == 0 && op->instruction->type == PROC_LOOP && next == op->branch && op->instruction->instruction.loop.period_ms != 0) {
+				continuation->proc = proc;
+				continuation->analysis = analysis;
+				continuation->pc = next;
+				ret = proc_loop_park(op->instruction->instruction.loop.period_ms, continuation);
+			}
+			prefetch_end = -1;  // operands pulled ahead may belong to instructions jumped over
+		} else {
+			ret = proc_runtime_call(op, continuation, &analysis, &proc, &next);
+			prefetch_end = -1;  // a call continues execution in another procedure
+		}
+
+		if (ret != 0) {
+			if (ret == PROC_RUN_YIELDED) {
+				pc = next;
+			}
+			break;
+		}
+		pc = next;
+	}
+
+	// Writes buffered before an error are still pushed, as they would have been without buffering
+	if (proc_write_buffer_flush(&write_buffer) != 0 && (ret == 0 || ret == PROC_RUN_YIELDED)) {
+		ret = -1;
+	}
+
+	if (ret == PROC_RUN_YIELDED) {
+		continuation->proc = proc;
+		continuation->analysis = analysis;
+		continuation->pc = pc;
+	}
+	return ret;
+}
+
+/**
+ * Continue a run from its continuation, until it ends, is parked on a block instruction, or (coroutine runtime)
+ * has executed PROC_COROUTINE_SLICE instructions.
+ *
+ * @param continuation State to continue the run from, updated unless the run ends
+ * @return 0 when the run is done, PROC_RUN_PARKED if the run was parked on a block instruction,
+ *         PROC_RUN_YIELDED if the run should be queued to continue later, -1 on error
+ */
+int proc_instructions_run(proc_continuation_t * continuation) {
+#if PROC_RUNTIME_COROUTINE
+	return instructions_run(continuation, PROC_COROUTINE_SLICE);
+#else
+	return instructions_run(continuation, 0);
+#endif
+}
+
+int proc_runtime_run_inline(uint8_t proc_slot) {
+	if (PROC_INLINE_BUDGET == 0) {
+		return PROC_RUN_NOT_INLINE;
+	}
+
+	proc_analysis_t * analysis = proc_analysis_acquire(proc_slot);
+	if (analysis == NULL) {
+		return -1;
+	}
+	if (!analysis->is_bounded_nonblocking) {
+		proc_analysis_release(analysis);
+		return PROC_RUN_NOT_INLINE;
+	}
+
+	// Without blocks, calls or loop periods, the run never parks nor needs frames, so it can live on the stack
+	proc_continuation_t continuation = {
+		.root_proc = analysis->proc,
+		.root_analysis = analysis,
+		.proc = analysis->proc,
+		.analysis = analysis,
+		.pc = 0,
+		.slot = proc_slot};
+
+	int ret = instructions_run(&continuation, PROC_INLINE_BUDGET);
+	if (ret == PROC_RUN_YIELDED) {
+		if (proc_runtime_resume(&continuation) == 0) {
+			return PROC_RUN_YIELDED;  // The runtime took over the run and its analysis reference
+		}
+		csp_print("Failed to hand procedure %d over to the runtime\n", proc_slot);
+		ret = -1;
+	}
+
+	proc_free(continuation.loops);
+	proc_registers_free(&continuation);
+	proc_analysis_release(analysis);
+	return ret;
+}
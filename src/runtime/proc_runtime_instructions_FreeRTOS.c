@@ -1,4 +1,5 @@
 #include "FreeRTOS.h"
+#include "task.h"
 
 #include <csp/csp.h>
 
@@ -6,48 +7,132 @@
 #include <csp_proc/proc_runtime.h>
 #include <csp_proc/proc_analyze.h>
 
-// NOTE: requires configNUM_THREAD_LOCAL_STORAGE_POINTERS > 0 in FreeRTOSConfig.h
-#ifndef TASK_STORAGE_RECURSION_DEPTH_INDEX
-#define TASK_STORAGE_RECURSION_DEPTH_INDEX 0
-#endif
-
 // forward declarations
-int proc_runtime_ifelse(proc_instruction_t * instruction);
-int proc_runtime_set(proc_instruction_t * instruction);
-int proc_runtime_unop(proc_instruction_t * instruction);
-int proc_runtime_binop(proc_instruction_t * instruction);
-int proc_runtime_call(proc_instruction_t * instruction, proc_analysis_t ** analysis, proc_t ** proc, int * i, if_else_flag_t * _if_else_flag);
+int proc_runtime_ifelse(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t * registers);
+int proc_prefetch_operands(proc_instruction_t * instructions, proc_instruction_state_t * states, int count, int after_ifelse);
+int proc_block_watch_operands(proc_instruction_state_t * state, proc_param_watches_t * watches);
+void proc_block_unwatch_operands(proc_param_watches_t * watches);
+int proc_block_watches_stale(proc_param_watches_t * watches);
+void proc_block_condition(proc_instruction_t * instruction, proc_instruction_t * ifelse_instruction);
+void proc_block_schedule(proc_block_t * block, proc_block_t * schedule);
+uint32_t proc_block_next_period(proc_block_t * schedule, uint32_t period_ms);
+
+#define PARAM_CHANGE_WAITERS (MAX_PROC_CONCURRENT + 1U)  // runtime tasks and the block poller task
+
+// Tasks blocked on watched local parameters, notified whenever one of them is set (see proc_runtime_param_watch.c)
+static TaskHandle_t param_change_waiters[PARAM_CHANGE_WAITERS];
+
+void proc_param_changed() {
+	taskENTER_CRITICAL();
+	for (size_t i = 0; i < PARAM_CHANGE_WAITERS; i++) {
+		if (param_change_waiters[i] != NULL) {
+			xTaskNotifyGive(param_change_waiters[i]);
+		}
+	}
+	taskEXIT_CRITICAL();
+}
+
+int proc_param_change_subscribe(TaskHandle_t task) {
+	int ret = -1;
+	taskENTER_CRITICAL();
+	for (size_t i = 0; i < PARAM_CHANGE_WAITERS; i++) {
+		if (param_change_waiters[i] == NULL) {
+			param_change_waiters[i] = task;
+			ret = 0;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+	return ret;
+}
+
+static void proc_param_change_unsubscribe(TaskHandle_t task) {
+	taskENTER_CRITICAL();
+	for (size_t i = 0; i < PARAM_CHANGE_WAITERS; i++) {
+		if (param_change_waiters[i] == task) {
+			param_change_waiters[i] = NULL;
+		}
+	}
+	taskEXIT_CRITICAL();
+}
 
 /**
  * Execute a block instruction.
  *
  * @param instruction The instruction to execute
+ * @param state The state of the instruction in the executing frame, holding the resolved parameter handles
  * @return int flag indicating the result of the block instruction (0 for success, -1 for error)
  */
-int proc_runtime_block(proc_instruction_t * instruction) {
+int proc_runtime_block(proc_instruction_t * instruction, proc_instruction_state_t * state) {
 	if (instruction->type != PROC_BLOCK) {
 		csp_print("Invalid instruction type, expected PROC_BLOCK\n");
 		return -1;
 	}
 
-	TickType_t timeout_tick = xTaskGetTickCount() + pdMS_TO_TICKS(MAX_PROC_BLOCK_TIMEOUT_MS);
+	proc_block_t schedule;
+	proc_block_schedule(&instruction->instruction.block, &schedule);
+	uint32_t period_ms = schedule.min_period_ms;
+
+	TickType_t timeout_tick = xTaskGetTickCount() + pdMS_TO_TICKS(schedule.timeout_ms);
 
 	// Create a temporary ifelse instruction from the block instruction for compatibility with proc_runtime_ifelse
 	proc_instruction_t ifelse_instruction;
-	ifelse_instruction.type = PROC_IFELSE;
-	ifelse_instruction.node = instruction->node;
-	ifelse_instruction.instruction.ifelse = instruction->instruction.block;
+	proc_block_condition(instruction, &ifelse_instruction);
+
+	int event_driven = -1;  // Unknown until the operands have been resolved by the first evaluation
+	proc_param_watches_t watches = {};
+	int subscribed = 0;
+	TaskHandle_t self = xTaskGetCurrentTaskHandle();
 
 	while (xTaskGetTickCount() < timeout_tick) {
-		int ifelse_result = proc_runtime_ifelse(&ifelse_instruction);
+		if (event_driven == 1 && proc_block_watches_stale(&watches)) {
+			event_driven = -1;  // The parameters may have been replaced, watch them again once resolved
+		}
+		proc_prefetch_operands(&ifelse_instruction, state, 1, 0);
+		int ifelse_result = proc_runtime_ifelse(&ifelse_instruction, state, NULL);
 		if (ifelse_result == IF_ELSE_FLAG_ERR) {
 			csp_print("Error in if-else condition %d\n", ifelse_result);
+			proc_block_unwatch_operands(&watches);
+			if (subscribed) {
+				proc_param_change_unsubscribe(self);
+			}
 			return -1;
 		} else if (ifelse_result == IF_ELSE_FLAG_TRUE) {
 			break;
 		}
 
-		vTaskDelay(pdMS_TO_TICKS(MIN_PROC_BLOCK_PERIOD_MS));
+		if (event_driven == -1) {
+			// Local operands are woken by their set hook; re-evaluate once, as they may have changed before being watched
+			event_driven = proc_block_watch_operands(state, &watches);
+			if (event_driven && !subscribed) {
+				if (proc_param_change_subscribe(self) == 0) {
+					subscribed = 1;
+				} else {
+					proc_block_unwatch_operands(&watches);
+					event_driven = 0;
+				}
+			}
+			if (event_driven) {
+				continue;
+			}
+		}
+
+		TickType_t now = xTaskGetTickCount();
+		TickType_t remaining = (now < timeout_tick) ? timeout_tick - now : 0;
+		if (event_driven) {
+			// Notifications given while evaluating are kept by the task, so none are missed
+			TickType_t recheck = pdMS_TO_TICKS(PROC_BLOCK_EVENT_RECHECK_MS);
+			ulTaskNotifyTake(pdTRUE, (remaining < recheck) ? remaining : recheck);
+		} else {
+			TickType_t period = pdMS_TO_TICKS(period_ms);
+			vTaskDelay((remaining < period) ? remaining : period);
+			period_ms = proc_block_next_period(&schedule, period_ms);
+		}
+	}
+
+	proc_block_unwatch_operands(&watches);
+	if (subscribed) {
+		proc_param_change_unsubscribe(self);
 	}
 
 	if (xTaskGetTickCount() >= timeout_tick) {
@@ -58,62 +143,11 @@ int proc_runtime_block(proc_instruction_t * instruction) {
 	return 0;
 }
 
-int proc_instructions_exec(proc_t * proc, proc_analysis_t * analysis) {
-	// NOTE: task local storage requires configNUM_THREAD_LOCAL_STORAGE_POINTERS > 0 in FreeRTOSConfig.h
-	int recursion_depth = (int)pvTaskGetThreadLocalStoragePointer(NULL, TASK_STORAGE_RECURSION_DEPTH_INDEX);
-	if (recursion_depth > MAX_PROC_RECURSION_DEPTH) {
-		csp_print("Error: maximum recursion depth exceeded\n");
-		return -1;
-	}
-	vTaskSetThreadLocalStoragePointer(NULL, TASK_STORAGE_RECURSION_DEPTH_INDEX, (void *)(recursion_depth + 1));
-
-	if_else_flag_t _if_else_flag = IF_ELSE_FLAG_NONE;
-	int ret = 0;
-
-	for (int i = 0; i < proc->instruction_count; i++) {
-
-		proc_instruction_t instruction = proc->instructions[i];
-
-		if (_if_else_flag == IF_ELSE_FLAG_FALSE) {  // skip instruction
-			_if_else_flag = IF_ELSE_FLAG_NONE;
-			continue;
-		} else if (_if_else_flag == IF_ELSE_FLAG_TRUE) {  // if-clause active, skip else-clause
-			_if_else_flag = IF_ELSE_FLAG_FALSE;
-		}
-
-		switch (instruction.type) {
-			case PROC_BLOCK:
-				ret = proc_runtime_block(&instruction);
-				break;
-			case PROC_IFELSE:
-				_if_else_flag = proc_runtime_ifelse(&instruction);
-				ret = (_if_else_flag <= IF_ELSE_FLAG_ERR) ? _if_else_flag : 0;
-				break;
-			case PROC_SET:
-				ret = proc_runtime_set(&instruction);
-				break;
-			case PROC_UNOP:
-				ret = proc_runtime_unop(&instruction);
-				break;
-			case PROC_BINOP:
-				ret = proc_runtime_binop(&instruction);
-				break;
-			case PROC_CALL:
-				ret = proc_runtime_call(&instruction, &analysis, &proc, &i, &_if_else_flag);
-				break;
-			case PROC_NOOP:
-				break;
-			default:
-				ret = -1;
-				break;
-		}
-
-		// Error handling - TODO: smarter way to differentiate between errors from different instructions - maybe return a struct with error code and instruction index?
-		if (ret != 0) {
-			vTaskSetThreadLocalStoragePointer(NULL, TASK_STORAGE_RECURSION_DEPTH_INDEX, (void *)(recursion_depth));
-			return ret;
-		}
-	}
-	vTaskSetThreadLocalStoragePointer(NULL, TASK_STORAGE_RECURSION_DEPTH_INDEX, (void *)(recursion_depth));
-	return ret;
+/**
+ * Wait in place for the period of a loop instruction, used when the run can't be parked on the block poller.
+ *
+ * @param ms Time to wait in milliseconds
+ */
+void proc_runtime_sleep(uint32_t ms) {
+	vTaskDelay(pdMS_TO_TICKS(ms));
 }
@@ -1,5 +1,6 @@
 #include <pthread.h>
 #include <time.h>
+#include <errno.h>
 
 #include <csp/csp.h>
 
@@ -8,49 +9,150 @@
 #include <csp_proc/proc_analyze.h>
 
 // forward declarations
-int proc_runtime_ifelse(proc_instruction_t * instruction);
-int proc_runtime_set(proc_instruction_t * instruction);
-int proc_runtime_unop(proc_instruction_t * instruction);
-int proc_runtime_binop(proc_instruction_t * instruction);
-int proc_runtime_call(proc_instruction_t * instruction, proc_analysis_t ** analysis, proc_t ** proc, int * i, if_else_flag_t * _if_else_flag);
+int proc_runtime_ifelse(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t * registers);
+int proc_prefetch_operands(proc_instruction_t * instructions, proc_instruction_state_t * states, int count, int after_ifelse);
+int proc_block_watch_operands(proc_instruction_state_t * state, proc_param_watches_t * watches);
+void proc_block_unwatch_operands(proc_param_watches_t * watches);
+int proc_block_watches_stale(proc_param_watches_t * watches);
+void proc_block_condition(proc_instruction_t * instruction, proc_instruction_t * ifelse_instruction);
+void proc_block_schedule(proc_block_t * block, proc_block_t * schedule);
+uint32_t proc_block_next_period(proc_block_t * schedule, uint32_t period_ms);
+
+// Signalled whenever a watched local parameter is set (see proc_runtime_param_watch.c)
+static pthread_mutex_t param_change_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t param_change_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int param_change_seq = 0;
+
+void proc_param_changed() {
+	pthread_mutex_lock(&param_change_mutex);
+	param_change_seq++;
+	pthread_cond_broadcast(&param_change_cond);
+	pthread_mutex_unlock(&param_change_mutex);
+}
 
-extern pthread_key_t recursion_depth_key;
+unsigned int proc_param_change_seq() {
+	pthread_mutex_lock(&param_change_mutex);
+	unsigned int seq = param_change_seq;
+	pthread_mutex_unlock(&param_change_mutex);
+	return seq;
+}
+
+/**
+ * Wait until a watched parameter has changed since `seq` was read, the deadline is reached,
+ * or PROC_BLOCK_EVENT_RECHECK_MS has passed (to catch changes made without param_set).
+ *
+ * @return 1 if a watched parameter has changed, 0 otherwise
+ */
+int proc_wait_param_change(unsigned int seq, struct timespec * deadline) {
+	struct timespec wake;
+	clock_gettime(CLOCK_REALTIME, &wake);
+	wake.tv_sec += PROC_BLOCK_EVENT_RECHECK_MS / 1000;
+	wake.tv_nsec += (PROC_BLOCK_EVENT_RECHECK_MS % 1000) * 1000000;
+	if (wake.tv_nsec >= 1000000000) {
+		wake.tv_sec++;
+		wake.tv_nsec -= 1000000000;
+	}
+	if (deadline->tv_sec < wake.tv_sec || (deadline->tv_sec == wake.tv_sec && deadline->tv_nsec < wake.tv_nsec)) {
+		wake = *deadline;
+	}
+
+	pthread_mutex_lock(&param_change_mutex);
+	while (param_change_seq == seq) {
+		if (pthread_cond_timedwait(&param_change_cond, &param_change_mutex, &wake) != 0) {
+			break;
+		}
+	}
+	int changed = (param_change_seq != seq);
+	pthread_mutex_unlock(&param_change_mutex);
+	return changed;
+}
+
+static void block_unwatch_cleanup(void * watches) {
+	proc_block_unwatch_operands(watches);
+}
 
 /**
  * Execute a block instruction.
  *
  * @param instruction The instruction to execute
+ * @param state The state of the instruction in the executing frame, holding the resolved parameter handles
  * @return int flag indicating the result of the block instruction (0 for success, -1 for error)
  */
-int proc_runtime_block(proc_instruction_t * instruction) {
+int proc_runtime_block(proc_instruction_t * instruction, proc_instruction_state_t * state) {
 	if (instruction->type != PROC_BLOCK) {
 		csp_print("Invalid instruction type, expected PROC_BLOCK\n");
 		return -1;
 	}
 
+	proc_block_t schedule;
+	proc_block_schedule(&instruction->instruction.block, &schedule);
+	uint32_t period_ms = schedule.min_period_ms;
+
 	struct timespec timeout;
 	clock_gettime(CLOCK_REALTIME, &timeout);
-	timeout.tv_sec += MAX_PROC_BLOCK_TIMEOUT_MS / 1000;
-	timeout.tv_nsec += (MAX_PROC_BLOCK_TIMEOUT_MS % 1000) * 1000000;
+	timeout.tv_sec += schedule.timeout_ms / 1000;
+	timeout.tv_nsec += (schedule.timeout_ms % 1000) * 1000000;
+	if (timeout.tv_nsec >= 1000000000) {
+		timeout.tv_sec++;
+		timeout.tv_nsec -= 1000000000;
+	}
 
 	// Create a temporary ifelse instruction from the block instruction for compatibility with proc_runtime_ifelse
 	proc_instruction_t ifelse_instruction;
-	ifelse_instruction.type = PROC_IFELSE;
-	ifelse_instruction.node = instruction->node;
-	ifelse_instruction.instruction.ifelse = instruction->instruction.block;
+	proc_block_condition(instruction, &ifelse_instruction);
 
+	int event_driven = -1;  // Unknown until the operands have been resolved by the first evaluation
+	proc_param_watches_t watches = {};
+	int ret = 0;
 	struct timespec current_time;
+
+	// The worker may be cancelled while waiting (see proc_stop_all_runtime_threads), the parameters are unwatched either way
+	pthread_cleanup_push(block_unwatch_cleanup, &watches);
 	while (clock_gettime(CLOCK_REALTIME, &current_time) == 0 && (current_time.tv_sec < timeout.tv_sec || (current_time.tv_sec == timeout.tv_sec && current_time.tv_nsec < timeout.tv_nsec))) {
-		int ifelse_result = proc_runtime_ifelse(&ifelse_instruction);
+		unsigned int change_seq = proc_param_change_seq();  // read before evaluating, so changes during evaluation aren't missed
+		if (event_driven == 1 && proc_block_watches_stale(&watches)) {
+			event_driven = -1;  // The parameters may have been replaced, watch them again once resolved
+		}
+		proc_prefetch_operands(&ifelse_instruction, state, 1, 0);
+		int ifelse_result = proc_runtime_ifelse(&ifelse_instruction, state, NULL);
 		if (ifelse_result == IF_ELSE_FLAG_ERR) {
 			csp_print("Error in if-else condition %d\n", ifelse_result);
-			return -1;
+			ret = -1;
+			break;
 		} else if (ifelse_result == IF_ELSE_FLAG_TRUE) {
 			break;
 		}
 
-		struct timespec sleep_time = {0, MIN_PROC_BLOCK_PERIOD_MS * 1000000};
-		nanosleep(&sleep_time, NULL);
+		if (event_driven == -1) {
+			// Local operands are woken by their set hook; re-evaluate once, as they may have changed before being watched
+			event_driven = proc_block_watch_operands(state, &watches);
+			if (event_driven) {
+				continue;
+			}
+		}
+
+		if (event_driven) {
+			proc_wait_param_change(change_seq, &timeout);
+		} else {
+			// Sleep until the next poll, or the timeout if that comes first
+			struct timespec wake = current_time;
+			wake.tv_sec += period_ms / 1000;
+			wake.tv_nsec += (period_ms % 1000) * 1000000;
+			if (wake.tv_nsec >= 1000000000) {
+				wake.tv_sec++;
+				wake.tv_nsec -= 1000000000;
+			}
+			if (timeout.tv_sec < wake.tv_sec || (timeout.tv_sec == wake.tv_sec && timeout.tv_nsec < wake.tv_nsec)) {
+				wake = timeout;
+			}
+			clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, NULL);
+			period_ms = proc_block_next_period(&schedule, period_ms);
+		}
+	}
+	pthread_cleanup_pop(1);
+
+	if (ret != 0) {
+		return ret;
 	}
 
 	if (clock_gettime(CLOCK_REALTIME, &current_time) == 0 && (current_time.tv_sec > timeout.tv_sec || (current_time.tv_sec == timeout.tv_sec && current_time.tv_nsec >= timeout.tv_nsec))) {
@@ -61,60 +163,14 @@ int proc_runtime_block(proc_instruction_t * instruction) {
 	return 0;
 }
 
-int proc_instructions_exec(proc_t * proc, proc_analysis_t * analysis) {
-	int recursion_depth = (int)pthread_getspecific(recursion_depth_key);
-	if (recursion_depth > MAX_PROC_RECURSION_DEPTH) {
-		csp_print("Error: maximum recursion depth exceeded\n");
-		return -1;
-	}
-	pthread_setspecific(recursion_depth_key, (void *)(recursion_depth + 1));
-
-	if_else_flag_t _if_else_flag = IF_ELSE_FLAG_NONE;
-	int ret = 0;
-
-	for (int i = 0; i < proc->instruction_count; i++) {
-
-		proc_instruction_t instruction = proc->instructions[i];
-
-		if (_if_else_flag == IF_ELSE_FLAG_FALSE) {  // skip instruction
-			_if_else_flag = IF_ELSE_FLAG_NONE;
-			continue;
-		} else if (_if_else_flag == IF_ELSE_FLAG_TRUE) {  // if-clause active, skip else-clause
-			_if_else_flag = IF_ELSE_FLAG_FALSE;
-		}
-
-		switch (instruction.type) {
-			case PROC_BLOCK:
-				ret = proc_runtime_block(&instruction);
-				break;
-			case PROC_IFELSE:
-				_if_else_flag = proc_runtime_ifelse(&instruction);
-				ret = (_if_else_flag <= IF_ELSE_FLAG_ERR) ? _if_else_flag : 0;
-				break;
-			case PROC_SET:
-				ret = proc_runtime_set(&instruction);
-				break;
-			case PROC_UNOP:
-				ret = proc_runtime_unop(&instruction);
-				break;
-			case PROC_BINOP:
-				ret = proc_runtime_binop(&instruction);
-				break;
-			case PROC_CALL:
-				ret = proc_runtime_call(&instruction, &analysis, &proc, &i, &_if_else_flag);
-				break;
-			case PROC_NOOP:
-				break;
-			default:
-				ret = -1;
-				break;
-		}
-
-		if (ret != 0) {
-			pthread_setspecific(recursion_depth_key, (void *)(recursion_depth));
-			return ret;
-		}
+/**
+ * Wait in place for the period of a loop instruction, used when the run can't be parked on the block poller.
+ *
+ * @param ms Time to wait in milliseconds
+ */
+void proc_runtime_sleep(uint32_t ms) {
+	struct timespec duration = {ms / 1000, (ms % 1000) * 1000000};
+	while (nanosleep(&duration, &duration) != 0 && errno == EINTR) {
+		// Interrupted by a signal, sleep for the remaining time
 	}
-	pthread_setspecific(recursion_depth_key, (void *)(recursion_depth));
-	return ret;
 }
@@ -3,6 +3,8 @@
 #include <param/param.h>
 #include <param/param_client.h>
 #include <param/param_string.h>
+#include <param/param_queue.h>
+#include <param/param_server.h>
 
 #include <csp_proc/proc_types.h>
 #include <csp_proc/proc_runtime.h>
@@ -17,12 +19,28 @@
 #define PARAM_ACK_ON_PUSH (1)
 #endif
 
+#ifndef PROC_PREFETCH_MAX_OPERANDS
+#define PROC_PREFETCH_MAX_OPERANDS (16)
+#endif
+
 #ifndef PROC_FLOAT_EPSILON
 #define PROC_FLOAT_EPSILON (1e-6)
 #endif
 
-// Forward declaration
-int proc_instructions_exec(proc_t * proc, proc_analysis_t * analysis);
+#define CALL_STACK_INITIAL_FRAMES (4)
+#define LOOP_STACK_INITIAL_LOOPS (2)
+
+// Read operands of an instruction, as flagged in proc_instruction_state_t.prefetched
+#define OPERAND_BIT_A (1 << 0)
+#define OPERAND_BIT_B (1 << 1)
+
+// Forward declarations
+void proc_loops_unwind(proc_continuation_t * continuation, int depth);
+int proc_list_cache_ensure(uint16_t node);
+param_t * proc_param_index_find(uint16_t node, const char * name);
+int proc_param_index_is_full();
+void proc_param_index_clear();
+void proc_param_unwatch_all();
 
 /**
  * Simplified parameter type for performing arithmetic & logical operations.
@@ -36,6 +54,9 @@ typedef union {
 	int64_t i64;
 	double d;
 	char * s;
+	uint32_t u32;
+	int32_t i32;
+	float f;
 } operand_val_t;
 
 typedef enum {
@@ -43,19 +64,53 @@ typedef enum {
 	OPERAND_TYPE_INT,
 	OPERAND_TYPE_FLOAT,
 	OPERAND_TYPE_STRING,
+	// Native-width types, for parameters of up to 32 bits (see PROC_NATIVE_WIDTH_ARITHMETIC)
+	OPERAND_TYPE_UINT32,
+	OPERAND_TYPE_INT32,
+	OPERAND_TYPE_FLOAT32,
 } operand_type_t;
 
-typedef struct {
+struct operand_t {
 	param_type_e source_type;
 	operand_type_t type;
 	operand_val_t value;
-} operand_t;
+};
 
 typedef struct {
 	operand_t operand;
 	param_t * param;
 } operand_param_pair_t;
 
+static void operand_from_uint32(operand_t * operand, uint32_t value) {
+#if PROC_NATIVE_WIDTH_ARITHMETIC
+	operand->type = OPERAND_TYPE_UINT32;
+	operand->value.u32 = value;
+#else
+	operand->type = OPERAND_TYPE_UINT;
+	operand->value.u64 = (uint64_t)value;
+#endif
+}
+
+static void operand_from_int32(operand_t * operand, int32_t value) {
+#if PROC_NATIVE_WIDTH_ARITHMETIC
+	operand->type = OPERAND_TYPE_INT32;
+	operand->value.i32 = value;
+#else
+	operand->type = OPERAND_TYPE_INT;
+	operand->value.i64 = (int64_t)value;
+#endif
+}
+
+static void operand_from_float(operand_t * operand, float value) {
+#if PROC_NATIVE_WIDTH_ARITHMETIC
+	operand->type = OPERAND_TYPE_FLOAT32;
+	operand->value.f = value;
+#else
+	operand->type = OPERAND_TYPE_FLOAT;
+	operand->value.d = value;
+#endif
+}
+
 /**
  * Parse a parameter to an operand.
  *
@@ -72,45 +127,39 @@ int parse_param_to_operand(param_t * param, operand_t * operand, int offset) {
 		case PARAM_TYPE_UINT8: {
 			uint8_t value;
 			param_get(param, offset, &value);
-			operand->type = OPERAND_TYPE_UINT;
-			operand->value.u64 = (uint64_t)value;
+			operand_from_uint32(operand, value);
 			break;
 		}
 		case PARAM_TYPE_INT8: {
 			int8_t value;
 			param_get(param, offset, &value);
-			operand->type = OPERAND_TYPE_INT;
-			operand->value.i64 = (int64_t)value;
+			operand_from_int32(operand, value);
 			break;
 		}
 		case PARAM_TYPE_XINT16:
 		case PARAM_TYPE_UINT16: {
 			uint16_t value;
 			param_get(param, offset, &value);
-			operand->type = OPERAND_TYPE_UINT;
-			operand->value.u64 = (uint64_t)value;
+			operand_from_uint32(operand, value);
 			break;
 		}
 		case PARAM_TYPE_INT16: {
 			int16_t value;
 			param_get(param, offset, &value);
-			operand->type = OPERAND_TYPE_INT;
-			operand->value.i64 = (int64_t)value;
+			operand_from_int32(operand, value);
 			break;
 		}
 		case PARAM_TYPE_XINT32:
 		case PARAM_TYPE_UINT32: {
 			uint32_t value;
 			param_get(param, offset, &value);
-			operand->type = OPERAND_TYPE_UINT;
-			operand->value.u64 = (uint64_t)value;
+			operand_from_uint32(operand, value);
 			break;
 		}
 		case PARAM_TYPE_INT32: {
 			int32_t value;
 			param_get(param, offset, &value);
-			operand->type = OPERAND_TYPE_INT;
-			operand->value.i64 = (int64_t)value;
+			operand_from_int32(operand, value);
 			break;
 		}
 		case PARAM_TYPE_XINT64:
@@ -131,8 +180,7 @@ int parse_param_to_operand(param_t * param, operand_t * operand, int offset) {
 		case PARAM_TYPE_FLOAT: {
 			float value;
 			param_get(param, offset, &value);
-			operand->type = OPERAND_TYPE_FLOAT;
-			operand->value.d = value;
+			operand_from_float(operand, value);
 			break;
 		}
 		case PARAM_TYPE_DOUBLE: {
@@ -161,617 +209,1527 @@ double float_abs(double x) {
 	return (x < 0) ? -x : x;
 }
 
-int proc_param_scan_offset(char * arg) {
-	char * arg_copy = proc_strdup(arg);
-	char * saveptr;
-	char * token;
-	int offset = -1;
+float float32_abs(float x) {
+	return (x < 0) ? -x : x;
+}
 
-	strtok_r(arg_copy, "[", &saveptr);
-	token = strtok_r(NULL, "[", &saveptr);
-	if (token != NULL) {
-		sscanf(token, "%d", &offset);
-		*token = '\0';
+/**
+ * Widen a native-width operand to the 64-bit (or double) type of its kind.
+ */
+static void operand_widen(operand_t * operand) {
+	switch (operand->type) {
+		case OPERAND_TYPE_UINT32: {
+			uint32_t value = operand->value.u32;
+			operand->type = OPERAND_TYPE_UINT;
+			operand->value.u64 = value;
+			break;
+		}
+		case OPERAND_TYPE_INT32: {
+			int32_t value = operand->value.i32;
+			operand->type = OPERAND_TYPE_INT;
+			operand->value.i64 = value;
+			break;
+		}
+		case OPERAND_TYPE_FLOAT32: {
+			float value = operand->value.f;
+			operand->type = OPERAND_TYPE_FLOAT;
+			operand->value.d = value;
+			break;
+		}
+		default:
+			break;
 	}
+}
 
-	proc_free(arg_copy);
+/**
+ * Bring two operands to the same type. Operands stay at native width if they already share a type,
+ * and are only widened when mixing widths of the same kind (e.g. uint8 and uint64, or float and double).
+ *
+ * @return 0 if the operands have the same type, -1 if they're of different kinds
+ */
+static int operand_unify(operand_t * a, operand_t * b) {
+	if (a->type != b->type) {
+		operand_widen(a);
+		operand_widen(b);
+	}
+	return (a->type == b->type) ? 0 : -1;
+}
 
-	return offset;
+static int operand_is_immediate(proc_operand_t * operand) {
+	return operand->kind == PROC_OPERAND_UINT || operand->kind == PROC_OPERAND_INT || operand->kind == PROC_OPERAND_FLOAT;
 }
 
-param_t * proc_fetch_param(char * param_name, int node) {
-	int inf_loop_guard = 0;
-	param_t * param = NULL;
+static void operand_from_immediate(proc_operand_t * immediate, operand_t * operand) {
+	switch (immediate->kind) {
+		case PROC_OPERAND_UINT:
+			operand->source_type = PARAM_TYPE_UINT64;
+			operand->type = OPERAND_TYPE_UINT;
+			operand->value.u64 = immediate->value.u;
+			break;
+		case PROC_OPERAND_INT:
+			operand->source_type = PARAM_TYPE_INT64;
+			operand->type = OPERAND_TYPE_INT;
+			operand->value.i64 = immediate->value.i;
+			break;
+		default:
+			operand->source_type = PARAM_TYPE_DOUBLE;
+			operand->type = OPERAND_TYPE_FLOAT;
+			operand->value.d = immediate->value.f;
+			break;
+	}
+}
 
-	// Check if parameter is an array element
-	char * param_name_copy = proc_strdup(param_name);
-	int offset = proc_param_scan_offset(param_name_copy);
-	if (offset != -1) {
-		int index_length = snprintf(NULL, 0, "%d", offset);
-		param_name_copy[strlen(param_name_copy) - (index_length + 2)] = '\0';
+/**
+ * Convert an integer immediate to the type of the operand it's combined with, if its value fits, so comparing or
+ * combining it with a parameter neither widens the parameter nor fails on signedness.
+ * Floating point immediates are left as is, and only combine with floating point operands.
+ */
+static void operand_match_immediate(operand_t * immediate, operand_t * other) {
+	if (immediate->type == OPERAND_TYPE_FLOAT) {
+		return;
 	}
+	int negative = (immediate->type == OPERAND_TYPE_INT && immediate->value.i64 < 0);
+	uint64_t u = immediate->value.u64;
+	int64_t i = immediate->value.i64;
+	double d = negative ? (double)i : (double)u;
 
-	csp_iface_t * ifaces = csp_iflist_get();
-	int local_addrs[10] = {-1};  // Assume max 10 local interfaces (normally only 2-3)
-	int iface_idx = 0;
-	int is_remote_param = node != 0;
-	while (ifaces && iface_idx++ < 10) {
-		local_addrs[iface_idx] = ifaces->addr;
-		ifaces = ifaces->next;
-		if (is_remote_param && local_addrs[iface_idx] == node) {
-			is_remote_param = 0;
-		}
+	switch (other->type) {
+		case OPERAND_TYPE_UINT:
+			if (!negative) {
+				immediate->type = OPERAND_TYPE_UINT;
+			}
+			break;
+		case OPERAND_TYPE_UINT32:
+			if (!negative && u <= UINT32_MAX) {
+				immediate->type = OPERAND_TYPE_UINT32;
+				immediate->value.u32 = (uint32_t)u;
+			}
+			break;
+		case OPERAND_TYPE_INT:
+			if (negative || u <= INT64_MAX) {
+				immediate->type = OPERAND_TYPE_INT;
+			}
+			break;
+		case OPERAND_TYPE_INT32:
+			if ((negative && i >= INT32_MIN) || (!negative && u <= INT32_MAX)) {
+				immediate->type = OPERAND_TYPE_INT32;
+				immediate->value.i32 = (int32_t)i;
+			}
+			break;
+		case OPERAND_TYPE_FLOAT:
+			immediate->type = OPERAND_TYPE_FLOAT;
+			immediate->value.d = d;
+			break;
+		case OPERAND_TYPE_FLOAT32:
+			immediate->type = OPERAND_TYPE_FLOAT32;
+			immediate->value.f = (float)d;
+			break;
+		default:
+			break;
 	}
+}
 
-	if (is_remote_param) {  // TODO: Don't download list every time
-		int remote_params = param_list_download(node, PARAM_REMOTE_TIMEOUT_MS, 2, 1);
-		if (remote_params < 0) {
-			proc_free(param_name_copy);
-			return NULL;
-		}
+/**
+ * Bring the operands of a comparison or binary operation to the same type, matching immediates to the other operand.
+ *
+ * @return 0 if the operands have the same type, -1 if they're of different kinds
+ */
+static int operand_unify_operands(proc_operand_t * operand_a, operand_t * a, proc_operand_t * operand_b, operand_t * b) {
+	if (operand_is_immediate(operand_a)) {
+		operand_match_immediate(a, b);
+	} else if (operand_is_immediate(operand_b)) {
+		operand_match_immediate(b, a);
 	}
+	return operand_unify(a, b);
+}
 
-	param_list_iterator i = {};
-	while ((param = param_list_iterate(&i)) != NULL && (inf_loop_guard++ < 10000)) {
-		int strmatch_ret = strmatch(param->name, param_name_copy, strlen(param->name), strlen(param_name_copy));
+/**
+ * Type-specialised kernels (proc_kernel_t), bound to an instruction by operation and operand type (see proc_bind_kernel).
+ * Both operands of a kernel have the type it was selected for.
+ */
 
-		if (strmatch_ret == 0) {
-			continue;
-		}
+#define COMPARE_KERNELS(type, field)                                                                      \
+	static int eq_##type(operand_t * a, operand_t * b) { return a->value.field == b->value.field; } \
+	static int neq_##type(operand_t * a, operand_t * b) { return a->value.field != b->value.field; } \
+	static int lt_##type(operand_t * a, operand_t * b) { return a->value.field < b->value.field; }   \
+	static int gt_##type(operand_t * a, operand_t * b) { return a->value.field > b->value.field; }   \
+	static int le_##type(operand_t * a, operand_t * b) { return a->value.field <= b->value.field; } \
+	static int ge_##type(operand_t * a, operand_t * b) { return a->value.field >= b->value.field; }
 
-		if (param->node != node) {
-			for (int i = 0; i < 10; i++) {
-				if (node == local_addrs[i] && param->node == 0) {
-					proc_free(param_name_copy);
-					return param;
-				}
-			}
-			continue;
-		}
+#define ARITHMETIC_KERNEL(name, type, field, operator) \
+	static int name##_##type(operand_t * a, operand_t * b) {     \
+		a->value.field = a->value.field operator b->value.field;          \
+		return 0;                                            \
+	}
 
-		if (param->node == 0) {
-			break;
-		}
+#define DIVISION_KERNEL(name, type, field, operator)        \
+	static int name##_##type(operand_t * a, operand_t * b) { \
+		if (b->value.field == 0) {                       \
+			csp_print("Error: Division by zero\n");      \
+			return -1;                                   \
+		}                                                \
+		a->value.field = a->value.field operator b->value.field;      \
+		return 0;                                        \
+	}
 
-		if (param_pull_single(param, offset, CSP_PRIO_NORM, 0, node, PARAM_REMOTE_TIMEOUT_MS, 2) < 0) {
-			proc_free(param_name_copy);
-			return NULL;
-		}
+COMPARE_KERNELS(uint, u64)
+COMPARE_KERNELS(int, i64)
 
-		break;
-	}
+static int eq_float(operand_t * a, operand_t * b) { return float_abs(a->value.d - b->value.d) < PROC_FLOAT_EPSILON; }
+static int neq_float(operand_t * a, operand_t * b) { return float_abs(a->value.d - b->value.d) >= PROC_FLOAT_EPSILON; }
+static int lt_float(operand_t * a, operand_t * b) { return a->value.d < b->value.d; }
+static int gt_float(operand_t * a, operand_t * b) { return a->value.d > b->value.d; }
+static int le_float(operand_t * a, operand_t * b) { return a->value.d < b->value.d || eq_float(a, b); }
+static int ge_float(operand_t * a, operand_t * b) { return a->value.d > b->value.d || eq_float(a, b); }
 
-	proc_free(param_name_copy);
-	return param;
-}
+static int eq_string(operand_t * a, operand_t * b) { return strcmp(a->value.s, b->value.s) == 0; }
+static int neq_string(operand_t * a, operand_t * b) { return strcmp(a->value.s, b->value.s) != 0; }
+static int lt_string(operand_t * a, operand_t * b) { return strcmp(a->value.s, b->value.s) < 0; }
+static int gt_string(operand_t * a, operand_t * b) { return strcmp(a->value.s, b->value.s) > 0; }
+static int le_string(operand_t * a, operand_t * b) { return strcmp(a->value.s, b->value.s) <= 0; }
+static int ge_string(operand_t * a, operand_t * b) { return strcmp(a->value.s, b->value.s) >= 0; }
 
-int fetch_operand_param_pair(char * param_name, operand_param_pair_t * pair, int node) {
-	int offset = proc_param_scan_offset(param_name);
+ARITHMETIC_KERNEL(add, uint, u64, +)
+ARITHMETIC_KERNEL(sub, uint, u64, -)
+ARITHMETIC_KERNEL(mul, uint, u64, *)
+DIVISION_KERNEL(div, uint, u64, /)
+DIVISION_KERNEL(mod, uint, u64, %)
+ARITHMETIC_KERNEL(lsh, uint, u64, <<)
+ARITHMETIC_KERNEL(rsh, uint, u64, >>)
+ARITHMETIC_KERNEL(and, uint, u64, &)
+ARITHMETIC_KERNEL(or, uint, u64, |)
+ARITHMETIC_KERNEL(xor, uint, u64, ^)
 
-	pair->param = proc_fetch_param(param_name, node);
-	if (pair->param == NULL) {
-		csp_print("Failed to fetch %s\n", param_name);
+ARITHMETIC_KERNEL(add, int, i64, +)
+ARITHMETIC_KERNEL(sub, int, i64, -)
+ARITHMETIC_KERNEL(mul, int, i64, *)
+DIVISION_KERNEL(div, int, i64, /)
+DIVISION_KERNEL(mod, int, i64, %)
+ARITHMETIC_KERNEL(lsh, int, i64, <<)
+ARITHMETIC_KERNEL(rsh, int, i64, >>)
+ARITHMETIC_KERNEL(and, int, i64, &)
+ARITHMETIC_KERNEL(or, int, i64, |)
+ARITHMETIC_KERNEL(xor, int, i64, ^)
+
+ARITHMETIC_KERNEL(add, float, d, +)
+ARITHMETIC_KERNEL(sub, float, d, -)
+ARITHMETIC_KERNEL(mul, float, d, *)
+DIVISION_KERNEL(div, float, d, /)
+
+// Native-width kernels. Signed results wrap around like the truncated 64-bit results would, and shifts past the
+// width give the same result as shifting the widened operand
+COMPARE_KERNELS(uint32, u32)
+COMPARE_KERNELS(int32, i32)
+
+static int eq_float32(operand_t * a, operand_t * b) { return float32_abs(a->value.f - b->value.f) < (float)PROC_FLOAT_EPSILON; }
+static int neq_float32(operand_t * a, operand_t * b) { return float32_abs(a->value.f - b->value.f) >= (float)PROC_FLOAT_EPSILON; }
+static int lt_float32(operand_t * a, operand_t * b) { return a->value.f < b->value.f; }
+static int gt_float32(operand_t * a, operand_t * b) { return a->value.f > b->value.f; }
+static int le_float32(operand_t * a, operand_t * b) { return a->value.f < b->value.f || eq_float32(a, b); }
+static int ge_float32(operand_t * a, operand_t * b) { return a->value.f > b->value.f || eq_float32(a, b); }
+
+ARITHMETIC_KERNEL(add, uint32, u32, +)
+ARITHMETIC_KERNEL(sub, uint32, u32, -)
+ARITHMETIC_KERNEL(mul, uint32, u32, *)
+DIVISION_KERNEL(div, uint32, u32, /)
+DIVISION_KERNEL(mod, uint32, u32, %)
+ARITHMETIC_KERNEL(and, uint32, u32, &)
+ARITHMETIC_KERNEL(or, uint32, u32, |)
+ARITHMETIC_KERNEL(xor, uint32, u32, ^)
+static int lsh_uint32(operand_t * a, operand_t * b) { a->value.u32 = (b->value.u32 < 32) ? a->value.u32 << b->value.u32 : 0; return 0; }
+static int rsh_uint32(operand_t * a, operand_t * b) { a->value.u32 = (b->value.u32 < 32) ? a->value.u32 >> b->value.u32 : 0; return 0; }
+
+static int add_int32(operand_t * a, operand_t * b) { a->value.i32 = (int32_t)((uint32_t)a->value.i32 + (uint32_t)b->value.i32); return 0; }
+static int sub_int32(operand_t * a, operand_t * b) { a->value.i32 = (int32_t)((uint32_t)a->value.i32 - (uint32_t)b->value.i32); return 0; }
+static int mul_int32(operand_t * a, operand_t * b) { a->value.i32 = (int32_t)((uint32_t)a->value.i32 * (uint32_t)b->value.i32); return 0; }
+static int div_int32(operand_t * a, operand_t * b) {
+	if (b->value.i32 == 0) {
+		csp_print("Error: Division by zero\n");
 		return -1;
 	}
-	if (parse_param_to_operand(pair->param, &pair->operand, offset) != 0) {
-		csp_print("Failed to parse %s\n", param_name);
+	a->value.i32 = (b->value.i32 == -1) ? (int32_t)(0U - (uint32_t)a->value.i32) : a->value.i32 / b->value.i32;
+	return 0;
+}
+static int mod_int32(operand_t * a, operand_t * b) {
+	if (b->value.i32 == 0) {
+		csp_print("Error: Division by zero\n");
 		return -1;
 	}
+	a->value.i32 = (b->value.i32 == -1) ? 0 : a->value.i32 % b->value.i32;
 	return 0;
 }
+ARITHMETIC_KERNEL(and, int32, i32, &)
+ARITHMETIC_KERNEL(or, int32, i32, |)
+ARITHMETIC_KERNEL(xor, int32, i32, ^)
+static int lsh_int32(operand_t * a, operand_t * b) { a->value.i32 = ((uint32_t)b->value.i32 < 32) ? (int32_t)((uint32_t)a->value.i32 << b->value.i32) : 0; return 0; }
+static int rsh_int32(operand_t * a, operand_t * b) { a->value.i32 = ((uint32_t)b->value.i32 < 32) ? a->value.i32 >> b->value.i32 : ((a->value.i32 < 0) ? -1 : 0); return 0; }
 
-int operand_to_valuebuf(operand_t * operand, char * valuebuf) {
-	switch (operand->source_type) {
+ARITHMETIC_KERNEL(add, float32, f, +)
+ARITHMETIC_KERNEL(sub, float32, f, -)
+ARITHMETIC_KERNEL(mul, float32, f, *)
+DIVISION_KERNEL(div, float32, f, /)
+
+// Unary kernels ignore operand b
+static int inc_uint(operand_t * a, operand_t * b) { a->value.u64++; return 0; }
+static int dec_uint(operand_t * a, operand_t * b) { a->value.u64--; return 0; }
+static int not_uint(operand_t * a, operand_t * b) { a->value.u64 = ~a->value.u64; return 0; }
+static int inc_int(operand_t * a, operand_t * b) { a->value.i64++; return 0; }
+static int dec_int(operand_t * a, operand_t * b) { a->value.i64--; return 0; }
+static int not_int(operand_t * a, operand_t * b) { a->value.i64 = ~a->value.i64; return 0; }
+static int neg_int(operand_t * a, operand_t * b) { a->value.i64 = -a->value.i64; return 0; }
+static int inc_float(operand_t * a, operand_t * b) { a->value.d += 1.0; return 0; }
+static int dec_float(operand_t * a, operand_t * b) { a->value.d -= 1.0; return 0; }
+static int neg_float(operand_t * a, operand_t * b) { a->value.d = -a->value.d; return 0; }
+static int inc_uint32(operand_t * a, operand_t * b) { a->value.u32++; return 0; }
+static int dec_uint32(operand_t * a, operand_t * b) { a->value.u32--; return 0; }
+static int not_uint32(operand_t * a, operand_t * b) { a->value.u32 = ~a->value.u32; return 0; }
+static int inc_int32(operand_t * a, operand_t * b) { a->value.i32 = (int32_t)((uint32_t)a->value.i32 + 1U); return 0; }
+static int dec_int32(operand_t * a, operand_t * b) { a->value.i32 = (int32_t)((uint32_t)a->value.i32 - 1U); return 0; }
+static int not_int32(operand_t * a, operand_t * b) { a->value.i32 = ~a->value.i32; return 0; }
+static int neg_int32(operand_t * a, operand_t * b) { a->value.i32 = (int32_t)(0U - (uint32_t)a->value.i32); return 0; }
+static int inc_float32(operand_t * a, operand_t * b) { a->value.f += 1.0f; return 0; }
+static int dec_float32(operand_t * a, operand_t * b) { a->value.f -= 1.0f; return 0; }
+static int neg_float32(operand_t * a, operand_t * b) { a->value.f = -a->value.f; return 0; }
+static int identity(operand_t * a, operand_t * b) { return 0; }
+
+// Kernel tables, indexed by operand_type_t: uint, int, float, string, uint32, int32, float32.
+// NULL where the operation isn't defined for the type
+static const proc_kernel_t compare_kernels[][7] = {
+	[OP_EQ] = {eq_uint, eq_int, eq_float, eq_string, eq_uint32, eq_int32, eq_float32},
+	[OP_NEQ] = {neq_uint, neq_int, neq_float, neq_string, neq_uint32, neq_int32, neq_float32},
+	[OP_LT] = {lt_uint, lt_int, lt_float, lt_string, lt_uint32, lt_int32, lt_float32},
+	[OP_GT] = {gt_uint, gt_int, gt_float, gt_string, gt_uint32, gt_int32, gt_float32},
+	[OP_LE] = {le_uint, le_int, le_float, le_string, le_uint32, le_int32, le_float32},
+	[OP_GE] = {ge_uint, ge_int, ge_float, ge_string, ge_uint32, ge_int32, ge_float32},
+};
+
+static const proc_kernel_t binop_kernels[][7] = {
+	[OP_ADD] = {add_uint, add_int, add_float, NULL, add_uint32, add_int32, add_float32},
+	[OP_SUB] = {sub_uint, sub_int, sub_float, NULL, sub_uint32, sub_int32, sub_float32},
+	[OP_MUL] = {mul_uint, mul_int, mul_float, NULL, mul_uint32, mul_int32, mul_float32},
+	[OP_DIV] = {div_uint, div_int, div_float, NULL, div_uint32, div_int32, div_float32},
+	[OP_MOD] = {mod_uint, mod_int, NULL, NULL, mod_uint32, mod_int32, NULL},
+	[OP_LSH] = {lsh_uint, lsh_int, NULL, NULL, lsh_uint32, lsh_int32, NULL},
+	[OP_RSH] = {rsh_uint, rsh_int, NULL, NULL, rsh_uint32, rsh_int32, NULL},
+	[OP_AND] = {and_uint, and_int, NULL, NULL, and_uint32, and_int32, NULL},
+	[OP_OR] = {or_uint, or_int, NULL, NULL, or_uint32, or_int32, NULL},
+	[OP_XOR] = {xor_uint, xor_int, NULL, NULL, xor_uint32, xor_int32, NULL},
+};
+
+static const proc_kernel_t unop_kernels[][7] = {
+	[OP_INC] = {inc_uint, inc_int, inc_float, NULL, inc_uint32, inc_int32, inc_float32},
+	[OP_DEC] = {dec_uint, dec_int, dec_float, NULL, dec_uint32, dec_int32, dec_float32},
+	[OP_NOT] = {not_uint, not_int, NULL, NULL, not_uint32, not_int32, NULL},
+	[OP_NEG] = {NULL, neg_int, neg_float, NULL, NULL, neg_int32, neg_float32},
+	[OP_IDT] = {identity, identity, identity, identity, identity, identity, identity},
+	[OP_RMT] = {identity, identity, identity, identity, identity, identity, identity},
+};
+
+/**
+ * Select the kernel of an operation for an operand type.
+ *
+ * @return The kernel, or NULL if the operation isn't defined for the type
+ */
+static proc_kernel_t proc_select_kernel(proc_instruction_type_t instruction_type, int op, int operand_type) {
+	if (operand_type < OPERAND_TYPE_UINT || operand_type > OPERAND_TYPE_FLOAT32) {
+		return NULL;
+	}
+
+	switch (instruction_type) {
+		case PROC_BLOCK:
+		case PROC_IFELSE:
+		case PROC_IF:
+			return (op >= 0 && op < sizeof(compare_kernels) / sizeof(compare_kernels[0])) ? compare_kernels[op][operand_type] : NULL;
+		case PROC_BINOP:
+			return (op >= 0 && op < sizeof(binop_kernels) / sizeof(binop_kernels[0])) ? binop_kernels[op][operand_type] : NULL;
+		case PROC_UNOP:
+			return (op >= 0 && op < sizeof(unop_kernels) / sizeof(unop_kernels[0])) ? unop_kernels[op][operand_type] : NULL;
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * Get the kernel bound to an instruction in the executing frame, binding it first if the instruction hasn't
+ * executed yet or its operands changed type (e.g. because a parameter was replaced).
+ *
+ * @return The kernel, or NULL if the operation isn't defined for the operand type
+ */
+static proc_kernel_t proc_bind_kernel(proc_instruction_state_t * state, proc_instruction_type_t instruction_type, int op, operand_type_t operand_type) {
+	if (state->kernel == NULL || state->kernel_type != operand_type) {
+		state->kernel = proc_select_kernel(instruction_type, op, operand_type);
+		state->kernel_type = operand_type;
+	}
+	return state->kernel;
+}
+
+/**
+ * Get the operand type a parameter type is parsed to (see parse_param_to_operand).
+ *
+ * @return The operand type, or -1 if the parameter type isn't supported
+ */
+static int param_operand_type(param_type_e param_type) {
+	switch (param_type) {
 		case PARAM_TYPE_UINT8:
 		case PARAM_TYPE_XINT8:
-			*(uint8_t *)valuebuf = (uint8_t)operand->value.u64;
-			break;
 		case PARAM_TYPE_UINT16:
 		case PARAM_TYPE_XINT16:
-			*(uint16_t *)valuebuf = (uint16_t)operand->value.u64;
-			break;
 		case PARAM_TYPE_UINT32:
 		case PARAM_TYPE_XINT32:
-			*(uint32_t *)valuebuf = (uint32_t)operand->value.u64;
-			break;
 		case PARAM_TYPE_UINT64:
 		case PARAM_TYPE_XINT64:
-			*(uint64_t *)valuebuf = operand->value.u64;
-			break;
+			return OPERAND_TYPE_UINT;
 		case PARAM_TYPE_INT8:
-			*(int8_t *)valuebuf = (int8_t)operand->value.i64;
-			break;
 		case PARAM_TYPE_INT16:
-			*(int16_t *)valuebuf = (int16_t)operand->value.i64;
-			break;
 		case PARAM_TYPE_INT32:
-			*(int32_t *)valuebuf = (int32_t)operand->value.i64;
-			break;
 		case PARAM_TYPE_INT64:
-			*(int64_t *)valuebuf = operand->value.i64;
-			break;
+			return OPERAND_TYPE_INT;
 		case PARAM_TYPE_FLOAT:
-			*(float *)valuebuf = (float)operand->value.d;
-			break;
 		case PARAM_TYPE_DOUBLE:
-			*(double *)valuebuf = operand->value.d;
-			break;
+			return OPERAND_TYPE_FLOAT;
 		case PARAM_TYPE_STRING:
-			strcpy(valuebuf, operand->value.s);
-			break;
+			return OPERAND_TYPE_STRING;
 		default:
-			csp_print("Invalid or unsupported parameter type\n");
 			return -1;
 	}
-	return 0;
 }
 
-char * proc_value_str_to_valuebuf(param_t * param, char * valuebuf, char * value_str) {
-	if (param_str_to_value(param->type, value_str, valuebuf) < 0) {
-		csp_print("invalid parameter value\n");
-		return -1;
-	}
-	return 0;
+/**
+ * Generation of the parameter list as seen by resolved handles.
+ * Bumped by proc_runtime_invalidate_params, and by the list cache when remote lists change, to force re-resolution of all handles.
+ * Only accessed atomically (see proc_param_list_changed), as any thread may bump it.
+ */
+unsigned int proc_param_list_generation = 1;
+
+/**
+ * Bump the parameter list generation, so all handles are resolved again on their next use.
+ */
+void proc_param_list_changed() {
+	__atomic_add_fetch(&proc_param_list_generation, 1, __ATOMIC_SEQ_CST);
 }
 
-int proc_set_param(char * param_name, operand_t * operand, char * value_str, int node) {
-	param_t * param = NULL;
+static unsigned int proc_param_list_current() {
+	return __atomic_load_n(&proc_param_list_generation, __ATOMIC_SEQ_CST);
+}
 
-	if (operand == NULL && value_str == NULL) {
-		csp_print("No value provided\n");
-		return -1;
-	}
+void proc_runtime_invalidate_params() {
+	proc_param_index_clear();
+	proc_param_unwatch_all();
+	proc_param_list_changed();
+}
 
-	param = proc_fetch_param(param_name, node);
-	if (param == NULL) {
-		// TODO: add ability to add new parameters?
-		csp_print("Failed to fetch %s\n", param_name);
-		return -1;
+/**
+ * Check whether a node address refers to this node, i.e. node 0 or one of the local interface addresses.
+ */
+int proc_node_is_local(int node) {
+	if (node == 0) {
+		return 1;
 	}
 
-	if (param->mask & PM_READONLY) {
-		csp_print("%s is read-only\n", param->name);
-		return -1;
+	csp_iface_t * ifaces = csp_iflist_get();
+	int iface_idx = 0;
+	while (ifaces && iface_idx++ < 10) {  // Assume max 10 local interfaces (normally only 2-3)
+		if (ifaces->addr == node) {
+			return 1;
+		}
+		ifaces = ifaces->next;
 	}
+	return 0;
+}
 
-	char valuebuf[128] __attribute__((aligned(16))) = {};
-	int ret = (value_str != NULL) ? proc_value_str_to_valuebuf(param, valuebuf, value_str) : operand_to_valuebuf(operand, valuebuf);
-	if (ret != 0) {
-		return ret;
+/**
+ * Find a parameter in the libparam list by node and name (without array index).
+ * Uses the hash index, and only walks the list for wildcard names or when the index has overflowed.
+ */
+static param_t * proc_find_param(int lookup_node, char * param_name) {
+	param_t * param = proc_param_index_find(lookup_node, param_name);
+	if (param != NULL || (strchr(param_name, '*') == NULL && !proc_param_index_is_full())) {
+		return param;
 	}
 
-	int offset = proc_param_scan_offset(param_name);
-
-	if (param->node == 0) {  // Local parameter
-		if (offset < 0) {
-			for (int i = 0; i < param->array_size; i++) {
-				param_set(param, i, valuebuf);
-			}
-		} else {
-			param_set(param, offset, valuebuf);
-		}
-	} else {  // Remote parameter
-		csp_timestamp_t time_now;
-		csp_clock_get_time(&time_now);
-		*param->timestamp = 0;
-		if (param_push_single(param, offset, valuebuf, 0, node, PARAM_REMOTE_TIMEOUT_MS, 2, PARAM_ACK_ON_PUSH) < 0 && PARAM_ACK_ON_PUSH) {
-			csp_print("No response\n");
-			return -1;
+	int inf_loop_guard = 0;
+	param_list_iterator i = {};
+	while ((param = param_list_iterate(&i)) != NULL && (inf_loop_guard++ < 10000)) {
+		if (param->node == lookup_node && strmatch(param->name, param_name, strlen(param->name), strlen(param_name))) {
+			return param;
 		}
 	}
-
-	return 0;
+	return NULL;
 }
 
 /**
- * Execute an if-else instruction.
+ * Resolve a parameter operand to a libparam handle by looking up the parameter.
+ * This is the slow path - it should only run the first time an operand is used or after the handle was invalidated.
  *
- * @param instruction The instruction to execute
- * @return if_else_flag_t flag indicating the result of the if-else instruction (true, false, error)
+ * @param operand The parameter operand
+ * @param node The node the parameter is located on
+ * @param handle The handle to populate
+ * @return 0 on success, -1 on failure
  */
-int proc_runtime_ifelse(proc_instruction_t * instruction) {
-	if (instruction->type != PROC_IFELSE) {
-		csp_print("Invalid instruction type, expected PROC_IFELSE\n");
-		return IF_ELSE_FLAG_ERR;
-	}
+int proc_resolve_param(proc_operand_t * operand, int node, proc_param_handle_t * handle) {
+	param_t * param = NULL;
 
-	param_t * param_a = proc_fetch_param(instruction->instruction.ifelse.param_a, instruction->node);
-	param_t * param_b = proc_fetch_param(instruction->instruction.ifelse.param_b, instruction->node);
+	int lookup_node = proc_node_is_local(node) ? 0 : node;
 
-	if (param_a == NULL || param_b == NULL || param_a->type == PARAM_TYPE_INVALID || param_b->type == PARAM_TYPE_DATA) {
-		csp_print("Failed to fetch params or invalid param type\n");
-		return IF_ELSE_FLAG_ERR;
+	if (lookup_node != 0 && proc_list_cache_ensure(lookup_node) != 0) {
+		return -1;
 	}
 
-	operand_param_pair_t op_par_pair_a, op_par_pair_b;
-	if (fetch_operand_param_pair(instruction->instruction.ifelse.param_a, &op_par_pair_a, instruction->node) != 0) {
-		csp_print("Failed to fetch operand A\n");
-		return IF_ELSE_FLAG_ERR;
-	}
-	if (fetch_operand_param_pair(instruction->instruction.ifelse.param_b, &op_par_pair_b, instruction->node) != 0) {
-		csp_print("Failed to fetch operand B\n");
-		return IF_ELSE_FLAG_ERR;
-	}
+	int found = 0;
+	unsigned int generation = 0;
+	for (int attempt = 0; attempt < 2; attempt++) {
+		generation = proc_param_list_current();  // Read before the lookup, so a list replaced meanwhile invalidates the handle
+		param = proc_find_param(lookup_node, operand->name);
+		found = (param != NULL);
 
-	switch (op_par_pair_a.operand.type) {
-		case OPERAND_TYPE_UINT: {
-			if (op_par_pair_b.operand.type != OPERAND_TYPE_UINT) {
-				return IF_ELSE_FLAG_ERR_TYPE;
-			}
-			uint64_t value_a = op_par_pair_a.operand.value.u64;
-			uint64_t value_b = op_par_pair_b.operand.value.u64;
-			switch (instruction->instruction.ifelse.op) {
-				case OP_EQ:
-					return (value_a == value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_NEQ:
-					return (value_a != value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LT:
-					return (value_a < value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GT:
-					return (value_a > value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LE:
-					return (value_a <= value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GE:
-					return (value_a >= value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-			}
-			break;
-		}
-		case OPERAND_TYPE_INT: {
-			if (op_par_pair_b.operand.type != OPERAND_TYPE_INT) {
-				return IF_ELSE_FLAG_ERR_TYPE;
-			}
-			int64_t value_a = op_par_pair_a.operand.value.i64;
-			int64_t value_b = op_par_pair_b.operand.value.i64;
-			switch (instruction->instruction.ifelse.op) {
-				case OP_EQ:
-					return (value_a == value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_NEQ:
-					return (value_a != value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LT:
-					return (value_a < value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GT:
-					return (value_a > value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LE:
-					return (value_a <= value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GE:
-					return (value_a >= value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-			}
-			break;
-		}
-		case OPERAND_TYPE_FLOAT: {
-			if (op_par_pair_b.operand.type != OPERAND_TYPE_FLOAT) {
-				return IF_ELSE_FLAG_ERR_TYPE;
-			}
-			double value_a = op_par_pair_a.operand.value.d;
-			double value_b = op_par_pair_b.operand.value.d;
-			switch (instruction->instruction.ifelse.op) {
-				case OP_EQ:
-					return (float_abs(value_a - value_b) < PROC_FLOAT_EPSILON) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_NEQ:
-					return (float_abs(value_a - value_b) >= PROC_FLOAT_EPSILON) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LT:
-					return (value_a < value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GT:
-					return (value_a > value_b) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LE:
-					return (value_a < value_b || float_abs(value_a - value_b) < PROC_FLOAT_EPSILON) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GE:
-					return (value_a > value_b || float_abs(value_a - value_b) < PROC_FLOAT_EPSILON) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-			}
+		// Refreshing invalidates all handles, so it's done at most once per handle until the list changes otherwise
+		if (found || lookup_node == 0 || attempt > 0 || handle->refreshed == generation) {
 			break;
 		}
-		case OPERAND_TYPE_STRING: {
-			if (param_b->type != OPERAND_TYPE_STRING) {
-				return IF_ELSE_FLAG_ERR_TYPE;
-			}
-			char * value_a = (char *)(param_a->addr);
-			char * value_b = (char *)(param_b->addr);
-			int cmp = strcmp(value_a, value_b);
-			switch (instruction->instruction.ifelse.op) {
-				case OP_EQ:
-					return (cmp == 0) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_NEQ:
-					return (cmp != 0) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LT:
-					return (cmp < 0) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GT:
-					return (cmp > 0) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_LE:
-					return (cmp <= 0) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-				case OP_GE:
-					return (cmp >= 0) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
-			}
+
+		// The cached list may predate the parameter, refresh it once before giving up
+		proc_runtime_flush_list_cache(lookup_node);
+		int ret = proc_list_cache_ensure(lookup_node);
+		handle->refreshed = proc_param_list_current();
+		if (ret != 0) {
 			break;
 		}
-		default:
-			csp_print("Invalid or unsupported operand type %d\n", op_par_pair_a.operand.type);
-			break;
 	}
-	return IF_ELSE_FLAG_ERR;
-}
 
-int proc_runtime_set(proc_instruction_t * instruction) {
-	if (instruction->type != PROC_SET) {
-		csp_print("Invalid instruction type, expected PROC_SET\n");
+	if (!found) {
 		return -1;
 	}
 
-	return proc_set_param(instruction->instruction.set.param,
-						  NULL,
-						  instruction->instruction.set.value,
-						  instruction->node);
+	handle->param = param;
+	handle->offset = operand->offset;
+	handle->node = lookup_node;
+	handle->generation = generation;
+	return 0;
 }
 
-int proc_runtime_unop(proc_instruction_t * instruction) {
-	if (instruction->type != PROC_UNOP) {
-		csp_print("Invalid instruction type, expected PROC_UNOP\n");
-		return -1;
+/**
+ * Get the parameter of a handle, resolving it first if it hasn't been resolved yet or has been invalidated.
+ *
+ * @return The resolved parameter or NULL on failure
+ */
+param_t * proc_resolve_handle(proc_operand_t * operand, int node, proc_param_handle_t * handle) {
+	if (operand->kind != PROC_OPERAND_PARAM) {
+		return NULL;
 	}
+	if (handle->param == NULL || handle->generation != proc_param_list_current()) {
+		if (proc_resolve_param(operand, node, handle) != 0) {
+			handle->param = NULL;
+			return NULL;
+		}
+	}
+	return handle->param;
+}
 
-	int fetch_node, result_node;
-	if (instruction->instruction.unop.op == OP_RMT) {
-		fetch_node = 0;
-		result_node = instruction->node;
-	} else {
-		fetch_node = instruction->node;
-		result_node = 0;
+/**
+ * Fetch the current value of a parameter, i.e. resolve its handle and pull the value if it's remote.
+ *
+ * @param state State of the instruction reading the parameter, counting its round trips
+ * @param operand_bit Bit of the operand in state->prefetched
+ * @return The parameter or NULL on failure
+ */
+param_t * proc_fetch_param(proc_operand_t * operand, int node, proc_param_handle_t * handle, proc_instruction_state_t * state, uint8_t operand_bit) {
+	param_t * param = proc_resolve_handle(operand, node, handle);
+	if (param == NULL) {
+		return NULL;
 	}
 
-	operand_param_pair_t op_par_pair;
-	if (fetch_operand_param_pair(instruction->instruction.unop.param, &op_par_pair, fetch_node) != 0) {
-		csp_print("Failed to fetch operand\n");
+	if (state->prefetched & operand_bit) {  // Already pulled together with other operands
+		state->prefetched &= ~operand_bit;
+	} else if (handle->node != 0) {
+		state->round_trips++;
+		if (param_pull_single(param, handle->offset, CSP_PRIO_NORM, 0, handle->node, PARAM_REMOTE_TIMEOUT_MS, 2) < 0) {
+			return NULL;
+		}
+	}
+
+	return param;
+}
+
+/**
+ * Read a scratch register of the executing frame.
+ *
+ * @param registers The registers of the frame, NULL if none has been written yet
+ * @return 0 on success, -1 if the register hasn't been written in the frame
+ */
+static int proc_read_register(proc_operand_t * register_operand, proc_register_t * registers, operand_t * operand) {
+	proc_register_t * reg = (registers != NULL) ? &registers[register_operand->value.u] : NULL;
+	if (reg == NULL || !reg->written) {
+		csp_print("Register r%u read before it was written\n", (unsigned int)register_operand->value.u);
 		return -1;
 	}
+	operand->source_type = reg->source_type;
+	operand->type = (operand_type_t)reg->type;
+	operand->value.u64 = reg->value.u64;  // Copies the value of any type
+	return 0;
+}
 
-	switch (instruction->instruction.unop.op) {
-		case OP_INC:
-		case OP_DEC:
-			if (op_par_pair.operand.type == OPERAND_TYPE_FLOAT) {
-				op_par_pair.operand.value.d = (instruction->instruction.unop.op == OP_INC) ? op_par_pair.operand.value.d + 1.0 : op_par_pair.operand.value.d - 1.0;
-			} else if (op_par_pair.operand.type == OPERAND_TYPE_INT) {
-				op_par_pair.operand.value.i64 = (instruction->instruction.unop.op == OP_INC) ? op_par_pair.operand.value.i64 + 1 : op_par_pair.operand.value.i64 - 1;
-			} else if (op_par_pair.operand.type == OPERAND_TYPE_UINT) {
-				op_par_pair.operand.value.u64 = (instruction->instruction.unop.op == OP_INC) ? op_par_pair.operand.value.u64 + 1 : op_par_pair.operand.value.u64 - 1;
-			} else {
-				csp_print("Error: Cannot increment or decrement type (%d)\n", op_par_pair.operand.type);
-				return -1;
+/**
+ * Write a scratch register of the executing frame, allocating the registers of the frame on the first write.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int proc_write_register(proc_operand_t * register_operand, proc_register_t ** registers, operand_t * operand) {
+	if (operand->type == OPERAND_TYPE_STRING) {
+		csp_print("Strings can't be stored in registers\n");
+		return -1;
+	}
+	if (*registers == NULL) {
+		*registers = proc_calloc(PROC_REGISTER_COUNT, sizeof(proc_register_t));
+		if (*registers == NULL) {
+			csp_print("Error allocating memory for registers\n");
+			return -1;
+		}
+	}
+	proc_register_t * reg = &(*registers)[register_operand->value.u];
+	reg->source_type = operand->source_type;
+	reg->type = (uint8_t)operand->type;
+	reg->written = 1;
+	reg->value.u64 = operand->value.u64;
+	return 0;
+}
+
+/**
+ * Free the scratch registers and instruction states of a run: those of the executing frame and those saved by its callers.
+ */
+void proc_registers_free(proc_continuation_t * continuation) {
+	proc_free(continuation->registers);
+	continuation->registers = NULL;
+	proc_free(continuation->states);
+	continuation->states = NULL;
+	for (int i = 0; i < continuation->depth; i++) {
+		proc_free(continuation->frames[i].registers);
+		proc_free(continuation->frames[i].states);
+	}
+}
+
+/**
+ * Allocate the instruction states of the executing frame of a run, if it has none yet.
+ *
+ * @param continuation The run
+ * @param proc The procedure executing in the frame
+ * @return 0 on success, -1 if memory runs out
+ */
+int proc_states_ensure(proc_continuation_t * continuation, proc_t * proc) {
+	if (continuation->states != NULL) {
+		return 0;
+	}
+	continuation->states = proc_calloc((proc->instruction_count > 0) ? proc->instruction_count : 1, sizeof(proc_instruction_state_t));
+	if (continuation->states == NULL) {
+		csp_print("Error allocating memory for instruction states\n");
+		return -1;
+	}
+	return 0;
+}
+
+uint32_t proc_instruction_round_trips(proc_instruction_state_t * state) {
+	return state->round_trips;
+}
+
+int fetch_operand_param_pair(proc_operand_t * param_operand, operand_param_pair_t * pair, int node, proc_param_handle_t * handle, proc_instruction_state_t * state, uint8_t operand_bit, proc_register_t * registers) {
+	if (param_operand->kind != PROC_OPERAND_PARAM) {
+		pair->param = NULL;  // Immediates and registers are used without accessing any parameter
+		if (param_operand->kind == PROC_OPERAND_REGISTER) {
+			return proc_read_register(param_operand, registers, &pair->operand);
+		}
+		operand_from_immediate(param_operand, &pair->operand);
+		return 0;
+	}
+
+	pair->param = proc_fetch_param(param_operand, node, handle, state, operand_bit);
+	if (pair->param == NULL) {
+		csp_print("Failed to fetch %s\n", param_operand->name);
+		return -1;
+	}
+	if (parse_param_to_operand(pair->param, &pair->operand, handle->offset) != 0) {
+		csp_print("Failed to parse %s\n", param_operand->name);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Get the operands an instruction reads from its node, i.e. the operands that can be pulled ahead of execution,
+ * with their handles and their bits in the instruction state.
+ *
+ * @return The number of operands (0-2)
+ */
+static int proc_read_operands(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_operand_t ** operands, proc_param_handle_t ** handles, uint8_t * bits) {
+	int n = 0;
+	switch (instruction->type) {
+		case PROC_IFELSE:
+		case PROC_IF:
+			operands[0] = &instruction->instruction.ifelse.param_a;
+			operands[1] = &instruction->instruction.ifelse.param_b;
+			handles[0] = &state->handles.ifelse.param_a;
+			handles[1] = &state->handles.ifelse.param_b;
+			bits[0] = OPERAND_BIT_A;
+			bits[1] = OPERAND_BIT_B;
+			n = 2;
+			break;
+		case PROC_SWITCH:
+			operands[0] = &instruction->instruction.switch_.param;
+			handles[0] = &state->handles.switch_.param;
+			bits[0] = OPERAND_BIT_A;
+			n = 1;
+			break;
+		case PROC_BINOP:
+			operands[0] = &instruction->instruction.binop.param_a;
+			operands[1] = &instruction->instruction.binop.param_b;
+			handles[0] = &state->handles.binop.param_a;
+			handles[1] = &state->handles.binop.param_b;
+			bits[0] = OPERAND_BIT_A;
+			bits[1] = OPERAND_BIT_B;
+			n = 2;
+			break;
+		case PROC_UNOP:
+			if (instruction->instruction.unop.op == OP_RMT) {  // operand is local
+				return 0;
 			}
+			operands[0] = &instruction->instruction.unop.param;
+			handles[0] = &state->handles.unop.param;
+			bits[0] = OPERAND_BIT_A;
+			n = 1;
 			break;
-		case OP_NOT:
-			if (op_par_pair.operand.source_type == OPERAND_TYPE_INT) {
-				op_par_pair.operand.value.i64 = ~op_par_pair.operand.value.i64;
-			} else if (op_par_pair.operand.source_type == OPERAND_TYPE_UINT) {
-				op_par_pair.operand.value.u64 = ~op_par_pair.operand.value.u64;
-			} else {
-				csp_print("Error: Cannot perform bitwise NOT on type (%d)\n", op_par_pair.operand.type);
-				return -1;
+		default:
+			return 0;
+	}
+
+	// Immediates aren't read from any node
+	int params = 0;
+	for (int k = 0; k < n; k++) {
+		if (operands[k]->kind == PROC_OPERAND_PARAM) {
+			operands[params] = operands[k];
+			handles[params] = handles[k];
+			bits[params++] = bits[k];
+		}
+	}
+	return params;
+}
+
+/**
+ * Get the parameter an instruction writes on its node, if any.
+ */
+static param_t * proc_written_param(proc_instruction_t * instruction, proc_instruction_state_t * state) {
+	switch (instruction->type) {
+		case PROC_SET:
+			return proc_resolve_handle(&instruction->instruction.set.param, instruction->node, &state->handles.set.param);
+		case PROC_BINOP:
+			return proc_resolve_handle(&instruction->instruction.binop.result, instruction->node, &state->handles.binop.result);
+		case PROC_UNOP:
+			if (instruction->instruction.unop.op == OP_RMT) {
+				return proc_resolve_handle(&instruction->instruction.unop.result, instruction->node, &state->handles.unop.result);
 			}
+			return NULL;  // result is local
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * Pull the remote operands of a group of adjacent instructions with a single libparam queue request.
+ *
+ * The group starts at the first instruction and is extended as long as the following instructions read from the same remote node,
+ * don't read a parameter written earlier in the group, and don't follow an ifelse, if or switch instruction.
+ * The pulled operands are marked as prefetched in the instruction states, so proc_fetch_param won't pull them again.
+ * Nothing is pulled if the group has less than two remote operands, as single pulls are then just as fast.
+ *
+ * @param instructions The instructions, starting at the first instruction of the group
+ * @param states The states of the instructions in the executing frame, holding their parameter handles
+ * @param count The number of instructions (from the first instruction to the end of the procedure)
+ * @param after_ifelse Whether the first instruction is directly preceded by an ifelse instruction
+ * @return The number of instructions in the group (at least 1)
+ */
+int proc_prefetch_operands(proc_instruction_t * instructions, proc_instruction_state_t * states, int count, int after_ifelse) {
+	proc_instruction_state_t * pulled_states[PROC_PREFETCH_MAX_OPERANDS];
+	uint8_t pulled_bits[PROC_PREFETCH_MAX_OPERANDS];
+	param_t * written[PROC_PREFETCH_MAX_OPERANDS];
+	int pulled_count = 0;
+	int written_count = 0;
+	int group_node = 0;
+	int group_size = 1;
+
+	char queue_buf[PARAM_SERVER_MTU];
+	param_queue_t queue;
+	param_queue_init(&queue, queue_buf, PARAM_SERVER_MTU, 0, PARAM_QUEUE_TYPE_GET, 2);
+
+	for (int j = 0; j < count; j++) {
+		// The instructions following an ifelse or if may be skipped, and a switch may continue anywhere
+		if (j > 0 && (after_ifelse || instructions[j - 1].type == PROC_IFELSE || instructions[j - 1].type == PROC_IF || instructions[j - 1].type == PROC_SWITCH)) {
 			break;
-		case OP_NEG:
-			if (op_par_pair.operand.type == OPERAND_TYPE_FLOAT) {
-				op_par_pair.operand.value.d = -op_par_pair.operand.value.d;
-			} else if (op_par_pair.operand.type == OPERAND_TYPE_INT) {
-				op_par_pair.operand.value.i64 = -op_par_pair.operand.value.i64;
-			} else {
-				csp_print("Error: Cannot negate type (%d)\n", op_par_pair.operand.type);
-				return -1;
+		}
+
+		proc_operand_t * operands[2];
+		proc_param_handle_t * handles[2];
+		uint8_t bits[2];
+		int n = proc_read_operands(&instructions[j], &states[j], operands, handles, bits);
+		if (n == 0 || pulled_count + n > PROC_PREFETCH_MAX_OPERANDS) {
+			break;
+		}
+
+		int eligible = 1;
+		for (int k = 0; k < n; k++) {
+			states[j].prefetched &= ~bits[k];
+			param_t * param = proc_resolve_handle(operands[k], instructions[j].node, handles[k]);
+			if (param == NULL || handles[k]->node == 0 || (group_node != 0 && handles[k]->node != group_node)) {
+				eligible = 0;
+				break;
+			}
+			for (int w = 0; w < written_count; w++) {
+				if (written[w] == param) {
+					eligible = 0;
+				}
 			}
+		}
+		if (!eligible) {
 			break;
-		case OP_IDT:
-		case OP_RMT:
+		}
+
+		for (int k = 0; k < n; k++) {
+			if (param_queue_add(&queue, handles[k]->param, handles[k]->offset, NULL) < 0) {
+				eligible = 0;
+				break;
+			}
+			pulled_states[pulled_count] = &states[j];
+			pulled_bits[pulled_count++] = bits[k];
+		}
+		group_node = handles[0]->node;
+		group_size = j + 1;
+		if (!eligible) {
 			break;
+		}
+
+		param_t * written_param = proc_written_param(&instructions[j], &states[j]);
+		if (written_param != NULL && written_count < PROC_PREFETCH_MAX_OPERANDS) {
+			written[written_count++] = written_param;
+		}
+	}
+
+	if (pulled_count < 2) {
+		return group_size;
+	}
+
+	pulled_states[0]->round_trips++;  // One round trip for the whole group
+	if (param_pull_queue(&queue, CSP_PRIO_NORM, 0, group_node, PARAM_REMOTE_TIMEOUT_MS) != 0) {
+		return group_size;  // Operands are pulled one by one instead
+	}
+	for (int k = 0; k < pulled_count; k++) {
+		pulled_states[k]->prefetched |= pulled_bits[k];
+	}
+
+	return group_size;
+}
+
+int operand_to_valuebuf(operand_t * operand, char * valuebuf) {
+	switch (operand->source_type) {
+		case PARAM_TYPE_UINT8:
+		case PARAM_TYPE_XINT8:
+			*(uint8_t *)valuebuf = (operand->type == OPERAND_TYPE_UINT32) ? (uint8_t)operand->value.u32 : (uint8_t)operand->value.u64;
+			break;
+		case PARAM_TYPE_UINT16:
+		case PARAM_TYPE_XINT16:
+			*(uint16_t *)valuebuf = (operand->type == OPERAND_TYPE_UINT32) ? (uint16_t)operand->value.u32 : (uint16_t)operand->value.u64;
+			break;
+		case PARAM_TYPE_UINT32:
+		case PARAM_TYPE_XINT32:
+			*(uint32_t *)valuebuf = (operand->type == OPERAND_TYPE_UINT32) ? operand->value.u32 : (uint32_t)operand->value.u64;
+			break;
+		case PARAM_TYPE_UINT64:
+		case PARAM_TYPE_XINT64:
+			*(uint64_t *)valuebuf = operand->value.u64;
+			break;
+		case PARAM_TYPE_INT8:
+			*(int8_t *)valuebuf = (operand->type == OPERAND_TYPE_INT32) ? (int8_t)operand->value.i32 : (int8_t)operand->value.i64;
+			break;
+		case PARAM_TYPE_INT16:
+			*(int16_t *)valuebuf = (operand->type == OPERAND_TYPE_INT32) ? (int16_t)operand->value.i32 : (int16_t)operand->value.i64;
+			break;
+		case PARAM_TYPE_INT32:
+			*(int32_t *)valuebuf = (operand->type == OPERAND_TYPE_INT32) ? operand->value.i32 : (int32_t)operand->value.i64;
+			break;
+		case PARAM_TYPE_INT64:
+			*(int64_t *)valuebuf = operand->value.i64;
+			break;
+		case PARAM_TYPE_FLOAT:
+			*(float *)valuebuf = (operand->type == OPERAND_TYPE_FLOAT32) ? operand->value.f : (float)operand->value.d;
+			break;
+		case PARAM_TYPE_DOUBLE:
+			*(double *)valuebuf = operand->value.d;
+			break;
+		case PARAM_TYPE_STRING:
+			strcpy(valuebuf, operand->value.s);
+			break;
+		default:
+			csp_print("Invalid or unsupported parameter type\n");
+			return -1;
+	}
+	return 0;
+}
+
+char * proc_value_str_to_valuebuf(param_t * param, char * valuebuf, char * value_str) {
+	if (param_str_to_value(param->type, value_str, valuebuf) < 0) {
+		csp_print("invalid parameter value\n");
+		return -1;
+	}
+	return 0;
+}
+
+void proc_write_buffer_init(proc_write_buffer_t * write_buffer) {
+	param_queue_init(&write_buffer->queue, write_buffer->buffer, PARAM_SERVER_MTU, 0, PARAM_QUEUE_TYPE_SET, 2);
+	write_buffer->node = 0;
+}
+
+/**
+ * Push all buffered writes in a single request.
+ *
+ * @return 0 on success, -1 if the push wasn't acknowledged
+ */
+int proc_write_buffer_flush(proc_write_buffer_t * write_buffer) {
+	if (write_buffer->node == 0) {
+		return 0;
+	}
+
+	int ret = param_push_queue(&write_buffer->queue, 0, write_buffer->node, PARAM_REMOTE_TIMEOUT_MS, 0, PARAM_ACK_ON_PUSH);
+	proc_write_buffer_init(write_buffer);
+	if (ret < 0 && PARAM_ACK_ON_PUSH) {
+		csp_print("No response\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Check whether buffered writes must be pushed before executing an instruction,
+ * i.e. if it may read the written parameters or otherwise depends on the writes having taken effect.
+ */
+int proc_write_buffer_needs_flush(proc_write_buffer_t * write_buffer, proc_instruction_t * instruction) {
+	if (write_buffer->node == 0) {
+		return 0;
+	}
+
+	switch (instruction->type) {
+		case PROC_BLOCK:
+		case PROC_IFELSE:
+		case PROC_IF:
+		case PROC_SWITCH:
+		case PROC_CALL:
+		case PROC_LOOP:
+			return 1;
+		case PROC_UNOP:
+			return instruction->instruction.unop.op != OP_RMT && instruction->node == write_buffer->node;
+		case PROC_BINOP:
+			return instruction->node == write_buffer->node;
 		default:
-			csp_print("Invalid or unsupported unary operation (%d)\n", instruction->instruction.unop.op);
+			return 0;
+	}
+}
+
+/**
+ * Add a remote write to the write buffer, flushing it first if it holds writes to another node or is full.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int proc_write_buffer_add(proc_write_buffer_t * write_buffer, proc_param_handle_t * handle, proc_instruction_state_t * state, char * valuebuf) {
+	if (write_buffer->node != handle->node && proc_write_buffer_flush(write_buffer) != 0) {
+		return -1;
+	}
+
+	if (param_queue_add(&write_buffer->queue, handle->param, handle->offset, valuebuf) < 0) {
+		if (proc_write_buffer_flush(write_buffer) != 0 || param_queue_add(&write_buffer->queue, handle->param, handle->offset, valuebuf) < 0) {
 			return -1;
+		}
+	}
+
+	if (write_buffer->node == 0) {
+		state->round_trips++;  // One round trip for all writes coalesced into the push
+	}
+	write_buffer->node = handle->node;
+	return 0;
+}
+
+int proc_set_param(proc_operand_t * param_operand, operand_t * operand, char * value_str, int node, proc_param_handle_t * handle, proc_instruction_state_t * state, proc_write_buffer_t * write_buffer) {
+	param_t * param = NULL;
+
+	if (operand == NULL && value_str == NULL) {
+		csp_print("No value provided\n");
+		return -1;
+	}
+
+	param = proc_resolve_handle(param_operand, node, handle);
+	if (param == NULL) {
+		// TODO: add ability to add new parameters?
+		csp_print("Failed to fetch %s\n", param_operand->name);
+		return -1;
 	}
 
-	int ret = proc_set_param(
-		instruction->instruction.unop.result,
+	if (param->mask & PM_READONLY) {
+		csp_print("%s is read-only\n", param->name);
+		return -1;
+	}
+
+	char valuebuf[128] __attribute__((aligned(16))) = {};
+	int ret = (value_str != NULL) ? proc_value_str_to_valuebuf(param, valuebuf, value_str) : operand_to_valuebuf(operand, valuebuf);
+	if (ret != 0) {
+		return ret;
+	}
+
+	int offset = handle->offset;
+
+	if (handle->node == 0) {  // Local parameter
+		if (offset < 0) {
+			for (int i = 0; i < param->array_size; i++) {
+				param_set(param, i, valuebuf);
+			}
+		} else {
+			param_set(param, offset, valuebuf);
+		}
+	} else {  // Remote parameter
+		csp_timestamp_t time_now;
+		csp_clock_get_time(&time_now);
+		*param->timestamp = 0;
+		if (write_buffer != NULL) {
+			return proc_write_buffer_add(write_buffer, handle, state, valuebuf);
+		}
+		state->round_trips++;
+		if (param_push_single(param, offset, valuebuf, 0, handle->node, PARAM_REMOTE_TIMEOUT_MS, 2, PARAM_ACK_ON_PUSH) < 0 && PARAM_ACK_ON_PUSH) {
+			csp_print("No response\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Write the result of a unop or binop instruction to its parameter or scratch register.
+ */
+static int proc_write_result(proc_operand_t * result, operand_t * operand, int node, proc_param_handle_t * handle, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
+	if (result->kind == PROC_OPERAND_REGISTER) {
+		return proc_write_register(result, registers, operand);
+	}
+	return proc_set_param(result, operand, NULL, node, handle, state, write_buffer);
+}
+
+/**
+ * Build the if-else instruction evaluating the condition of a block instruction, for use with proc_runtime_ifelse.
+ *
+ * @param instruction The block instruction
+ * @param ifelse_instruction The if-else instruction to fill in
+ */
+void proc_block_condition(proc_instruction_t * instruction, proc_instruction_t * ifelse_instruction) {
+	ifelse_instruction->type = PROC_IFELSE;
+	ifelse_instruction->node = instruction->node;
+	ifelse_instruction->instruction.ifelse.param_a = instruction->instruction.block.param_a;
+	ifelse_instruction->instruction.ifelse.op = instruction->instruction.block.op;
+	ifelse_instruction->instruction.ifelse.param_b = instruction->instruction.block.param_b;
+}
+
+/**
+ * Get the polling schedule of a block instruction: unset (0) fields are replaced by the runtime defaults,
+ * and the periods and timeout are kept within MIN_PROC_BLOCK_PERIOD_MS and MAX_PROC_BLOCK_TIMEOUT_MS.
+ *
+ * @param block The block instruction
+ * @param schedule The block instruction with the resolved schedule
+ */
+void proc_block_schedule(proc_block_t * block, proc_block_t * schedule) {
+	*schedule = *block;
+	if (schedule->min_period_ms < MIN_PROC_BLOCK_PERIOD_MS) {
+		schedule->min_period_ms = MIN_PROC_BLOCK_PERIOD_MS;
+	}
+	if (schedule->max_period_ms == 0) {
+		schedule->max_period_ms = PROC_BLOCK_MAX_PERIOD_MS;
+	}
+	if (schedule->max_period_ms < schedule->min_period_ms) {
+		schedule->max_period_ms = schedule->min_period_ms;
+	}
+	if (schedule->backoff_percent == 0) {
+		schedule->backoff_percent = PROC_BLOCK_BACKOFF_PERCENT;
+	}
+	if (schedule->backoff_percent < 100) {
+		schedule->backoff_percent = 100;
+	}
+	if (schedule->timeout_ms == 0 || schedule->timeout_ms > MAX_PROC_BLOCK_TIMEOUT_MS) {
+		schedule->timeout_ms = MAX_PROC_BLOCK_TIMEOUT_MS;
+	}
+}
+
+/**
+ * Get the polling period following `period_ms` in the schedule of a block instruction.
+ *
+ * @param schedule The schedule, as resolved by proc_block_schedule
+ * @param period_ms The current period
+ * @return The next period
+ */
+uint32_t proc_block_next_period(proc_block_t * schedule, uint32_t period_ms) {
+	uint64_t next_period_ms = (uint64_t)period_ms * schedule->backoff_percent / 100;
+	return (next_period_ms > schedule->max_period_ms) ? schedule->max_period_ms : (uint32_t)next_period_ms;
+}
+
+/**
+ * Execute an if-else or if instruction, evaluating its condition.
+ *
+ * @param instruction The instruction to execute
+ * @param state The state of the instruction in the executing frame, holding the resolved parameter handles
+ * @param registers Scratch registers of the executing frame, NULL if there are none (e.g. block conditions)
+ * @return if_else_flag_t flag indicating the result of the if-else instruction (true, false, error)
+ */
+int proc_runtime_ifelse(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t * registers) {
+	if (instruction->type != PROC_IFELSE && instruction->type != PROC_IF) {
+		csp_print("Invalid instruction type, expected PROC_IFELSE or PROC_IF\n");
+		return IF_ELSE_FLAG_ERR;
+	}
+
+	// Each operand is fetched (pulled, if remote) exactly once; the typed value and the param metadata come from the same fetch
+	ifelse_handles_t * ifelse_handles = &state->handles.ifelse;
+	operand_param_pair_t op_par_pair_a, op_par_pair_b;
+	if (fetch_operand_param_pair(&instruction->instruction.ifelse.param_a, &op_par_pair_a, instruction->node, &ifelse_handles->param_a, state, OPERAND_BIT_A, registers) != 0) {
+		csp_print("Failed to fetch operand A\n");
+		return IF_ELSE_FLAG_ERR;
+	}
+	if (fetch_operand_param_pair(&instruction->instruction.ifelse.param_b, &op_par_pair_b, instruction->node, &ifelse_handles->param_b, state, OPERAND_BIT_B, registers) != 0) {
+		csp_print("Failed to fetch operand B\n");
+		return IF_ELSE_FLAG_ERR;
+	}
+
+	if ((op_par_pair_a.param != NULL && op_par_pair_a.param->type == PARAM_TYPE_INVALID) || (op_par_pair_b.param != NULL && op_par_pair_b.param->type == PARAM_TYPE_DATA)) {
+		csp_print("Invalid param type\n");
+		return IF_ELSE_FLAG_ERR;
+	}
+
+	if (operand_unify_operands(&instruction->instruction.ifelse.param_a, &op_par_pair_a.operand, &instruction->instruction.ifelse.param_b, &op_par_pair_b.operand) != 0) {
+		return IF_ELSE_FLAG_ERR_TYPE;
+	}
+	if (op_par_pair_a.operand.type == OPERAND_TYPE_STRING) {
+		op_par_pair_a.operand.value.s = (char *)(op_par_pair_a.param->addr);
+		op_par_pair_b.operand.value.s = (char *)(op_par_pair_b.param->addr);
+	}
+
+	proc_kernel_t kernel = proc_bind_kernel(state, PROC_IFELSE, instruction->instruction.ifelse.op, op_par_pair_a.operand.type);
+	if (kernel == NULL) {
+		csp_print("Invalid or unsupported comparison (%d) on operand type %d\n", instruction->instruction.ifelse.op, op_par_pair_a.operand.type);
+		return IF_ELSE_FLAG_ERR;
+	}
+	return kernel(&op_par_pair_a.operand, &op_par_pair_b.operand) ? IF_ELSE_FLAG_TRUE : IF_ELSE_FLAG_FALSE;
+}
+
+/**
+ * Evaluate a switch instruction, fetching its parameter once and looking its value up in the jump table.
+ *
+ * @param instruction The instruction to execute
+ * @param state The state of the instruction in the executing frame, holding the resolved parameter handle
+ * @return The index of the instruction to continue at (the instruction count ends the procedure), -1 on error
+ */
+int proc_runtime_switch(proc_instruction_t * instruction, proc_instruction_state_t * state) {
+	if (instruction->type != PROC_SWITCH) {
+		csp_print("Invalid instruction type, expected PROC_SWITCH\n");
+		return -1;
+	}
+
+	proc_switch_t * switch_ = &instruction->instruction.switch_;
+	operand_param_pair_t op_par_pair;
+	if (fetch_operand_param_pair(&switch_->param, &op_par_pair, instruction->node, &state->handles.switch_.param, state, OPERAND_BIT_A, NULL) != 0) {
+		return -1;
+	}
+
+	int64_t value;
+	switch (op_par_pair.operand.type) {
+		case OPERAND_TYPE_UINT:
+			if (op_par_pair.operand.value.u64 > INT32_MAX) {
+				return switch_->default_target;
+			}
+			value = (int64_t)op_par_pair.operand.value.u64;
+			break;
+		case OPERAND_TYPE_INT:
+			value = op_par_pair.operand.value.i64;
+			break;
+		case OPERAND_TYPE_UINT32:
+			value = (int64_t)op_par_pair.operand.value.u32;
+			break;
+		case OPERAND_TYPE_INT32:
+			value = (int64_t)op_par_pair.operand.value.i32;
+			break;
+		default:
+			csp_print("Switch on non-integer parameter %s\n", switch_->param.name);
+			return -1;
+	}
+
+	// Cases are sorted by value (see proc_analyze)
+	int low = 0;
+	int high = switch_->case_count - 1;
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		if (switch_->cases[mid].value == value) {
+			return switch_->cases[mid].target;
+		}
+		if (switch_->cases[mid].value < value) {
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return switch_->default_target;
+}
+
+int proc_runtime_set(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_write_buffer_t * write_buffer) {
+	if (instruction->type != PROC_SET) {
+		csp_print("Invalid instruction type, expected PROC_SET\n");
+		return -1;
+	}
+
+	return proc_set_param(&instruction->instruction.set.param,
+						  NULL,
+						  instruction->instruction.set.value,
+						  instruction->node,
+						  &state->handles.set.param,
+						  state,
+						  write_buffer);
+}
+
+int proc_runtime_unop(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
+	if (instruction->type != PROC_UNOP) {
+		csp_print("Invalid instruction type, expected PROC_UNOP\n");
+		return -1;
+	}
+
+	int fetch_node, result_node;
+	if (instruction->instruction.unop.op == OP_RMT) {
+		fetch_node = 0;
+		result_node = instruction->node;
+	} else {
+		fetch_node = instruction->node;
+		result_node = 0;
+	}
+
+	operand_param_pair_t op_par_pair;
+	if (fetch_operand_param_pair(&instruction->instruction.unop.param, &op_par_pair, fetch_node, &state->handles.unop.param, state, OPERAND_BIT_A, *registers) != 0) {
+		csp_print("Failed to fetch operand\n");
+		return -1;
+	}
+
+	proc_kernel_t kernel = proc_bind_kernel(state, PROC_UNOP, instruction->instruction.unop.op, op_par_pair.operand.type);
+	if (kernel == NULL) {
+		csp_print("Error: Cannot perform unary operation (%d) on type (%d)\n", instruction->instruction.unop.op, op_par_pair.operand.type);
+		return -1;
+	}
+	if (kernel(&op_par_pair.operand, NULL) != 0) {
+		return -1;
+	}
+
+	int ret = proc_write_result(
+		&instruction->instruction.unop.result,
 		&op_par_pair.operand,
-		NULL,
-		result_node);
+		result_node,
+		&state->handles.unop.result,
+		state,
+		registers,
+		write_buffer);
 
 	return ret;
 }
 
-int proc_runtime_binop(proc_instruction_t * instruction) {
+int proc_runtime_binop(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer) {
 	if (instruction->type != PROC_BINOP) {
 		csp_print("Invalid instruction type, expected PROC_BINOP\n");
 		return -1;
 	}
 
+	binop_handles_t * binop_handles = &state->handles.binop;
 	operand_param_pair_t op_par_pair_a, op_par_pair_b;
-	if (fetch_operand_param_pair(instruction->instruction.binop.param_a, &op_par_pair_a, instruction->node) != 0 ||
-		fetch_operand_param_pair(instruction->instruction.binop.param_b, &op_par_pair_b, instruction->node) != 0) {
+	if (fetch_operand_param_pair(&instruction->instruction.binop.param_a, &op_par_pair_a, instruction->node, &binop_handles->param_a, state, OPERAND_BIT_A, *registers) != 0 ||
+		fetch_operand_param_pair(&instruction->instruction.binop.param_b, &op_par_pair_b, instruction->node, &binop_handles->param_b, state, OPERAND_BIT_B, *registers) != 0) {
 		csp_print("Failed to fetch operands\n");
 		return -1;
 	}
 
-	switch (instruction->instruction.binop.op) {
-		case OP_ADD:
-		case OP_SUB:
-		case OP_MUL:
-		case OP_DIV:
-			if (op_par_pair_a.operand.type == OPERAND_TYPE_FLOAT && op_par_pair_b.operand.type == OPERAND_TYPE_FLOAT) {
-				switch (instruction->instruction.binop.op) {
-					case OP_ADD:
-						op_par_pair_a.operand.value.d += op_par_pair_b.operand.value.d;
-						break;
-					case OP_SUB:
-						op_par_pair_a.operand.value.d -= op_par_pair_b.operand.value.d;
-						break;
-					case OP_MUL:
-						op_par_pair_a.operand.value.d *= op_par_pair_b.operand.value.d;
-						break;
-					case OP_DIV:
-						if (op_par_pair_b.operand.value.d == 0) {
-							csp_print("Error: Division by zero\n");
-							return -1;
-						}
-						op_par_pair_a.operand.value.d /= op_par_pair_b.operand.value.d;
-						break;
-					default:
-						csp_print("Invalid or unsupported binary operation (%d)\n", instruction->instruction.binop.op);
-						return -1;
-				}
-			} else if (op_par_pair_a.operand.type == OPERAND_TYPE_INT && op_par_pair_b.operand.type == OPERAND_TYPE_INT) {
-				switch (instruction->instruction.binop.op) {
-					case OP_ADD:
-						op_par_pair_a.operand.value.i64 += op_par_pair_b.operand.value.i64;
-						break;
-					case OP_SUB:
-						op_par_pair_a.operand.value.i64 -= op_par_pair_b.operand.value.i64;
-						break;
-					case OP_MUL:
-						op_par_pair_a.operand.value.i64 *= op_par_pair_b.operand.value.i64;
-						break;
-					case OP_DIV:
-						if (op_par_pair_b.operand.value.i64 == 0) {
-							csp_print("Error: Division by zero\n");
-							return -1;
-						}
-						op_par_pair_a.operand.value.i64 /= op_par_pair_b.operand.value.i64;
-						break;
-					default:
-						csp_print("Invalid or unsupported binary operation (%d)\n", instruction->instruction.binop.op);
-						return -1;
-				}
-			} else if (op_par_pair_a.operand.type == OPERAND_TYPE_UINT && op_par_pair_b.operand.type == OPERAND_TYPE_UINT) {
-				switch (instruction->instruction.binop.op) {
-					case OP_ADD:
-						op_par_pair_a.operand.value.u64 += op_par_pair_b.operand.value.u64;
-						break;
-					case OP_SUB:
-						op_par_pair_a.operand.value.u64 -= op_par_pair_b.operand.value.u64;
-						break;
-					case OP_MUL:
-						op_par_pair_a.operand.value.u64 *= op_par_pair_b.operand.value.u64;
-						break;
-					case OP_DIV:
-						if (op_par_pair_b.operand.value.u64 == 0) {
-							csp_print("Error: Division by zero\n");
-							return -1;
-						}
-						op_par_pair_a.operand.value.u64 /= op_par_pair_b.operand.value.u64;
-						break;
-					default:
-						csp_print("Invalid or unsupported binary operation (%d)\n", instruction->instruction.binop.op);
-						return -1;
-				}
-			} else {
-				csp_print("Error: Cannot perform arithmetic operation on types (%d, %d)\n", op_par_pair_a.operand.type, op_par_pair_b.operand.type);
+	if (operand_unify_operands(&instruction->instruction.binop.param_a, &op_par_pair_a.operand, &instruction->instruction.binop.param_b, &op_par_pair_b.operand) != 0) {
+		csp_print("Error: Cannot perform operation on types (%d, %d)\n", op_par_pair_a.operand.type, op_par_pair_b.operand.type);
+		return -1;
+	}
+
+	proc_kernel_t kernel = proc_bind_kernel(state, PROC_BINOP, instruction->instruction.binop.op, op_par_pair_a.operand.type);
+	if (kernel == NULL) {
+		csp_print("Error: Cannot perform binary operation (%d) on type (%d)\n", instruction->instruction.binop.op, op_par_pair_a.operand.type);
+		return -1;
+	}
+	if (kernel(&op_par_pair_a.operand, &op_par_pair_b.operand) != 0) {
+		return -1;
+	}
+	if (operand_is_immediate(&instruction->instruction.binop.param_a)) {
+		op_par_pair_a.operand.source_type = op_par_pair_b.operand.source_type;  // An immediate has no representation of its own
+	}
+
+	int ret = proc_write_result(
+		&instruction->instruction.binop.result,
+		&op_par_pair_a.operand,
+		instruction->node,
+		&binop_handles->result,
+		state,
+		registers,
+		write_buffer);
+
+	return ret;
+}
+
+/**
+ * Push the caller of a non-tail call onto the call stack of a run. The stack starts small and doubles when
+ * full, so shallow runs only pay for the frames they use.
+ *
+ * @return 0 on success, -1 if the maximum recursion depth is exceeded or memory runs out
+ */
+static int proc_frame_push(proc_continuation_t * continuation, proc_t * proc, proc_analysis_t * analysis, int pc) {
+	if (continuation->depth >= MAX_PROC_RECURSION_DEPTH) {
+		csp_print("Error: maximum recursion depth exceeded\n");
+		return -1;
+	}
+
+	if (continuation->depth == continuation->frame_capacity) {
+		int frame_capacity = (continuation->frame_capacity > 0) ? continuation->frame_capacity * 2 : CALL_STACK_INITIAL_FRAMES;
+		proc_frame_t * frames = proc_realloc(continuation->frames, frame_capacity * sizeof(proc_frame_t));
+		if (frames == NULL) {
+			csp_print("Error allocating memory for call stack\n");
+			return -1;
+		}
+		continuation->frames = frames;
+		continuation->frame_capacity = frame_capacity;
+	}
+
+	// The called procedure starts with registers and instruction states of its own, the caller's are restored on return
+	continuation->frames[continuation->depth++] = (proc_frame_t){proc, analysis, pc, continuation->registers, continuation->states};
+	continuation->registers = NULL;
+	continuation->states = NULL;
+	return 0;
+}
+
+/**
+ * Execute a call instruction by continuing in the called procedure. A non-tail call first pushes the caller
+ * onto the call stack of the run, to return to once the called procedure completes; a tail call reuses the
+ * frame of the caller. Either way, the called procedure starts with an empty register file and fresh instruction states.
+ *
+ * @param op The compiled call instruction
+ * @param continuation The run executing the call, holding its call stack
+ * @param analysis The analysis of the executing procedure, replaced by the called one
+ * @param proc The executing procedure, replaced by the called one
+ * @param pc The op to continue with after the call, set to the start of the called procedure
+ * @return 0 on success, -1 on error
+ */
+int proc_runtime_call(proc_op_t * op, proc_continuation_t * continuation, proc_analysis_t ** analysis, proc_t ** proc, int * pc) {
+	if (op->instruction->type != PROC_CALL) {
+		csp_print("Invalid instruction type, expected PROC_CALL\n");
+		return -1;
+	}
+
+	if (op->instruction_analysis->analysis.call.is_tail_call) {
+		proc_loops_unwind(continuation, continuation->depth);  // The loops, registers and instruction states of the caller are done with its frame
+		proc_free(continuation->registers);
+		continuation->registers = NULL;
+		proc_free(continuation->states);
+		continuation->states = NULL;
+	} else if (proc_frame_push(continuation, *proc, *analysis, *pc) != 0) {
+		return -1;
+	}
+
+	*analysis = op->callee;
+	*proc = op->callee->proc;
+	*pc = 0;
+	return 0;
+}
+
+/**
+ * Drop the counted loops a run executes at a depth of its call stack or deeper, e.g. when returning from a call.
+ *
+ * @param continuation The run
+ * @param depth The depth of the call stack
+ */
+void proc_loops_unwind(proc_continuation_t * continuation, int depth) {
+	while (continuation->loop_count > 0 && continuation->loops[continuation->loop_count - 1].depth >= depth) {
+		continuation->loop_count--;
+	}
+}
+
+/**
+ * Push a counted loop entered by a run. The stack grows like the call stack.
+ *
+ * @return The loop state, or NULL if memory runs out
+ */
+static proc_loop_state_t * proc_loop_push(proc_continuation_t * continuation, int index, int start, uint32_t remaining) {
+	if (continuation->loop_count == continuation->loop_capacity) {
+		int loop_capacity = (continuation->loop_capacity > 0) ? continuation->loop_capacity * 2 : LOOP_STACK_INITIAL_LOOPS;
+		proc_loop_state_t * loops = proc_realloc(continuation->loops, loop_capacity * sizeof(proc_loop_state_t));
+		if (loops == NULL) {
+			csp_print("Error allocating memory for loop counts\n");
+			return NULL;
+		}
+		continuation->loops = loops;
+		continuation->loop_capacity = loop_capacity;
+	}
+
+	proc_loop_state_t * loop = &continuation->loops[continuation->loop_count++];
+	*loop = (proc_loop_state_t){continuation->depth, index, start, remaining};
+	return loop;
+}
+
+/**
+ * Execute a jump, switch or loop instruction within the executing procedure. A loop continues at the start of its
+ * body until the body has run `count` times, with the iterations counted in the run; a jump or switch out of the
+ * body of a counted loop ends the loop, so it starts over when it's entered again.
+ *
+ * @param op The compiled jump, switch or loop instruction
+ * @param continuation The run executing the instruction, holding its loop counts
+ * @param analysis The analysis of the executing procedure
+ * @param next The op to continue with after the instruction, set to the target when jumping
+ * @return 0 on success, -1 if memory runs out or the switch parameter can't be fetched
+ */
+int proc_runtime_jump(proc_op_t * op, proc_continuation_t * continuation, proc_analysis_t * analysis, int * next) {
+	proc_loop_state_t * loop = NULL;
+
+	if (op->instruction->type == PROC_JUMP || op->instruction->type == PROC_SWITCH) {
+		int target = (op->branch == PROC_CODE_END) ? analysis->proc->instruction_count : op->branch;
+		if (op->instruction->type == PROC_SWITCH) {
+			target = proc_runtime_switch(op->instruction, &continuation->states[op->index]);
+			if (target < 0) {
 				return -1;
 			}
-			break;
-		case OP_MOD:
-		case OP_LSH:
-		case OP_RSH:
-		case OP_AND:
-		case OP_OR:
-		case OP_XOR:
-			if (op_par_pair_a.operand.type == OPERAND_TYPE_INT && op_par_pair_b.operand.type == OPERAND_TYPE_INT) {
-				switch (instruction->instruction.binop.op) {
-					case OP_MOD:
-						if (op_par_pair_b.operand.value.i64 == 0) {
-							csp_print("Error: Division by zero\n");
-							return -1;
-						}
-						op_par_pair_a.operand.value.i64 %= op_par_pair_b.operand.value.i64;
-						break;
-					case OP_LSH:
-						op_par_pair_a.operand.value.i64 <<= op_par_pair_b.operand.value.i64;
-						break;
-					case OP_RSH:
-						op_par_pair_a.operand.value.i64 >>= op_par_pair_b.operand.value.i64;
-						break;
-					case OP_AND:
-						op_par_pair_a.operand.value.i64 &= op_par_pair_b.operand.value.i64;
-						break;
-					case OP_OR:
-						op_par_pair_a.operand.value.i64 |= op_par_pair_b.operand.value.i64;
-						break;
-					case OP_XOR:
-						op_par_pair_a.operand.value.i64 ^= op_par_pair_b.operand.value.i64;
-						break;
-					default:
-						csp_print("Invalid or unsupported binary operation (%d)\n", instruction->instruction.binop.op);
-						return -1;
-				}
-			} else if (op_par_pair_a.operand.type == OPERAND_TYPE_UINT && op_par_pair_b.operand.type == OPERAND_TYPE_UINT) {
-				switch (instruction->instruction.binop.op) {
-					case OP_MOD:
-						if (op_par_pair_b.operand.value.u64 == 0) {
-							csp_print("Error: Division by zero\n");
-							return -1;
-						}
-						op_par_pair_a.operand.value.u64 %= op_par_pair_b.operand.value.u64;
-						break;
-					case OP_LSH:
-						op_par_pair_a.operand.value.u64 <<= op_par_pair_b.operand.value.u64;
-						break;
-					case OP_RSH:
-						op_par_pair_a.operand.value.u64 >>= op_par_pair_b.operand.value.u64;
-						break;
-					case OP_AND:
-						op_par_pair_a.operand.value.u64 &= op_par_pair_b.operand.value.u64;
-						break;
-					case OP_OR:
-						op_par_pair_a.operand.value.u64 |= op_par_pair_b.operand.value.u64;
-						break;
-					case OP_XOR:
-						op_par_pair_a.operand.value.u64 ^= op_par_pair_b.operand.value.u64;
-						break;
-					default:
-						csp_print("Invalid or unsupported binary operation (%d)\n", instruction->instruction.binop.op);
-						return -1;
-				}
-			} else {
-				csp_print("Error: Cannot perform operation on types (%d, %d)\n", op_par_pair_a.operand.type, op_par_pair_b.operand.type);
-				return -1;
+		}
+		while (continuation->loop_count > 0) {
+			loop = &continuation->loops[continuation->loop_count - 1];
+			if (loop->depth != continuation->depth || (target >= loop->start && target <= loop->index)) {
+				break;
 			}
+			continuation->loop_count--;
+		}
+		*next = (target < analysis->proc->instruction_count) ? target : PROC_CODE_END;  // Instructions are the first ops
+		return 0;
+	}
+
+	if (op->instruction->type != PROC_LOOP) {
+		csp_print("Invalid instruction type, expected PROC_JUMP, PROC_SWITCH or PROC_LOOP\n");
+		return -1;
+	}
+
+	uint32_t count = op->instruction->instruction.loop.count;
+	if (count == 0) {
+		*next = op->branch;
+		return 0;
+	}
+
+	// Loops nested in this one have completed, or were left by skipping their loop instruction
+	while (continuation->loop_count > 0) {
+		loop = &continuation->loops[continuation->loop_count - 1];
+		if (loop->depth != continuation->depth || loop->index >= op->index) {
 			break;
-		default:
-			csp_print("Invalid or unsupported binary operation (%d)\n", instruction->instruction.binop.op);
-			return -1;
+		}
+		continuation->loop_count--;
 	}
 
-	int ret = proc_set_param(
-		instruction->instruction.binop.result,
-		&op_par_pair_a.operand,
-		NULL,
-		instruction->node);
+	if (continuation->loop_count > 0 && loop->depth == continuation->depth && loop->index == op->index) {
+		if (loop->remaining == 0) {
+			continuation->loop_count--;
+			return 0;  // The body has run count times
+		}
+		loop->remaining--;
+	} else if (count > 1) {
+		if (proc_loop_push(continuation, op->index, op->instruction->instruction.loop.target, count - 2) == NULL) {
+			return -1;
+		}
+	} else {
+		return 0;
+	}
 
-	return ret;
+	*next = op->branch;
+	return 0;
 }
 
-int proc_runtime_call(proc_instruction_t * instruction, proc_analysis_t ** analysis, proc_t ** proc, int * i, if_else_flag_t * _if_else_flag) {
-	if (instruction->type != PROC_CALL) {
-		csp_print("Invalid instruction type, expected PROC_CALL\n");
+/**
+ * Get the operand type of a parameter operand, if it can be known without contacting other nodes.
+ *
+ * @return The operand type, or -1 if it isn't known yet
+ */
+static int proc_check_operand_type(proc_operand_t * operand, int node) {
+	if (operand->kind == PROC_OPERAND_FLOAT) {
+		return OPERAND_TYPE_FLOAT;
+	}
+	if (operand->kind != PROC_OPERAND_PARAM || !proc_node_is_local(node) || operand->name == NULL) {  // Integer immediates match the other operand
+		return -1;
+	}
+
+	proc_param_handle_t handle = {};
+	if (proc_resolve_param(operand, node, &handle) != 0) {
 		return -1;
 	}
-	proc_instruction_analysis_t * instruction_analysis = &((*analysis)->instruction_analyses[(*i)]);
+	return param_operand_type(handle.param->type);
+}
 
-	int analysis_index = -1;
-	for (int j = 0; j < (*analysis)->procedure_slot_count; j++) {
-		if ((*analysis)->procedure_slots[j] == instruction->instruction.call.procedure_slot) {
-			analysis_index = j;
+/**
+ * Check the operand types of an instruction (see proc_runtime_check).
+ *
+ * @return 0 if no mismatch was found, -1 otherwise
+ */
+static int proc_check_instruction(proc_instruction_t * instruction) {
+	int op, type_a, type_b, type_result;
+	switch (instruction->type) {
+		case PROC_BLOCK:
+			op = instruction->instruction.block.op;
+			type_a = proc_check_operand_type(&instruction->instruction.block.param_a, instruction->node);
+			type_b = proc_check_operand_type(&instruction->instruction.block.param_b, instruction->node);
+			type_result = -1;
+			break;
+		case PROC_IFELSE:
+		case PROC_IF:
+			op = instruction->instruction.ifelse.op;
+			type_a = proc_check_operand_type(&instruction->instruction.ifelse.param_a, instruction->node);
+			type_b = proc_check_operand_type(&instruction->instruction.ifelse.param_b, instruction->node);
+			type_result = -1;
+			break;
+		case PROC_UNOP: {
+			op = instruction->instruction.unop.op;
+			int rmt = (op == OP_RMT);
+			type_a = proc_check_operand_type(&instruction->instruction.unop.param, rmt ? 0 : instruction->node);
+			type_b = -1;
+			type_result = proc_check_operand_type(&instruction->instruction.unop.result, rmt ? instruction->node : 0);
 			break;
 		}
+		case PROC_SWITCH:
+			type_a = proc_check_operand_type(&instruction->instruction.switch_.param, instruction->node);
+			if (type_a != -1 && type_a != OPERAND_TYPE_UINT && type_a != OPERAND_TYPE_INT) {
+				csp_print("Switch parameter %s must be an integer\n", instruction->instruction.switch_.param.name);
+				return -1;
+			}
+			return 0;
+		case PROC_BINOP:
+			op = instruction->instruction.binop.op;
+			type_a = proc_check_operand_type(&instruction->instruction.binop.param_a, instruction->node);
+			type_b = proc_check_operand_type(&instruction->instruction.binop.param_b, instruction->node);
+			type_result = proc_check_operand_type(&instruction->instruction.binop.result, instruction->node);
+			break;
+		default:
+			return 0;
+	}
+
+	// Operand b has the type of operand a, and so does the result (written with the representation of operand a)
+	if (type_a == -1) {
+		type_a = (type_b != -1) ? type_b : type_result;
 	}
-	if (analysis_index == -1) {
-		csp_print("Error: procedure not found %d\n", instruction->instruction.call.procedure_slot);
+	if ((type_b != -1 && type_b != type_a) || (type_result != -1 && type_result != type_a)) {
+		csp_print("Operand type mismatch (%d, %d, %d)\n", type_a, type_b, type_result);
 		return -1;
 	}
+	if (type_a != -1 && proc_select_kernel(instruction->type, op, type_a) == NULL) {
+		csp_print("Operation %d is not defined for operand type %d\n", op, type_a);
+		return -1;
+	}
+	return 0;
+}
 
-	if (instruction_analysis->analysis.call.is_tail_call) {
-		// Avoid nesting procedure execution when tail call (reuse outer stack frame)
-		*analysis = (*analysis)->sub_analyses[analysis_index];
-		*proc = (*analysis)->proc;
-		*_if_else_flag = IF_ELSE_FLAG_NONE;
-		*i = -1;  // It will be incremented to 0 at the start of the next loop iteration
-	} else {
-		proc_analysis_t * called_proc_analysis = (*analysis)->sub_analyses[analysis_index];
-		return proc_instructions_exec(called_proc_analysis->proc, called_proc_analysis);
+int proc_runtime_check(proc_t * proc) {
+	for (int i = 0; i < proc->instruction_count; i++) {
+		if (proc_check_instruction(&proc->instructions[i]) != 0) {
+			csp_print("Type check failed on instruction %d\n", i);
+			return -1;
+		}
 	}
 	return 0;
 }
@@ -0,0 +1,117 @@
+// Per-node cache of downloaded remote parameter lists
+
+#include <csp/csp.h>
+#include <param/param.h>
+#include <param/param_client.h>
+
+#include <csp_proc/proc_runtime.h>
+#include <csp_proc/proc_mutex.h>
+
+// forward declarations
+void proc_param_index_sync();
+void proc_param_list_changed();
+
+#ifndef PARAM_REMOTE_TIMEOUT_MS
+#define PARAM_REMOTE_TIMEOUT_MS (1000)
+#endif
+
+typedef struct {
+	uint16_t node;  // 0 if the entry is unused
+	uint32_t downloaded_ms;
+} list_cache_entry_t;
+
+static list_cache_entry_t list_cache[PROC_LIST_CACHE_SIZE];
+static uint32_t list_cache_hits = 0;
+static uint32_t list_cache_misses = 0;
+static proc_mutex_t * list_cache_mutex = NULL;
+
+int proc_list_cache_init() {
+	if (list_cache_mutex == NULL) {
+		list_cache_mutex = proc_mutex_create();
+	}
+	return (list_cache_mutex != NULL) ? 0 : -1;
+}
+
+/**
+ * Find the cache entry of a node, or the entry to replace (unused or least recently downloaded) if the node isn't cached.
+ * Must be called with list_cache_mutex taken.
+ */
+static list_cache_entry_t * list_cache_lookup(uint16_t node, uint32_t now) {
+	list_cache_entry_t * victim = &list_cache[0];
+	for (size_t i = 0; i < PROC_LIST_CACHE_SIZE; i++) {
+		if (list_cache[i].node == node) {
+			return &list_cache[i];
+		}
+		if (victim->node != 0 && (list_cache[i].node == 0 || (now - list_cache[i].downloaded_ms) > (now - victim->downloaded_ms))) {
+			victim = &list_cache[i];
+		}
+	}
+	return victim;
+}
+
+/**
+ * Ensure the parameter list of a remote node is present in the libparam list.
+ * The list is only downloaded if it isn't cached or the cached list is older than PROC_LIST_CACHE_TTL_MS.
+ *
+ * @param node The remote node
+ * @return 0 on success, -1 on failure
+ */
+int proc_list_cache_ensure(uint16_t node) {
+	if (proc_mutex_take(list_cache_mutex) != PROC_MUTEX_OK) {
+		return -1;
+	}
+
+	uint32_t now = csp_get_ms();
+	list_cache_entry_t * entry = list_cache_lookup(node, now);
+	if (entry->node == node && (now - entry->downloaded_ms) < PROC_LIST_CACHE_TTL_MS) {
+		list_cache_hits++;
+		proc_mutex_give(list_cache_mutex);
+		return 0;
+	}
+	list_cache_misses++;
+
+	// Download without holding the mutex, so lists of other nodes can be served from the cache meanwhile
+	proc_mutex_give(list_cache_mutex);
+	if (param_list_download(node, PARAM_REMOTE_TIMEOUT_MS, 2, 1) < 0) {
+		return -1;
+	}
+	proc_param_index_sync();
+	proc_param_list_changed();  // The download may have replaced parameters that handles point to
+
+	if (proc_mutex_take(list_cache_mutex) != PROC_MUTEX_OK) {
+		return -1;
+	}
+	now = csp_get_ms();
+	entry = list_cache_lookup(node, now);
+	entry->node = node;
+	entry->downloaded_ms = now;
+	proc_mutex_give(list_cache_mutex);
+
+	return 0;
+}
+
+void proc_runtime_flush_list_cache(uint16_t node) {
+	if (proc_mutex_take(list_cache_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+	for (size_t i = 0; i < PROC_LIST_CACHE_SIZE; i++) {
+		if (node == 0 || list_cache[i].node == node) {
+			list_cache[i].node = 0;
+		}
+	}
+	proc_mutex_give(list_cache_mutex);
+
+	// Resolve handles again, so they pick up the list once it's downloaded again
+	proc_param_list_changed();
+}
+
+void proc_runtime_list_cache_stats(uint32_t * hits, uint32_t * misses) {
+	if (list_cache_mutex == NULL || proc_mutex_take(list_cache_mutex) != PROC_MUTEX_OK) {
+		*hits = 0;
+		*misses = 0;
+		return;
+	}
+	*hits = list_cache_hits;
+	*misses = list_cache_misses;
+	proc_mutex_give(list_cache_mutex);
+}
@@ -0,0 +1,137 @@
+// Hash index over the libparam list, keyed by (node, name)
+
+#include <string.h>
+
+#include <param/param.h>
+
+#include <csp_proc/proc_runtime.h>
+#include <csp_proc/proc_mutex.h>
+
+/**
+ * Open addressing table with linear probing. Entries are only ever added, or all removed at once by
+ * proc_param_index_clear, so no tombstones are needed.
+ */
+static param_t * param_index[PROC_PARAM_INDEX_SIZE];
+static size_t param_index_count = 0;
+static proc_mutex_t * param_index_mutex = NULL;
+
+int proc_param_index_init() {
+	if (param_index_mutex == NULL) {
+		param_index_mutex = proc_mutex_create();
+	}
+	return (param_index_mutex != NULL) ? 0 : -1;
+}
+
+static uint32_t param_index_hash(uint16_t node, const char * name) {
+	uint32_t hash = 2166136261U;  // FNV-1a
+	while (*name != '\0') {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619U;
+	}
+	hash ^= node;
+	hash *= 16777619U;
+	return hash;
+}
+
+/**
+ * Add a parameter to the index, unless it's already present or the index is full.
+ * Must be called with param_index_mutex taken.
+ */
+static void param_index_insert(param_t * param) {
+	if (param_index_count >= PROC_PARAM_INDEX_SIZE) {
+		return;
+	}
+
+	size_t slot = param_index_hash(param->node, param->name) % PROC_PARAM_INDEX_SIZE;
+	while (param_index[slot] != NULL) {
+		if (param_index[slot] == param) {
+			return;
+		}
+		slot = (slot + 1) % PROC_PARAM_INDEX_SIZE;
+	}
+	param_index[slot] = param;
+	param_index_count++;
+}
+
+/**
+ * Must be called with param_index_mutex taken.
+ */
+static param_t * param_index_lookup(uint16_t node, const char * name) {
+	size_t slot = param_index_hash(node, name) % PROC_PARAM_INDEX_SIZE;
+	for (size_t probes = 0; probes < PROC_PARAM_INDEX_SIZE && param_index[slot] != NULL; probes++) {
+		if (param_index[slot]->node == node && strcmp(param_index[slot]->name, name) == 0) {
+			return param_index[slot];
+		}
+		slot = (slot + 1) % PROC_PARAM_INDEX_SIZE;
+	}
+	return NULL;
+}
+
+/**
+ * Add any parameters of the libparam list that aren't indexed yet.
+ * Called when a lookup misses and after remote parameter lists are downloaded.
+ */
+void proc_param_index_sync() {
+	if (proc_mutex_take(param_index_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+
+	int inf_loop_guard = 0;
+	param_t * param;
+	param_list_iterator i = {};
+	while ((param = param_list_iterate(&i)) != NULL && (inf_loop_guard++ < 10000)) {
+		param_index_insert(param);
+	}
+
+	proc_mutex_give(param_index_mutex);
+}
+
+/**
+ * Remove all parameters from the index, e.g. because parameters may have been removed from the libparam list.
+ */
+void proc_param_index_clear() {
+	if (proc_mutex_take(param_index_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+	memset(param_index, 0, sizeof(param_index));
+	param_index_count = 0;
+	proc_mutex_give(param_index_mutex);
+}
+
+/**
+ * Check whether the index holds every parameter it has been offered.
+ * If it doesn't, a lookup miss doesn't prove the parameter is absent from the libparam list.
+ */
+int proc_param_index_is_full() {
+	return param_index_count >= PROC_PARAM_INDEX_SIZE;
+}
+
+/**
+ * Find a parameter by node and exact name. Parameters missing from the index are picked up from the
+ * libparam list before giving up.
+ *
+ * @param node The node of the parameter (0 for local parameters)
+ * @param name The name of the parameter without array index
+ * @return The parameter or NULL if it isn't in the libparam list (or couldn't be indexed)
+ */
+param_t * proc_param_index_find(uint16_t node, const char * name) {
+	if (proc_mutex_take(param_index_mutex) != PROC_MUTEX_OK) {
+		return NULL;
+	}
+	param_t * param = param_index_lookup(node, name);
+	proc_mutex_give(param_index_mutex);
+
+	if (param != NULL) {
+		return param;
+	}
+
+	proc_param_index_sync();
+
+	if (proc_mutex_take(param_index_mutex) != PROC_MUTEX_OK) {
+		return NULL;
+	}
+	param = param_index_lookup(node, name);
+	proc_mutex_give(param_index_mutex);
+
+	return param;
+}
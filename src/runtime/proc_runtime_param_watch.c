@@ -0,0 +1,216 @@
+// Change notifications for local parameters, used to wake block instructions instead of polling
+
+#include <param/param.h>
+
+#include <csp_proc/proc_runtime.h>
+#include <csp_proc/proc_analyze.h>
+#include <csp_proc/proc_mutex.h>
+
+// forward declarations
+void proc_param_changed();
+
+typedef struct {
+	param_t * param;  // NULL if the slot is free
+	void (*callback)(param_t * param, int offset);  // Callback of the parameter before it was watched
+	unsigned int refs;  // Waiting block instructions woken by the parameter
+} param_watch_t;
+
+static param_watch_t param_watches[PROC_PARAM_WATCH_MAX];
+static unsigned int param_watch_epoch = 1;
+static proc_mutex_t * param_watch_mutex = NULL;
+
+int proc_param_watch_init() {
+	if (param_watch_mutex == NULL) {
+		param_watch_mutex = proc_mutex_create();
+	}
+	return (param_watch_mutex != NULL) ? 0 : -1;
+}
+
+/**
+ * Must be called with param_watch_mutex taken.
+ */
+static param_watch_t * param_watch_find(param_t * param) {
+	for (size_t i = 0; i < PROC_PARAM_WATCH_MAX; i++) {
+		if (param_watches[i].param == param) {
+			return &param_watches[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Set hook installed on watched parameters.
+ * Calls the original callback of the parameter (if any) and wakes blocked procedures.
+ */
+static void param_watch_callback(param_t * param, int offset) {
+	void (*callback)(param_t * param, int offset) = NULL;
+
+	if (proc_mutex_take(param_watch_mutex) == PROC_MUTEX_OK) {
+		param_watch_t * watch = param_watch_find(param);
+		if (watch != NULL) {
+			callback = watch->callback;
+		} else if (param->callback != param_watch_callback) {
+			callback = param->callback;  // Unwatched while this set was under way, the original callback is restored
+		}
+		proc_mutex_give(param_watch_mutex);
+	}
+
+	// Called without the mutex, as the callback may set (watched) parameters itself
+	if (callback != NULL) {
+		callback(param, offset);
+	}
+
+	proc_param_changed();
+}
+
+/**
+ * Watch a local parameter for changes made through param_set, until it's unwatched as often as it was watched.
+ * The existing callback of the parameter is preserved and called before blocked procedures are woken.
+ *
+ * @param param The parameter to watch
+ * @return 0 on success, -1 if the parameter can't be watched (no free watch slots)
+ */
+static int proc_param_watch(param_t * param) {
+	param_watch_t * watch = param_watch_find(param);
+	if (watch == NULL) {
+		watch = param_watch_find(NULL);
+		if (watch == NULL) {
+			return -1;
+		}
+		watch->param = param;
+		watch->callback = (param->callback != param_watch_callback) ? param->callback : NULL;
+		watch->refs = 0;
+		param->callback = param_watch_callback;
+	}
+	watch->refs++;
+	return 0;
+}
+
+/**
+ * Drop a watch of a local parameter, restoring its original callback once no block instruction waits on it.
+ * Must be called with param_watch_mutex taken.
+ */
+static void proc_param_unwatch(param_t * param) {
+	param_watch_t * watch = param_watch_find(param);
+	if (watch == NULL || --watch->refs > 0) {
+		return;
+	}
+	if (param->callback == param_watch_callback) {
+		param->callback = watch->callback;
+	}
+	watch->param = NULL;
+}
+
+/**
+ * Drop all watches, restoring the original callbacks of the watched parameters still in the libparam list.
+ * Called by proc_runtime_invalidate_params, as watched parameters may have been removed from the list.
+ * Block instructions waiting on the dropped watches watch their parameters again on their next evaluation.
+ */
+void proc_param_unwatch_all() {
+	if (param_watch_mutex == NULL || proc_mutex_take(param_watch_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+
+	param_t * param;
+	param_list_iterator i = {};
+	while ((param = param_list_iterate(&i)) != NULL) {
+		if (param->callback == param_watch_callback) {
+			param_watch_t * watch = param_watch_find(param);
+			param->callback = (watch != NULL) ? watch->callback : NULL;
+		}
+	}
+
+	for (size_t j = 0; j < PROC_PARAM_WATCH_MAX; j++) {
+		param_watches[j].param = NULL;
+	}
+	param_watch_epoch++;
+
+	proc_mutex_give(param_watch_mutex);
+}
+
+/**
+ * Check whether a block instruction can wait for parameter changes instead of polling,
+ * i.e. its operands are local parameters or immediates, and start watching the parameters if so.
+ * Must be called after the condition has been evaluated, so the parameter operands have been resolved
+ * and the handles of immediates are the only ones without a parameter.
+ *
+ * @param state The state of the block instruction, holding the resolved parameter handles
+ * @param watches Set to the watched parameters, to be passed to proc_block_unwatch_operands once the block stops waiting
+ * @return 1 if the block can be event-driven, 0 if it must poll
+ */
+int proc_block_watch_operands(proc_instruction_state_t * state, proc_param_watches_t * watches) {
+	proc_param_handle_t * handles[] = {&state->handles.block.param_a, &state->handles.block.param_b};
+
+	int param_count = 0;
+	for (int k = 0; k < 2; k++) {
+		if (handles[k]->param != NULL) {
+			if (handles[k]->node != 0) {
+				return 0;
+			}
+			param_count++;
+		}
+	}
+	if (param_count == 0) {
+		return 0;  // A condition on immediates never changes
+	}
+
+	if (proc_mutex_take(param_watch_mutex) != PROC_MUTEX_OK) {
+		return 0;
+	}
+
+	int ret = 1;
+	*watches = (proc_param_watches_t){.epoch = param_watch_epoch};
+	for (int k = 0; k < 2; k++) {
+		if (handles[k]->param == NULL) {
+			continue;
+		}
+		if (proc_param_watch(handles[k]->param) != 0) {
+			if (k > 0 && watches->params[0] != NULL) {
+				proc_param_unwatch(watches->params[0]);
+			}
+			*watches = (proc_param_watches_t){};
+			ret = 0;
+			break;
+		}
+		watches->params[k] = handles[k]->param;
+	}
+
+	proc_mutex_give(param_watch_mutex);
+	return ret;
+}
+
+/**
+ * Stop watching the parameters of a block instruction that no longer waits, see proc_block_watch_operands.
+ *
+ * @param watches The watched parameters, cleared
+ */
+void proc_block_unwatch_operands(proc_param_watches_t * watches) {
+	if (proc_mutex_take(param_watch_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+
+	// Watches dropped by proc_param_unwatch_all are gone, and their parameters may be too
+	if (watches->epoch == param_watch_epoch) {
+		for (int k = 0; k < 2; k++) {
+			if (watches->params[k] != NULL) {
+				proc_param_unwatch(watches->params[k]);
+			}
+		}
+	}
+	*watches = (proc_param_watches_t){};
+
+	proc_mutex_give(param_watch_mutex);
+}
+
+/**
+ * Check whether the watches of a waiting block instruction have been dropped by proc_param_unwatch_all,
+ * in which case the block must watch its parameters again to be woken by their changes.
+ */
+int proc_block_watches_stale(proc_param_watches_t * watches) {
+	if (proc_mutex_take(param_watch_mutex) != PROC_MUTEX_OK) {
+		return 0;
+	}
+	int stale = (watches->epoch != param_watch_epoch);
+	proc_mutex_give(param_watch_mutex);
+	return stale;
+}
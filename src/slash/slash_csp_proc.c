@@ -20,10 +20,14 @@ Small enough to fit in a single CSP packet!
 	- List occupied procedure slots on node.
 - proc run <procedure slot> [node]
 	- Run the procedure in the specified slot.
+- proc cache <flush|stats> [node]
+	- Flush the remote parameter list cache of the runtime on node (all cached nodes, or only the one given with -r), or show its hit/miss counters.
 
-Additionally, this adds the following commands to handle control-flow and operations within procedures. Result is always a parameter stored on the node hosting the corresponding procedure server (node 0 from its perspective) - Except when using the `rmt` unop operation, where it's switched with [node]!
+Additionally, this adds the following commands to handle control-flow and operations within procedures. Result is always a parameter stored on the node hosting the corresponding procedure server (node 0 from its perspective) - Except when using the `rmt` unop operation, where it's switched with [node]! The operands of block, ifelse, if and binop may also be numeric constants, e.g. `proc ifelse a > 0`, and the operands and results of ifelse, if, unop and binop may be the scratch registers $r0 to $r15 of the procedure frame.
 - proc block <param a> <op> <param b> [node]
 	- Block execution of the procedure until the condition is met. <op> is one of: ==, !=, <, >, <=, >=
+	- The polling period starts at -p ms and grows by -b percent after each evaluation, up to -m ms. The block fails after -t ms. Omitted options use the runtime defaults.
+	- With -o, the condition is handed to the runtime on [node], which notifies the procedure host once it holds, instead of being polled.
 - proc ifelse <param a> <op> <param b> [node]
 	- Skip the next instruction if the condition is not met. Skip the next instruction after that if the condition is met. This instruction cannot be nested, i.e. the following two instructions cannot be ifelse. <op> is one of: ==, !=, <, >, <=, >=
 - proc noop
@@ -42,11 +46,14 @@ Additionally, this adds the following commands to handle control-flow and operat
 // TODO: implement functionality to add new parameters with `set`?
 // TODO: mark certain procedures to be run on boot? (to handle mid-flight reboots)
 // TODO: better / more comprehensive ACK?
-// TODO: configure things like exponential backoff for block instruction?
 // TODO: not quite a guarantee that procedures will fit in a single CSP packet, mainly because of the char* parameters. Can test with `proc size` to verify before pushing. Might have to support splitting procedures across multiple packets. Can char* arrays be compressed/referenced in a table sent separately? otherwise csp_sfp_send maybe?
 
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <slash/slash.h>
@@ -126,6 +133,109 @@ const char * binary_op_str[] = {
 	"^",   // OP_XOR
 };
 
+/**
+ * Parse a parameter argument with an optional array index (e.g. "param[2]") into an operand,
+ * so the index doesn't have to be parsed from the name by the runtime. "$r0" to "$r15" are scratch
+ * registers; the "$" prefix can't appear in parameter names, so registers never shadow a parameter.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int parse_operand(const char * arg, proc_operand_t * operand) {
+	operand->offset = -1;
+	if (arg[0] == '$') {
+		char * end = "";
+		unsigned long number = PROC_REGISTER_COUNT;
+		if (arg[1] == 'r' && isdigit((unsigned char)arg[2])) {
+			number = strtoul(arg + 2, &end, 10);
+		}
+		if (number >= PROC_REGISTER_COUNT || *end != '\0') {
+			printf("Invalid register %s, expected $r0 to $r%d\n", arg, PROC_REGISTER_COUNT - 1);
+			return -1;
+		}
+		operand->name = NULL;
+		operand->kind = PROC_OPERAND_REGISTER;
+		operand->value.u = number;
+		return 0;
+	}
+
+	operand->kind = PROC_OPERAND_PARAM;
+	operand->name = proc_strdup(arg);
+	if (operand->name == NULL) {
+		printf("Failed to allocate memory for parameter %s\n", arg);
+		return -1;
+	}
+
+	char * index_start = strchr(operand->name, '[');
+	if (index_start == NULL) {
+		return 0;
+	}
+
+	char * index_end;
+	long offset = strtol(index_start + 1, &index_end, 10);
+	if (index_end == index_start + 1 || strcmp(index_end, "]") != 0 || offset < 0 || offset > INT16_MAX) {
+		printf("Invalid array index in parameter %s\n", arg);
+		proc_free(operand->name);
+		return -1;
+	}
+
+	*index_start = '\0';
+	operand->offset = (int16_t)offset;
+	return 0;
+}
+
+/**
+ * Parse a comparison or binary operation operand, which is either a numeric constant or a parameter (see parse_operand).
+ * Constants with a decimal point or exponent are floating point, constants with a sign are signed, and other constants
+ * are unsigned.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int parse_value_operand(const char * arg, proc_operand_t * operand) {
+	if (!isdigit((unsigned char)arg[0]) && !((arg[0] == '-' || arg[0] == '+' || arg[0] == '.') && isdigit((unsigned char)arg[1]))) {
+		return parse_operand(arg, operand);
+	}
+
+	char * end;
+	operand->name = NULL;
+	operand->offset = -1;
+	errno = 0;
+	if (strpbrk(arg, ".eE") != NULL && strncmp(arg, "0x", 2) != 0 && strncmp(arg, "0X", 2) != 0) {
+		operand->kind = PROC_OPERAND_FLOAT;
+		operand->value.f = strtod(arg, &end);
+	} else if (arg[0] == '-' || arg[0] == '+') {
+		operand->kind = PROC_OPERAND_INT;
+		operand->value.i = strtoll(arg, &end, 0);
+	} else {
+		operand->kind = PROC_OPERAND_UINT;
+		operand->value.u = strtoull(arg, &end, 0);
+	}
+	if (*end != '\0' || errno == ERANGE) {
+		printf("Invalid constant %s\n", arg);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Format an operand as it was given on the command line, e.g. "param[2]", "-5" or "$r3".
+ */
+char * operand_str(proc_operand_t * operand, char * buf, size_t buf_size) {
+	if (operand->kind == PROC_OPERAND_REGISTER) {
+		snprintf(buf, buf_size, "$r%" PRIu64, operand->value.u);
+	} else if (operand->kind == PROC_OPERAND_UINT) {
+		snprintf(buf, buf_size, "%" PRIu64, operand->value.u);
+	} else if (operand->kind == PROC_OPERAND_INT) {
+		snprintf(buf, buf_size, "%" PRId64, operand->value.i);
+	} else if (operand->kind == PROC_OPERAND_FLOAT) {
+		snprintf(buf, buf_size, "%g", operand->value.f);
+	} else if (operand->offset < 0) {
+		snprintf(buf, buf_size, "%s", operand->name);
+	} else {
+		snprintf(buf, buf_size, "%s[%d]", operand->name, operand->offset);
+	}
+	return buf;
+}
+
 int instruction_can_be_added() {
 	if (current_procedure == NULL) {
 		printf("No active procedure. Use 'proc new' to create one.\n");
@@ -383,29 +493,66 @@ int proc_list(struct slash * slash) {
 	printf("Current procedure contains the following %d instruction(s):\n", current_procedure->instruction_count);
 	for (int i = 0; i < current_procedure->instruction_count; i++) {
 		proc_instruction_t instruction = current_procedure->instructions[i];
+		char a[64], b[64], c[64];
 		printf("%d:\t", i);
 		switch (instruction.type) {
 			case PROC_BLOCK:
-				printf("[node %d]\tblock : %s %s %s\n", instruction.node, instruction.instruction.block.param_a, comparison_op_str[instruction.instruction.block.op], instruction.instruction.block.param_b);
+				printf("[node %d]\tblock : %s %s %s", instruction.node, operand_str(&instruction.instruction.block.param_a, a, sizeof(a)), comparison_op_str[instruction.instruction.block.op], operand_str(&instruction.instruction.block.param_b, b, sizeof(b)));
+				if (instruction.instruction.block.offload) {
+					printf(" (offloaded)");
+				}
+				if (instruction.instruction.block.min_period_ms != 0 || instruction.instruction.block.max_period_ms != 0 || instruction.instruction.block.backoff_percent != 0 || instruction.instruction.block.timeout_ms != 0) {
+					printf(" (period %u-%u ms, backoff %u%%, timeout %u ms; 0 = default)", (unsigned int)instruction.instruction.block.min_period_ms, (unsigned int)instruction.instruction.block.max_period_ms, (unsigned int)instruction.instruction.block.backoff_percent, (unsigned int)instruction.instruction.block.timeout_ms);
+				}
+				printf("\n");
 				break;
 			case PROC_IFELSE:
-				printf("[node %d]\tifelse: %s %s %s\n", instruction.node, instruction.instruction.ifelse.param_a, comparison_op_str[instruction.instruction.ifelse.op], instruction.instruction.ifelse.param_b);
+				printf("[node %d]\tifelse: %s %s %s\n", instruction.node, operand_str(&instruction.instruction.ifelse.param_a, a, sizeof(a)), comparison_op_str[instruction.instruction.ifelse.op], operand_str(&instruction.instruction.ifelse.param_b, b, sizeof(b)));
 				break;
 			case PROC_NOOP:
 				printf("-\t\tnoop\n");
 				break;
+			case PROC_IF:
+				printf("[node %d]\tif    : %s %s %s\n", instruction.node, operand_str(&instruction.instruction.ifelse.param_a, a, sizeof(a)), comparison_op_str[instruction.instruction.ifelse.op], operand_str(&instruction.instruction.ifelse.param_b, b, sizeof(b)));
+				break;
+			case PROC_ELSE:
+				printf("-\t\telse\n");
+				break;
+			case PROC_ENDIF:
+				printf("-\t\tendif\n");
+				break;
 			case PROC_SET:
-				printf("[node %d]\tset   : %s = %s\n", instruction.node, instruction.instruction.set.param, instruction.instruction.set.value);
+				printf("[node %d]\tset   : %s = %s\n", instruction.node, operand_str(&instruction.instruction.set.param, a, sizeof(a)), instruction.instruction.set.value);
 				break;
 			case PROC_UNOP:
-				printf("[node %d]\tunop  : %s = %s(%s)\n", instruction.node, instruction.instruction.unop.result, unary_op_str[instruction.instruction.unop.op], instruction.instruction.unop.param);
+				printf("[node %d]\tunop  : %s = %s(%s)\n", instruction.node, operand_str(&instruction.instruction.unop.result, a, sizeof(a)), unary_op_str[instruction.instruction.unop.op], operand_str(&instruction.instruction.unop.param, b, sizeof(b)));
 				break;
 			case PROC_BINOP:
-				printf("[node %d]\tbinop : %s = %s %s %s\n", instruction.node, instruction.instruction.binop.result, instruction.instruction.binop.param_a, binary_op_str[instruction.instruction.binop.op], instruction.instruction.binop.param_b);
+				printf("[node %d]\tbinop : %s = %s %s %s\n", instruction.node, operand_str(&instruction.instruction.binop.result, a, sizeof(a)), operand_str(&instruction.instruction.binop.param_a, b, sizeof(b)), binary_op_str[instruction.instruction.binop.op], operand_str(&instruction.instruction.binop.param_b, c, sizeof(c)));
 				break;
 			case PROC_CALL:
 				printf("[node %d]\tcall  : %d\n", instruction.node, instruction.instruction.call.procedure_slot);
 				break;
+			case PROC_JUMP:
+				printf(instruction.instruction.jump.relative ? "-\t\tjump  : %+d\n" : "-\t\tjump  : %d\n", instruction.instruction.jump.target);
+				break;
+			case PROC_SWITCH:
+				printf("[node %d]\tswitch: %s", instruction.node, operand_str(&instruction.instruction.switch_.param, a, sizeof(a)));
+				for (int j = 0; j < instruction.instruction.switch_.case_count; j++) {
+					printf(" %ld:%d", (long)instruction.instruction.switch_.cases[j].value, instruction.instruction.switch_.cases[j].target);
+				}
+				printf(" (default %d)\n", instruction.instruction.switch_.default_target);
+				break;
+			case PROC_LOOP:
+				printf("-\t\tloop  : %d", instruction.instruction.loop.target);
+				if (instruction.instruction.loop.count != 0) {
+					printf(" x%u", (unsigned int)instruction.instruction.loop.count);
+				}
+				if (instruction.instruction.loop.period_ms != 0) {
+					printf(" (period %u ms)", (unsigned int)instruction.instruction.loop.period_ms);
+				}
+				printf("\n");
+				break;
 			default:
 				printf("Unknown instruction type %d\n", instruction.type);
 				break;
@@ -488,28 +635,101 @@ int proc_run(struct slash * slash) {
 		return SLASH_EINVAL;
 	}
 
-	int ret = proc_run_request(proc_slot, node, timeout);
+	proc_run_status_e status;
+	int ret = proc_run_request_status(proc_slot, &status, node, timeout);
 	if (ret != 0) {
 		printf("Failed to run procedure in slot %d on node %d with return code %d\n", proc_slot, node, ret);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	printf("Running procedure in slot %d on node %d\n", proc_slot, node);
+	if (status == PROC_RUN_COMPLETED) {
+		printf("Ran procedure in slot %d on node %d to completion\n", proc_slot, node);
+	} else {
+		printf("Running procedure in slot %d on node %d\n", proc_slot, node);
+	}
 
 	optparse_del(parser);
 	return SLASH_SUCCESS;
 }
 slash_command_sub(proc, run, proc_run, "<procedure slot> [node]", "");
 
+int proc_cache(struct slash * slash) {
+	unsigned int node = slash_dfl_node;
+	unsigned int timeout = slash_dfl_timeout;
+	unsigned int remote_node = 0;
+
+	optparse_t * parser = optparse_new("proc cache", "<flush|stats> [node]");
+	optparse_add_help(parser);
+	optparse_add_unsigned(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_unsigned(parser, 't', "timeout", "NUM", 0, &timeout, "timeout (default = <env>)");
+	optparse_add_unsigned(parser, 'r', "remote", "NUM", 0, &remote_node, "only flush the list cached for this remote node (default = all)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("Argument <flush|stats> required\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	proc_cache_op_e op;
+	if (strcmp(slash->argv[argi], "flush") == 0) {
+		op = PROC_CACHE_FLUSH;
+	} else if (strcmp(slash->argv[argi], "stats") == 0) {
+		op = PROC_CACHE_STATS;
+	} else {
+		printf("Unknown cache operation %s\n", slash->argv[argi]);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi < slash->argc) {
+		node = atoi(slash->argv[argi]);
+	}
+
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	int ret = proc_cache_request(op, remote_node, &hits, &misses, node, timeout);
+	if (ret != 0) {
+		printf("Failed cache request on node %d with return code %d\n", node, ret);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (op == PROC_CACHE_FLUSH) {
+		printf("Flushed parameter list cache on node %d\n", node);
+	}
+	printf("Parameter list cache on node %d: %u hits, %u misses\n", node, hits, misses);
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(proc, cache, proc_cache, "<flush|stats> [node]", "");
+
 int proc_block(struct slash * slash) {
 	unsigned int node = slash_dfl_node;
 	if (!instruction_can_be_added()) {
 		return SLASH_EINVAL;
 	}
 
+	unsigned int min_period_ms = 0;
+	unsigned int max_period_ms = 0;
+	unsigned int backoff_percent = 0;
+	unsigned int timeout_ms = 0;
+	int offload = 0;
+
 	optparse_t * parser = optparse_new("proc block", "<param a> <op> <param b> [node]");
 	optparse_add_help(parser);
 	optparse_add_unsigned(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_unsigned(parser, 'p', "period", "NUM", 0, &min_period_ms, "initial polling period in ms (default = runtime default)");
+	optparse_add_unsigned(parser, 'm', "max-period", "NUM", 0, &max_period_ms, "maximum polling period in ms (default = runtime default)");
+	optparse_add_unsigned(parser, 'b', "backoff", "NUM", 0, &backoff_percent, "polling period after each evaluation in percent of the previous one, e.g. 200 to double it (default = runtime default)");
+	optparse_add_unsigned(parser, 't', "timeout", "NUM", 0, &timeout_ms, "timeout in ms (default = runtime default)");
+	optparse_add_set(parser, 'o', "offload", 1, &offload, "evaluate the condition on [node] and get notified once it holds, instead of polling it");
 
 	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
 	if (argi < 0) {
@@ -522,16 +742,22 @@ int proc_block(struct slash * slash) {
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param_a = proc_strdup(slash->argv[argi]);
+	proc_operand_t param_a;
+	if (parse_value_operand(slash->argv[argi], &param_a) != 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
 
 	if (++argi >= slash->argc) {
 		printf("Argument <op> (char*) required\n");
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
 	int _parsed_op = parse_comparison_op_enum(slash->argv[argi]);
 	if (_parsed_op == -1) {
 		printf("Invalid comparison operator: %s\n", slash->argv[argi]);
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
@@ -539,22 +765,37 @@ int proc_block(struct slash * slash) {
 
 	if (++argi >= slash->argc) {
 		printf("Argument <param b> (char*) required\n");
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param_b = proc_strdup(slash->argv[argi]);
-
-	if (param_a == NULL || param_b == NULL) {
-		printf("Failed to allocate memory for parameters\n");
+	proc_operand_t param_b;
+	if (parse_value_operand(slash->argv[argi], &param_b) != 0) {
+		proc_free(param_a.name);
 		optparse_del(parser);
-		return SLASH_ENOMEM;
+		return SLASH_EINVAL;
+	}
+	if (param_a.kind == PROC_OPERAND_REGISTER || param_b.kind == PROC_OPERAND_REGISTER) {
+		printf("Block conditions can't use registers\n");
+		proc_free(param_a.name);
+		proc_free(param_b.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
 	}
 
 	if (++argi < slash->argc) {
 		node = atoi(slash->argv[argi]);
 	}
 
-	proc_block_t block = {param_a, op, param_b};
+	if (backoff_percent > UINT16_MAX) {
+		printf("Backoff must be at most %u%%\n", UINT16_MAX);
+		proc_free(param_a.name);
+		proc_free(param_b.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	proc_block_t block = {param_a, op, param_b, min_period_ms, max_period_ms, (uint16_t)backoff_percent, timeout_ms, (uint8_t)offload};
 
 	proc_instruction_t proc_instruction;
 	proc_instruction.node = node;
@@ -592,16 +833,22 @@ int proc_ifelse(struct slash * slash) {
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param_a = proc_strdup(slash->argv[argi]);
+	proc_operand_t param_a;
+	if (parse_value_operand(slash->argv[argi], &param_a) != 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
 
 	if (++argi >= slash->argc) {
 		printf("Argument <op> (char*) required\n");
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
 	int _parsed_op = parse_comparison_op_enum(slash->argv[argi]);
 	if (_parsed_op == -1) {
 		printf("Invalid comparison operator: %s\n", slash->argv[argi]);
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
@@ -609,15 +856,15 @@ int proc_ifelse(struct slash * slash) {
 
 	if (++argi >= slash->argc) {
 		printf("Argument <param b> (char*) required\n");
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param_b = proc_strdup(slash->argv[argi]);
-
-	if (param_a == NULL || param_b == NULL) {
-		printf("Failed to allocate memory for parameters\n");
+	proc_operand_t param_b;
+	if (parse_value_operand(slash->argv[argi], &param_b) != 0) {
+		proc_free(param_a.name);
 		optparse_del(parser);
-		return SLASH_ENOMEM;
+		return SLASH_EINVAL;
 	}
 
 	if (++argi < slash->argc) {
@@ -641,6 +888,138 @@ int proc_ifelse(struct slash * slash) {
 }
 slash_command_sub(proc, ifelse, proc_ifelse, "<param a> <op> <param b> [node]", "");
 
+int proc_if(struct slash * slash) {
+	unsigned int node = slash_dfl_node;
+	if (!instruction_can_be_added()) {
+		return SLASH_EINVAL;
+	}
+
+	optparse_t * parser = optparse_new("proc if", "<param a> <op> <param b> [node]");
+	optparse_add_help(parser);
+	optparse_add_unsigned(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("Argument <param a> (char*) required\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	proc_operand_t param_a;
+	if (parse_value_operand(slash->argv[argi], &param_a) != 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("Argument <op> (char*) required\n");
+		proc_free(param_a.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	int _parsed_op = parse_comparison_op_enum(slash->argv[argi]);
+	if (_parsed_op == -1) {
+		printf("Invalid comparison operator: %s\n", slash->argv[argi]);
+		proc_free(param_a.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	comparison_op_t op = (comparison_op_t)_parsed_op;
+
+	if (++argi >= slash->argc) {
+		printf("Argument <param b> (char*) required\n");
+		proc_free(param_a.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	proc_operand_t param_b;
+	if (parse_value_operand(slash->argv[argi], &param_b) != 0) {
+		proc_free(param_a.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi < slash->argc) {
+		node = atoi(slash->argv[argi]);
+	}
+
+	proc_ifelse_t condition = {param_a, op, param_b};
+
+	proc_instruction_t proc_instruction;
+	proc_instruction.node = node;
+	proc_instruction.type = PROC_IF;
+	proc_instruction.instruction.ifelse = condition;
+
+	current_procedure->instructions[current_procedure->instruction_count] = proc_instruction;
+	current_procedure->instruction_count++;
+
+	printf("Added if instruction to procedure\n");
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(proc, if, proc_if, "<param a> <op> <param b> [node]", "");
+
+int proc_else(struct slash * slash) {
+	if (!instruction_can_be_added()) {
+		return SLASH_EINVAL;
+	}
+
+	optparse_t * parser = optparse_new("proc else", "");
+	optparse_add_help(parser);
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	proc_instruction_t proc_instruction;
+	proc_instruction.node = 0;
+	proc_instruction.type = PROC_ELSE;
+
+	current_procedure->instructions[current_procedure->instruction_count] = proc_instruction;
+	current_procedure->instruction_count++;
+
+	printf("Added else instruction to procedure\n");
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(proc, else, proc_else, "", "");
+
+int proc_endif(struct slash * slash) {
+	if (!instruction_can_be_added()) {
+		return SLASH_EINVAL;
+	}
+
+	optparse_t * parser = optparse_new("proc endif", "");
+	optparse_add_help(parser);
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	proc_instruction_t proc_instruction;
+	proc_instruction.node = 0;
+	proc_instruction.type = PROC_ENDIF;
+
+	current_procedure->instructions[current_procedure->instruction_count] = proc_instruction;
+	current_procedure->instruction_count++;
+
+	printf("Added endif instruction to procedure\n");
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(proc, endif, proc_endif, "", "");
+
 int proc_noop(struct slash * slash) {
 	if (!instruction_can_be_added()) {
 		return SLASH_EINVAL;
@@ -690,17 +1069,29 @@ int proc_set(struct slash * slash) {
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param = proc_strdup(slash->argv[argi]);
+	proc_operand_t param;
+	if (parse_operand(slash->argv[argi], &param) != 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	if (param.kind == PROC_OPERAND_REGISTER) {
+		printf("Argument <param> must be a parameter, not a register\n");
+		proc_free(param.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
 
 	if (++argi >= slash->argc) {
 		printf("Argument <value> (char*) required\n");
+		proc_free(param.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
 	char * value = proc_strdup(slash->argv[argi]);
 
-	if (param == NULL || value == NULL) {
+	if (value == NULL) {
 		printf("Failed to allocate memory for parameters\n");
+		proc_free(param.name);
 		optparse_del(parser);
 		return SLASH_ENOMEM;
 	}
@@ -747,31 +1138,38 @@ int proc_unop(struct slash * slash) {
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param = proc_strdup(slash->argv[argi]);
+	proc_operand_t param;
+	if (parse_operand(slash->argv[argi], &param) != 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
 
 	if (++argi >= slash->argc) {
 		printf("Argument <op> (char*) required\n");
+		proc_free(param.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
 	int _parsed_op = parse_unary_op_enum(slash->argv[argi]);
 	if (_parsed_op == -1) {
 		printf("Invalid unary operator: %s\n", slash->argv[argi]);
+		proc_free(param.name);
+		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
 	unary_op_t op = (unary_op_t)_parsed_op;
 
 	if (++argi >= slash->argc) {
 		printf("Argument <result> (char*) required\n");
+		proc_free(param.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * result = proc_strdup(slash->argv[argi]);
-
-	if (param == NULL || result == NULL) {
-		printf("Failed to allocate memory for parameters\n");
+	proc_operand_t result;
+	if (parse_operand(slash->argv[argi], &result) != 0) {
+		proc_free(param.name);
 		optparse_del(parser);
-		return SLASH_ENOMEM;
+		return SLASH_EINVAL;
 	}
 
 	if (++argi < slash->argc) {
@@ -816,16 +1214,22 @@ int proc_binop(struct slash * slash) {
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param_a = proc_strdup(slash->argv[argi]);
+	proc_operand_t param_a;
+	if (parse_value_operand(slash->argv[argi], &param_a) != 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
 
 	if (++argi >= slash->argc) {
 		printf("Argument <op> (char*) required\n");
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
 	int _parsed_op = parse_binary_op_enum(slash->argv[argi]);
 	if (_parsed_op == -1) {
 		printf("Invalid binary operator: %s\n", slash->argv[argi]);
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
@@ -833,22 +1237,30 @@ int proc_binop(struct slash * slash) {
 
 	if (++argi >= slash->argc) {
 		printf("Argument <param b> (char*) required\n");
+		proc_free(param_a.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	proc_operand_t param_b;
+	if (parse_value_operand(slash->argv[argi], &param_b) != 0) {
+		proc_free(param_a.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * param_b = proc_strdup(slash->argv[argi]);
 
 	if (++argi >= slash->argc) {
 		printf("Argument <result> (char*) required\n");
+		proc_free(param_a.name);
+		proc_free(param_b.name);
 		optparse_del(parser);
 		return SLASH_EINVAL;
 	}
-	char * result = proc_strdup(slash->argv[argi]);
-
-	if (param_a == NULL || param_b == NULL || result == NULL) {
-		printf("Failed to allocate memory for parameters\n");
+	proc_operand_t result;
+	if (parse_operand(slash->argv[argi], &result) != 0) {
+		proc_free(param_a.name);
+		proc_free(param_b.name);
 		optparse_del(parser);
-		return SLASH_ENOMEM;
+		return SLASH_EINVAL;
 	}
 
 	if (++argi < slash->argc) {
@@ -915,3 +1327,188 @@ int proc_call(struct slash * slash) {
 	return SLASH_SUCCESS;
 }
 slash_command_sub(proc, call, proc_call, "<procedure slot> [node]", "");
+
+int proc_jump(struct slash * slash) {
+	unsigned int relative = 0;
+	if (!instruction_can_be_added()) {
+		return SLASH_EINVAL;
+	}
+
+	optparse_t * parser = optparse_new("proc jump", "<target>");
+	optparse_add_help(parser);
+	optparse_add_set(parser, 'r', "relative", 1, &relative, "target is an offset from the jump instruction");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("Argument <target> (int16_t) required\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	int16_t target = (int16_t)atoi(slash->argv[argi]);
+
+	proc_jump_t jump = {target, (uint8_t)relative};
+
+	proc_instruction_t proc_instruction;
+	proc_instruction.node = 0;
+	proc_instruction.type = PROC_JUMP;
+	proc_instruction.instruction.jump = jump;
+
+	current_procedure->instructions[current_procedure->instruction_count] = proc_instruction;
+	current_procedure->instruction_count++;
+
+	printf("Added jump instruction to procedure\n");
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(proc, jump, proc_jump, "<target>", "");
+
+int proc_loop(struct slash * slash) {
+	unsigned int count = 0;
+	unsigned int period_ms = 0;
+	if (!instruction_can_be_added()) {
+		return SLASH_EINVAL;
+	}
+
+	optparse_t * parser = optparse_new("proc loop", "<target> [count]");
+	optparse_add_help(parser);
+	optparse_add_unsigned(parser, 'p', "period", "NUM", 0, &period_ms, "wait in ms after each iteration (default = 0)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("Argument <target> (uint8_t) required\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	uint8_t target = (uint8_t)atoi(slash->argv[argi]);
+
+	if (++argi < slash->argc) {
+		count = strtoul(slash->argv[argi], NULL, 0);
+	}
+
+	if (target > current_procedure->instruction_count) {
+		printf("Loop target must not follow the loop instruction\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	proc_loop_t loop = {target, count, period_ms};
+
+	proc_instruction_t proc_instruction;
+	proc_instruction.node = 0;
+	proc_instruction.type = PROC_LOOP;
+	proc_instruction.instruction.loop = loop;
+
+	current_procedure->instructions[current_procedure->instruction_count] = proc_instruction;
+	current_procedure->instruction_count++;
+
+	printf("Added loop instruction to procedure\n");
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(proc, loop, proc_loop, "<target> [count]", "");
+
+int proc_switch(struct slash * slash) {
+	unsigned int node = slash_dfl_node;
+	unsigned int default_target = 0;
+	if (!instruction_can_be_added()) {
+		return SLASH_EINVAL;
+	}
+	default_target = current_procedure->instruction_count + 1;  // Continue with the next instruction
+
+	optparse_t * parser = optparse_new("proc switch", "<param> <value:target>... [node]");
+	optparse_add_help(parser);
+	optparse_add_unsigned(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_unsigned(parser, 'd', "default", "NUM", 0, &default_target, "target if no case matches (default = next instruction)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **)slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("Argument <param> (char*) required\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	proc_operand_t param;
+	if (parse_operand(slash->argv[argi], &param) != 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+	if (param.kind == PROC_OPERAND_REGISTER) {
+		printf("Argument <param> must be a parameter, not a register\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	proc_switch_case_t * cases = proc_calloc(slash->argc, sizeof(proc_switch_case_t));
+	if (cases == NULL) {
+		printf("Error allocating memory for switch cases\n");
+		proc_free(param.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	// Cases are kept sorted by value, as required by the runtime
+	int case_count = 0;
+	while (++argi < slash->argc) {
+		char * separator = strchr(slash->argv[argi], ':');
+		if (separator == NULL) {
+			node = atoi(slash->argv[argi]);
+			break;
+		}
+
+		proc_switch_case_t switch_case = {(int32_t)strtol(slash->argv[argi], NULL, 0), (uint8_t)atoi(separator + 1)};
+		int j = case_count;
+		while (j > 0 && cases[j - 1].value > switch_case.value) {
+			cases[j] = cases[j - 1];
+			j--;
+		}
+		if (j > 0 && cases[j - 1].value == switch_case.value) {
+			printf("Duplicate switch case %ld\n", (long)switch_case.value);
+			proc_free(cases);
+			proc_free(param.name);
+			optparse_del(parser);
+			return SLASH_EINVAL;
+		}
+		cases[j] = switch_case;
+		case_count++;
+	}
+
+	if (case_count == 0) {
+		printf("Argument <value:target> required\n");
+		proc_free(cases);
+		proc_free(param.name);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	proc_switch_t switch_ = {param, (uint8_t)default_target, (uint8_t)case_count, cases};
+
+	proc_instruction_t proc_instruction;
+	proc_instruction.node = node;
+	proc_instruction.type = PROC_SWITCH;
+	proc_instruction.instruction.switch_ = switch_;
+
+	current_procedure->instructions[current_procedure->instruction_count] = proc_instruction;
+	current_procedure->instruction_count++;
+
+	printf("Added switch instruction to procedure\n");
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(proc, switch, proc_switch, "<param> <value:target>... [node]", "");
@@ -1,18 +1,67 @@
+#include <stdio.h>
+
 #include <csp_proc/proc_store.h>
 #include <csp_proc/proc_mutex.h>
 #include <csp_proc/proc_memory.h>
+#include <csp_proc/proc_runtime.h>
+
+/**
+ * Immutable procedure stored in a slot. Replacing or deleting the procedure of a slot installs another
+ * snapshot (or none), so references taken with get_proc_ref stay valid until they're released.
+ */
+typedef struct {
+	proc_t proc;  // First, so references can be converted back to their snapshot
+	int refs;     // The slot holding the snapshot, plus references taken with get_proc_ref, 0 if free
+} proc_snapshot_t;
+
+// Every slot can hold a snapshot while PROC_STORE_SPARE_SNAPSHOTS replaced ones are still referenced by runs
+static proc_snapshot_t snapshot_pool[MAX_PROC_SLOT + 1 + PROC_STORE_SPARE_SNAPSHOTS] = {0};
 
-proc_t proc_store[MAX_PROC_SLOT + 1] = {0};
+proc_snapshot_t * proc_store[MAX_PROC_SLOT + 1] = {0};
 proc_mutex_t * proc_store_mutex = NULL;
 
+/**
+ * Drop a reference to a snapshot, returning it to the pool once unreferenced.
+ * Must be called with proc_store_mutex taken.
+ */
+static void snapshot_unref(proc_snapshot_t * snapshot) {
+	if (--snapshot->refs > 0) {
+		return;
+	}
+	for (int i = 0; i < snapshot->proc.instruction_count; i++) {
+		proc_free_instruction(&snapshot->proc.instructions[i]);
+	}
+	snapshot->proc.instruction_count = 0;
+}
+
+/**
+ * Must be called with proc_store_mutex taken.
+ */
+static proc_snapshot_t * snapshot_alloc() {
+	for (size_t i = 0; i < sizeof(snapshot_pool) / sizeof(snapshot_pool[0]); i++) {
+		if (snapshot_pool[i].refs == 0) {
+			return &snapshot_pool[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Must be called with proc_store_mutex taken.
+ */
+static proc_snapshot_t * slot_snapshot(uint8_t slot) {
+	proc_snapshot_t * snapshot = proc_store[slot];
+	return (snapshot != NULL && snapshot->proc.instruction_count > 0) ? snapshot : NULL;
+}
+
 int _delete_proc(uint8_t slot) {
 	if (slot < 0 || slot > MAX_PROC_SLOT) {
 		return -1;
 	}
-	for (int i = 0; i < proc_store[slot].instruction_count; i++) {
-		proc_free_instruction(&proc_store[slot].instructions[i]);
+	if (proc_store[slot] != NULL) {
+		snapshot_unref(proc_store[slot]);
+		proc_store[slot] = NULL;
 	}
-	proc_store[slot].instruction_count = 0;
 	return 0;
 }
 
@@ -22,6 +71,10 @@ int delete_proc(uint8_t slot) {
 	}
 	int ret = _delete_proc(slot);
 	proc_mutex_give(proc_store_mutex);
+
+	if (ret == 0 && proc_runtime_invalidate_slot != NULL) {
+		proc_runtime_invalidate_slot(slot);
+	}
 	return ret;
 }
 
@@ -33,6 +86,10 @@ void reset_proc_store() {
 		_delete_proc(i);
 	}
 	proc_mutex_give(proc_store_mutex);
+
+	for (int i = 0; i < MAX_PROC_SLOT + 1 && proc_runtime_invalidate_slot != NULL; i++) {
+		proc_runtime_invalidate_slot(i);
+	}
 }
 
 int proc_store_init() {
@@ -52,16 +109,24 @@ int set_proc(proc_t * proc, uint8_t slot, int overwrite) {
 	}
 
 	int ret = -1;
-	if (proc_store[slot].instruction_count == 0) {
-		_delete_proc(slot);
-		proc_store[slot] = *proc;
-		ret = slot;
-	} else if (overwrite) {
-		_delete_proc(slot);
-		proc_store[slot] = *proc;
-		ret = slot;
+	if (slot_snapshot(slot) == NULL || overwrite) {
+		// Runs holding the current snapshot aren't affected by the swap
+		proc_snapshot_t * snapshot = snapshot_alloc();
+		if (snapshot == NULL) {
+			printf("No free procedure snapshot, increase PROC_STORE_SPARE_SNAPSHOTS\n");
+		} else {
+			snapshot->proc = *proc;
+			snapshot->refs = 1;
+			_delete_proc(slot);
+			proc_store[slot] = snapshot;
+			ret = slot;
+		}
 	}
 	proc_mutex_give(proc_store_mutex);
+
+	if (ret >= 0 && proc_runtime_invalidate_slot != NULL) {
+		proc_runtime_invalidate_slot(slot);
+	}
 	return ret;
 }
 
@@ -74,13 +139,36 @@ proc_t * get_proc(uint8_t slot) {
 		return PROC_MUTEX_ERR;
 	}
 
-	if (proc_store[slot].instruction_count == 0) {
-		proc_mutex_give(proc_store_mutex);
+	proc_snapshot_t * snapshot = slot_snapshot(slot);
+
+	proc_mutex_give(proc_store_mutex);
+	return (snapshot != NULL) ? &snapshot->proc : NULL;
+}
+
+proc_t * get_proc_ref(uint8_t slot) {
+	if (slot < 0 || slot > MAX_PROC_SLOT) {
 		return NULL;
 	}
 
+	if (proc_mutex_take(proc_store_mutex) != PROC_MUTEX_OK) {
+		return NULL;
+	}
+
+	proc_snapshot_t * snapshot = slot_snapshot(slot);
+	if (snapshot != NULL) {
+		snapshot->refs++;
+	}
+
+	proc_mutex_give(proc_store_mutex);
+	return (snapshot != NULL) ? &snapshot->proc : NULL;
+}
+
+void put_proc(proc_t * proc) {
+	if (proc == NULL || proc_mutex_take(proc_store_mutex) != PROC_MUTEX_OK) {
+		return;
+	}
+	snapshot_unref((proc_snapshot_t *)proc);
 	proc_mutex_give(proc_store_mutex);
-	return &proc_store[slot];
 }
 
 int * get_proc_slots() {
@@ -91,7 +179,7 @@ int * get_proc_slots() {
 		return NULL;
 	}
 	for (int i = 0; i < MAX_PROC_SLOT + 1; i++) {
-		if (proc_store[i].instruction_count > 0) {
+		if (slot_snapshot(i) != NULL) {
 			slots[count++] = i;
 		}
 	}
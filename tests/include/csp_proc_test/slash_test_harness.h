@@ -13,6 +13,7 @@ int proc_pop(struct slash * slash);
 int proc_list(struct slash * slash);
 int proc_slots(struct slash * slash);
 int proc_run(struct slash * slash);
+int proc_cache(struct slash * slash);
 int proc_block(struct slash * slash);
 int proc_ifelse(struct slash * slash);
 int proc_noop(struct slash * slash);
@@ -90,6 +91,8 @@ int proc_slash_command(const char * command) {
 		result = proc_slots(&slash);
 	} else if (strcmp(argv[1], "run") == 0) {
 		result = proc_run(&slash);
+	} else if (strcmp(argv[1], "cache") == 0) {
+		result = proc_cache(&slash);
 	} else if (strcmp(argv[1], "block") == 0) {
 		result = proc_block(&slash);
 	} else if (strcmp(argv[1], "ifelse") == 0) {
@@ -1,8 +1,604 @@
+#include <unistd.h>
 #include <criterion/criterion.h>
 #include <csp_proc_test/csp_network_test_harness.h>
+#include <csp_proc/proc_analyze.h>
+#include <csp_proc/proc_store.h>
 
 Test(csp_network, test_network_init) {
 	cr_assert(node1_fixture->iface->addr == 1);
 	cr_assert(node2_fixture->iface->addr == 2);
 	cr_assert(node3_fixture->iface->addr == 3);
 }
+
+int proc_runtime_ifelse(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t * registers);
+
+Test(csp_network, test_ifelse_local_no_round_trips) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_instruction_t instruction = {
+		.node = 0,
+		.type = PROC_IFELSE,
+		.instruction.ifelse = {{"p_uint8_1", -1}, OP_EQ, {"p_uint8_2", -1}},
+	};
+	proc_instruction_state_t state = {};
+
+	for (int i = 0; i < 3; i++) {
+		cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_TRUE);
+	}
+	cr_assert_eq(proc_instruction_round_trips(&state), 0, "Local operands must not cause remote round trips");
+}
+
+Test(csp_network, test_ifelse_type_mismatch) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_instruction_t instruction = {
+		.node = 0,
+		.type = PROC_IFELSE,
+		.instruction.ifelse = {{"p_uint8_1", -1}, OP_EQ, {"p_float_1", -1}},
+	};
+	proc_instruction_state_t state = {};
+
+	cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_ERR_TYPE);
+}
+
+Test(csp_network, test_check_rejects_type_mismatch) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_instruction_t instructions[] = {
+		{.node = 0, .type = PROC_BINOP, .instruction.binop = {{"p_int32_1", -1}, OP_ADD, {"p_int32_2", -1}, {"p_int64_1", -1}}},
+		{.node = 0, .type = PROC_IFELSE, .instruction.ifelse = {{"p_double_1", -1}, OP_LT, {"p_float_1", -1}}},
+	};
+	proc_t proc = {.instruction_count = 2};
+	memcpy(proc.instructions, instructions, sizeof(instructions));
+	cr_assert_eq(proc_runtime_check(&proc), 0, "Operands of the same type class must pass");
+
+	proc.instructions[1].instruction.ifelse.param_b.name = "p_uint8_1";
+	cr_assert_eq(proc_runtime_check(&proc), -1, "Comparing floating point and unsigned operands must be rejected");
+
+	proc.instruction_count = 1;
+	proc.instructions[0].instruction.binop.op = OP_MOD;
+	proc.instructions[0].instruction.binop.param_a.name = "p_float_1";
+	proc.instructions[0].instruction.binop.param_b.name = "p_float_2";
+	proc.instructions[0].instruction.binop.result.name = "p_double_1";
+	cr_assert_eq(proc_runtime_check(&proc), -1, "Modulo of floating point operands must be rejected");
+}
+
+int proc_runtime_call(proc_op_t * op, proc_continuation_t * continuation, proc_analysis_t ** analysis, proc_t ** proc, int * pc);
+
+Test(csp_network, test_call_pushes_heap_frames) {
+	proc_t caller = {.instruction_count = 1};
+	proc_t callee = {.instruction_count = 1};
+	proc_analysis_t caller_analysis = {.proc = &caller};
+	proc_analysis_t callee_analysis = {.proc = &callee};
+	proc_instruction_t instruction = {.type = PROC_CALL};
+	proc_instruction_analysis_t instruction_analysis = {.type = PROC_CALL};
+	proc_op_t op = {.instruction = &instruction, .instruction_analysis = &instruction_analysis, .callee = &callee_analysis};
+	proc_continuation_t continuation = {};
+
+	// Deeper than a native call chain on a small task stack would allow
+	for (int depth = 0; depth < 100; depth++) {
+		proc_analysis_t * analysis = &caller_analysis;
+		proc_t * proc = &caller;
+		int pc = 7;
+		cr_assert_eq(proc_runtime_call(&op, &continuation, &analysis, &proc, &pc), 0);
+		cr_assert(analysis == &callee_analysis && proc == &callee && pc == 0);
+	}
+	cr_assert_eq(continuation.depth, 100);
+	cr_assert(continuation.frames[99].analysis == &caller_analysis && continuation.frames[99].pc == 7, "The caller must be resumed after the call");
+
+	instruction_analysis.analysis.call.is_tail_call = 1;
+	proc_analysis_t * analysis = &caller_analysis;
+	proc_t * proc = &caller;
+	int pc = 7;
+	continuation.registers = proc_calloc(PROC_REGISTER_COUNT, sizeof(proc_register_t));
+	cr_assert_eq(proc_runtime_call(&op, &continuation, &analysis, &proc, &pc), 0);
+	cr_assert_eq(continuation.depth, 100, "Tail calls must not push a frame");
+	cr_assert(continuation.registers == NULL, "Tail calls must start the called procedure with empty registers");
+
+	proc_free(continuation.frames);
+}
+
+proc_analysis_t * proc_analysis_acquire(uint8_t slot);
+void proc_analysis_release(proc_analysis_t * analysis);
+
+Test(csp_network, test_analysis_cache_invalidates_callers) {
+	cr_assert(proc_runtime_init() == 0);
+	cr_assert(proc_store_init() == 0);
+
+	proc_t callee = {.instruction_count = 1, .instructions = {{.type = PROC_NOOP}}};
+	proc_t caller = {.instruction_count = 1, .instructions = {{.type = PROC_CALL, .instruction.call.procedure_slot = 11}}};
+	cr_assert_eq(set_proc(&callee, 11, 1), 11);
+	cr_assert_eq(set_proc(&caller, 10, 1), 10);
+	cr_assert_eq(set_proc(&callee, 12, 1), 12);
+
+	proc_analysis_t * analysis = proc_analysis_acquire(10);
+	proc_analysis_t * unrelated = proc_analysis_acquire(12);
+	cr_assert(analysis != NULL && unrelated != NULL);
+	cr_assert(proc_analysis_acquire(10) == analysis, "Repeated runs must reuse the cached analysis");
+	proc_analysis_release(analysis);
+
+	// Changing the callee drops the analysis of its caller, while runs holding it keep it alive
+	cr_assert_eq(set_proc(&callee, 11, 1), 11);
+	proc_analysis_t * reanalyzed = proc_analysis_acquire(10);
+	cr_assert(reanalyzed != NULL && reanalyzed != analysis, "Callers of a changed slot must be analyzed again");
+	cr_assert(proc_analysis_acquire(12) == unrelated, "Unrelated slots must stay cached");
+
+	// Stored procedures are immutable snapshots, replacing one leaves the runs holding it untouched
+	cr_assert_eq(set_proc(&callee, 10, 1), 10);
+	cr_assert(get_proc(10) != analysis->proc);
+	cr_assert_eq(analysis->proc->instructions[0].type, PROC_CALL);
+
+	proc_analysis_release(unrelated);
+	proc_analysis_release(unrelated);
+	proc_analysis_release(reanalyzed);
+	proc_analysis_release(analysis);
+}
+
+Test(csp_network, test_inline_run_bounded_procedures) {
+	cr_assert(proc_runtime_init() == 0);
+	cr_assert(proc_store_init() == 0);
+
+	proc_t local = {.instruction_count = 2, .instructions = {{.type = PROC_NOOP}, {.type = PROC_NOOP}}};
+	proc_t remote = {.instruction_count = 1, .instructions = {{.node = 2, .type = PROC_NOOP}}};
+	proc_t caller = {.instruction_count = 1, .instructions = {{.type = PROC_CALL, .instruction.call.procedure_slot = 20}}};
+	cr_assert_eq(set_proc(&local, 20, 1), 20);
+	cr_assert_eq(set_proc(&remote, 21, 1), 21);
+	cr_assert_eq(set_proc(&caller, 22, 1), 22);
+
+	cr_assert_eq(proc_runtime_run_inline(20), 0, "Short local procedures must complete inline");
+	cr_assert_eq(proc_runtime_run_inline(21), PROC_RUN_NOT_INLINE, "Remote operands must not be waited on inline");
+	cr_assert_eq(proc_runtime_run_inline(22), PROC_RUN_NOT_INLINE, "Calls must not run inline");
+}
+
+int proc_runtime_jump(proc_op_t * op, proc_continuation_t * continuation, proc_analysis_t * analysis, int * next);
+
+Test(csp_network, test_loop_counts_iterations_in_run) {
+	proc_t proc = {.instruction_count = 3};
+	proc_analysis_t analysis = {.proc = &proc};
+	proc_instruction_t instruction = {.type = PROC_LOOP, .instruction.loop = {.target = 0, .count = 3}};
+	proc_op_t op = {.instruction = &instruction, .index = 2, .next = 3, .branch = 0};
+	proc_continuation_t continuation = {};
+
+	// Runs again and again go through the same op, but count their iterations separately
+	for (int run = 0; run < 2; run++) {
+		int iterations = 1;
+		int next = op.next;
+		while (proc_runtime_jump(&op, &continuation, &analysis, &next) == 0 && next == op.branch) {
+			iterations++;
+			next = op.next;
+		}
+		cr_assert_eq(iterations, 3, "The loop body must run count times");
+		cr_assert_eq(continuation.loop_count, 0, "A completed loop must not leave a count behind");
+	}
+
+	proc_free(continuation.loops);
+}
+
+Test(csp_network, test_analyze_nested_if_targets) {
+	proc_t proc = {
+		.instruction_count = 10,
+		.instructions = {
+			{.type = PROC_IF, .instruction.ifelse = {{"p_uint8_1", -1}, OP_EQ, {"p_uint8_2", -1}}},
+			{.type = PROC_NOOP},
+			{.type = PROC_IF, .instruction.ifelse = {{"p_uint8_1", -1}, OP_LT, {"p_uint8_2", -1}}},
+			{.type = PROC_NOOP},
+			{.type = PROC_ELSE},
+			{.type = PROC_NOOP},
+			{.type = PROC_ENDIF},
+			{.type = PROC_ELSE},
+			{.type = PROC_NOOP},
+			{.type = PROC_ENDIF},
+		},
+	};
+	proc_analysis_config_t config = {};
+
+	proc_analysis_t * analysis = proc_malloc(sizeof(proc_analysis_t));
+	cr_assert_eq(proc_analyze(&proc, analysis, &config), 0);
+	cr_assert_eq(analysis->instruction_analyses[0].target, 8, "An if must continue after its own else, past the nested clauses");
+	cr_assert_eq(analysis->instruction_analyses[2].target, 5);
+	cr_assert_eq(analysis->instruction_analyses[4].target, 7, "An else must continue past its endif");
+	cr_assert_eq(analysis->instruction_analyses[7].target, 10, "An else closing the procedure must end it");
+	free_proc_analysis(analysis);
+
+	proc.instruction_count = 9;  // Drop the outer endif
+	analysis = proc_malloc(sizeof(proc_analysis_t));
+	cr_assert_eq(proc_analyze(&proc, analysis, &config), -1, "Unbalanced if/else/endif must be rejected");
+	free_proc_analysis(analysis);
+}
+
+int proc_runtime_switch(proc_instruction_t * instruction, proc_instruction_state_t * state);
+
+Test(csp_network, test_switch_jump_table) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_switch_case_t cases[] = {{-3, 2}, {7, 5}, {40, 1}};
+	proc_instruction_t instruction = {
+		.node = 0,
+		.type = PROC_SWITCH,
+		.instruction.switch_ = {{"p_int32_1", -1}, 4, 3, cases},
+	};
+	proc_instruction_state_t state = {};
+
+	param_set_int32(&p_int32_1, 7);
+	cr_assert_eq(proc_runtime_switch(&instruction, &state), 5);
+	param_set_int32(&p_int32_1, -3);
+	cr_assert_eq(proc_runtime_switch(&instruction, &state), 2);
+	param_set_int32(&p_int32_1, 8);
+	cr_assert_eq(proc_runtime_switch(&instruction, &state), 4, "Values without a case must continue at the default target");
+
+	proc_t proc = {.instruction_count = 1, .instructions = {instruction}};
+	proc.instructions[0].instruction.switch_.param.name = "p_float_1";
+	cr_assert_eq(proc_runtime_check(&proc), -1, "Switching on a floating point parameter must be rejected");
+}
+
+Test(csp_network, test_ifelse_immediate_operands) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_instruction_t instruction = {
+		.node = 0,
+		.type = PROC_IFELSE,
+		.instruction.ifelse = {{"p_int8_1", -1}, OP_GT, {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = -5}},
+	};
+	proc_instruction_state_t state = {};
+
+	param_set_int8(&p_int8_1, -4);
+	cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_TRUE);
+	param_set_int8(&p_int8_1, -6);
+	cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_FALSE);
+	cr_assert_eq(proc_instruction_round_trips(&state), 0, "Immediates must not cause remote round trips");
+
+	instruction.instruction.ifelse.param_a.name = "p_uint8_1";
+	state = (proc_instruction_state_t){};
+	cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_ERR_TYPE, "A negative immediate must not be compared as unsigned");
+
+	instruction.instruction.ifelse.param_b = (proc_operand_t){.kind = PROC_OPERAND_FLOAT, .offset = -1, .value.f = 0.5};
+	cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_ERR_TYPE, "A floating point immediate must not be compared with an integer");
+}
+
+int proc_runtime_unop(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer);
+int proc_runtime_binop(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_register_t ** registers, proc_write_buffer_t * write_buffer);
+
+Test(csp_network, test_registers_hold_intermediates) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_operand_t r0 = {.kind = PROC_OPERAND_REGISTER, .offset = -1, .value.u = 0};
+	proc_operand_t r1 = {.kind = PROC_OPERAND_REGISTER, .offset = -1, .value.u = 1};
+	proc_operand_t three = {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = 3};
+	proc_instruction_t load = {.type = PROC_UNOP, .instruction.unop = {{"p_int8_1", -1}, OP_IDT, r0}};
+	proc_instruction_t mul = {.type = PROC_BINOP, .instruction.binop = {r0, OP_MUL, three, r1}};
+	proc_instruction_t check = {.type = PROC_IFELSE, .instruction.ifelse = {r1, OP_EQ, {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = -12}}};
+	proc_instruction_t store = {.type = PROC_UNOP, .instruction.unop = {r1, OP_IDT, {"p_int8_2", -1}}};
+	proc_instruction_state_t states[4] = {};
+
+	proc_register_t * registers = NULL;
+	cr_assert_eq(proc_runtime_binop(&mul, &states[1], &registers, NULL), -1, "Reading a register before it's written must fail");
+
+	param_set_int8(&p_int8_1, -4);
+	cr_assert_eq(proc_runtime_unop(&load, &states[0], &registers, NULL), 0);
+	cr_assert(registers != NULL, "The registers of the frame must be allocated by the first write");
+	cr_assert_eq(proc_runtime_binop(&mul, &states[1], &registers, NULL), 0);
+	cr_assert_eq(proc_runtime_ifelse(&check, &states[2], registers), IF_ELSE_FLAG_TRUE);
+	cr_assert_eq(proc_runtime_unop(&store, &states[3], &registers, NULL), 0);
+	cr_assert_eq(param_get_int8(&p_int8_2), -12, "A register must be written to a parameter in the representation it was read with");
+	proc_free(registers);
+}
+
+Test(csp_network, test_offloaded_block_notifies_run) {
+	cr_assert(proc_runtime_init() == 0);
+	cr_assert(proc_store_init() == 0);
+
+	param_set_int8(&p_int8_1, 0);
+	param_set_int8(&p_int8_2, 0);
+
+	// Node 2 watches its own parameter and notifies node 1, which resumes the run to copy it
+	proc_t proc = {
+		.instruction_count = 2,
+		.instructions = {
+			{.node = 2, .type = PROC_BLOCK, .instruction.block = {.param_a = {"p_int8_2", -1}, .op = OP_EQ, .param_b = {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = 5}, .timeout_ms = 5000, .offload = 1}},
+			{.node = 0, .type = PROC_UNOP, .instruction.unop = {{"p_int8_2", -1}, OP_IDT, {"p_int8_1", -1}}},
+		},
+	};
+	cr_assert_eq(set_proc(&proc, 23, 1), 23);
+	cr_assert_eq(proc_runtime_run(23), 0);
+
+	usleep(500 * 1000);
+	cr_assert_eq(param_get_int8(&p_int8_1), 0, "The run must stay parked until node 2 notifies it");
+
+	param_set_int8(&p_int8_2, 5);
+	for (int i = 0; i < 50 && param_get_int8(&p_int8_1) != 5; i++) {
+		usleep(100 * 1000);
+	}
+	cr_assert_eq(param_get_int8(&p_int8_1), 5, "The notification from node 2 must resume the run");
+}
+
+int proc_prefetch_operands(proc_instruction_t * instructions, proc_instruction_state_t * states, int count, int after_ifelse);
+extern unsigned int proc_param_list_generation;
+
+Test(csp_network, test_prefetch_reduces_round_trips) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_operand_t r0 = {.kind = PROC_OPERAND_REGISTER, .offset = -1, .value.u = 0};
+	proc_operand_t r1 = {.kind = PROC_OPERAND_REGISTER, .offset = -1, .value.u = 1};
+	proc_instruction_t instructions[] = {
+		{.node = 2, .type = PROC_BINOP, .instruction.binop = {{"p_int8_2", -1}, OP_ADD, {"p_int16_2", -1}, r0}},
+		{.node = 2, .type = PROC_BINOP, .instruction.binop = {{"p_int32_2", -1}, OP_ADD, {"p_int64_2", -1}, r1}},
+	};
+
+	// All fixture nodes share this process, so node 2 counts as local; resolve the handles as remote ones instead
+	param_t * params[][2] = {{&p_int8_2, &p_int16_2}, {&p_int32_2, &p_int64_2}};
+	proc_instruction_state_t states[2];
+	for (int i = 0; i < 2; i++) {
+		states[i] = (proc_instruction_state_t){};
+		states[i].handles.binop.param_a = (proc_param_handle_t){params[i][0], -1, 2, proc_param_list_generation};
+		states[i].handles.binop.param_b = (proc_param_handle_t){params[i][1], -1, 2, proc_param_list_generation};
+	}
+
+	proc_register_t * registers = NULL;
+	for (int i = 0; i < 2; i++) {
+		cr_assert_eq(proc_runtime_binop(&instructions[i], &states[i], &registers, NULL), 0);
+	}
+	cr_assert_eq(proc_instruction_round_trips(&states[0]) + proc_instruction_round_trips(&states[1]), 4, "Each remote operand must be pulled on its own");
+
+	states[0].round_trips = states[1].round_trips = 0;
+	cr_assert_eq(proc_prefetch_operands(instructions, states, 2, 0), 2, "Both instructions read from node 2, so they must be pulled as one group");
+	for (int i = 0; i < 2; i++) {
+		cr_assert_eq(proc_runtime_binop(&instructions[i], &states[i], &registers, NULL), 0);
+	}
+	cr_assert_eq(proc_instruction_round_trips(&states[0]) + proc_instruction_round_trips(&states[1]), 1, "The operands of the group must be pulled in a single round trip");
+
+	proc_free(registers);
+}
+
+// Also run against the native-width kernels (run_tests_mcu), where parameters of up to 32 bits stay 32 bits wide
+Test(csp_network, test_arithmetic_operand_widths) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_operand_t r0 = {.kind = PROC_OPERAND_REGISTER, .offset = -1, .value.u = 0};
+	proc_instruction_t compare = {.type = PROC_IFELSE};
+	proc_instruction_state_t compare_state;
+
+	// Immediates beyond 32 bits don't fit a native-width parameter, which is then widened instead
+	param_set_uint32(&p_uint32_1, UINT32_MAX);
+	compare.instruction.ifelse = (proc_ifelse_t){{"p_uint32_1", -1}, OP_LT, {.kind = PROC_OPERAND_UINT, .offset = -1, .value.u = 1ULL << 32}};
+	compare_state = (proc_instruction_state_t){};
+	cr_assert_eq(proc_runtime_ifelse(&compare, &compare_state, NULL), IF_ELSE_FLAG_TRUE);
+
+	param_set_int16(&p_int16_1, -30000);
+	compare.instruction.ifelse = (proc_ifelse_t){{"p_int16_1", -1}, OP_GT, {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = -3000000000LL}};
+	compare_state = (proc_instruction_state_t){};
+	cr_assert_eq(proc_runtime_ifelse(&compare, &compare_state, NULL), IF_ELSE_FLAG_TRUE);
+
+	// Immediates that fit are matched to the parameter, integers to floating point ones too
+	param_set_uint16(&p_uint16_1, UINT16_MAX);
+	compare.instruction.ifelse = (proc_ifelse_t){{"p_uint16_1", -1}, OP_EQ, {.kind = PROC_OPERAND_UINT, .offset = -1, .value.u = UINT16_MAX}};
+	compare_state = (proc_instruction_state_t){};
+	cr_assert_eq(proc_runtime_ifelse(&compare, &compare_state, NULL), IF_ELSE_FLAG_TRUE);
+
+	param_set_float(&p_float_1, 0.25f);
+	compare.instruction.ifelse = (proc_ifelse_t){{"p_float_1", -1}, OP_LT, {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = 1}};
+	compare_state = (proc_instruction_state_t){};
+	cr_assert_eq(proc_runtime_ifelse(&compare, &compare_state, NULL), IF_ELSE_FLAG_TRUE);
+
+	// Results exceeding the parameter type, but not 32 bits, are kept in full by registers
+	proc_instruction_t mul = {.type = PROC_BINOP, .instruction.binop = {{"p_int16_1", -1}, OP_MUL, {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = 3}, r0}};
+	proc_instruction_state_t mul_state = {};
+	proc_register_t * registers = NULL;
+	cr_assert_eq(proc_runtime_binop(&mul, &mul_state, &registers, NULL), 0);
+	compare.instruction.ifelse = (proc_ifelse_t){r0, OP_EQ, {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = -90000}};
+	compare_state = (proc_instruction_state_t){};
+	cr_assert_eq(proc_runtime_ifelse(&compare, &compare_state, registers), IF_ELSE_FLAG_TRUE);
+
+	// Integer division truncates, and dividing by zero fails, at either width
+	param_set_int32(&p_int32_1, -7);
+	proc_instruction_t div = {.type = PROC_BINOP, .instruction.binop = {{"p_int32_1", -1}, OP_DIV, {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = 2}, {"p_int32_2", -1}}};
+	proc_instruction_state_t div_state = {};
+	cr_assert_eq(proc_runtime_binop(&div, &div_state, &registers, NULL), 0);
+	cr_assert_eq(param_get_int32(&p_int32_2), -3);
+	div.instruction.binop.param_b.value.i = 0;
+	cr_assert_eq(proc_runtime_binop(&div, &div_state, &registers, NULL), -1, "Division by zero must fail");
+
+	proc_free(registers);
+}
+
+Test(csp_network, test_list_flush_invalidates_handles) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_instruction_t instruction = {.node = 0, .type = PROC_IFELSE, .instruction.ifelse = {{"p_uint8_1", -1}, OP_EQ, {"p_uint8_1", -1}}};
+	proc_instruction_state_t state = {};
+	cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_TRUE);
+	unsigned int generation = state.handles.ifelse.param_a.generation;
+
+	proc_runtime_flush_list_cache(0);
+	cr_assert_neq(proc_param_list_generation, generation, "Flushing the list cache must invalidate resolved handles");
+	cr_assert_eq(proc_runtime_ifelse(&instruction, &state, NULL), IF_ELSE_FLAG_TRUE);
+	cr_assert_eq(state.handles.ifelse.param_a.generation, proc_param_list_generation, "Handles must be resolved again on their next use");
+}
+
+param_t * proc_param_index_find(uint16_t node, const char * name);
+int proc_param_index_is_full();
+int proc_resolve_param(proc_operand_t * operand, int node, proc_param_handle_t * handle);
+
+Test(csp_network, test_param_index_lookup) {
+	cr_assert(proc_runtime_init() == 0);
+	proc_runtime_invalidate_params();
+
+	// Every local parameter resolves, through the index or, once the index is full (run_tests_mcu), by walking the list
+	int inf_loop_guard = 0;
+	param_t * param;
+	param_list_iterator i = {};
+	while ((param = param_list_iterate(&i)) != NULL && (inf_loop_guard++ < 10000)) {
+		if (param->node != 0) {
+			continue;
+		}
+		if (!proc_param_index_is_full()) {
+			cr_assert(proc_param_index_find(0, param->name) == param, "%s must be indexed", param->name);
+		}
+		proc_operand_t operand = {.name = param->name, .offset = -1, .kind = PROC_OPERAND_PARAM};
+		proc_param_handle_t handle = {};
+		cr_assert_eq(proc_resolve_param(&operand, 0, &handle), 0, "%s must resolve", param->name);
+		cr_assert(handle.param == param);
+	}
+
+	cr_assert(proc_param_index_find(0, "p_missing") == NULL);
+	proc_operand_t missing = {.name = "p_missing", .offset = -1, .kind = PROC_OPERAND_PARAM};
+	proc_param_handle_t handle = {};
+	cr_assert_eq(proc_resolve_param(&missing, 0, &handle), -1, "Parameters absent from the list must not resolve");
+}
+
+int proc_list_cache_ensure(uint16_t node);
+
+Test(csp_network, test_list_cache_hit_miss_flush) {
+	cr_assert(proc_runtime_init() == 0);
+	proc_runtime_flush_list_cache(0);
+
+	uint32_t hits, misses, hits_before, misses_before;
+	proc_runtime_list_cache_stats(&hits_before, &misses_before);
+
+	cr_assert_eq(proc_list_cache_ensure(2), 0);
+	proc_runtime_list_cache_stats(&hits, &misses);
+	cr_assert(hits == hits_before && misses == misses_before + 1, "The first lookup must download the list");
+
+	cr_assert_eq(proc_list_cache_ensure(2), 0);
+	proc_runtime_list_cache_stats(&hits, &misses);
+	cr_assert(hits == hits_before + 1 && misses == misses_before + 1, "Lookups within the TTL must be served from the cache");
+
+	proc_runtime_flush_list_cache(3);
+	cr_assert_eq(proc_list_cache_ensure(2), 0);
+	proc_runtime_list_cache_stats(&hits, &misses);
+	cr_assert_eq(hits, hits_before + 2, "Flushing another node must keep the list cached");
+
+	proc_runtime_flush_list_cache(2);
+	cr_assert_eq(proc_list_cache_ensure(2), 0);
+	proc_runtime_list_cache_stats(&hits, &misses);
+	cr_assert_eq(misses, misses_before + 2, "A flushed list must be downloaded again");
+}
+
+void proc_write_buffer_init(proc_write_buffer_t * write_buffer);
+int proc_write_buffer_flush(proc_write_buffer_t * write_buffer);
+int proc_runtime_set(proc_instruction_t * instruction, proc_instruction_state_t * state, proc_write_buffer_t * write_buffer);
+
+Test(csp_network, test_remote_writes_coalesce) {
+	cr_assert(proc_runtime_init() == 0);
+
+	proc_instruction_t instructions[] = {
+		{.node = 2, .type = PROC_SET, .instruction.set = {{"p_int8_2", -1}, "5"}},
+		{.node = 2, .type = PROC_SET, .instruction.set = {{"p_int16_2", -1}, "6"}},
+		{.node = 2, .type = PROC_SET, .instruction.set = {{"p_int32_2", -1}, "7"}},
+	};
+
+	// Resolve the handles as remote ones, as node 2 counts as local in the shared fixture process
+	param_t * params[] = {&p_int8_2, &p_int16_2, &p_int32_2};
+	proc_instruction_state_t states[3];
+	for (int i = 0; i < 3; i++) {
+		states[i] = (proc_instruction_state_t){};
+		states[i].handles.set.param = (proc_param_handle_t){params[i], -1, 2, proc_param_list_generation};
+	}
+
+	for (int i = 0; i < 3; i++) {
+		cr_assert_eq(proc_runtime_set(&instructions[i], &states[i], NULL), 0);
+	}
+	cr_assert_eq(proc_instruction_round_trips(&states[0]) + proc_instruction_round_trips(&states[1]) + proc_instruction_round_trips(&states[2]), 3, "Unbuffered writes must be pushed one by one");
+
+	for (int i = 0; i < 3; i++) {
+		states[i].round_trips = 0;
+	}
+	proc_write_buffer_t write_buffer;
+	proc_write_buffer_init(&write_buffer);
+	for (int i = 0; i < 3; i++) {
+		cr_assert_eq(proc_runtime_set(&instructions[i], &states[i], &write_buffer), 0);
+	}
+	cr_assert_eq(write_buffer.node, 2, "The writes must be held until the buffer is flushed");
+	cr_assert_eq(proc_write_buffer_flush(&write_buffer), 0);
+	cr_assert_eq(write_buffer.node, 0);
+	cr_assert_eq(proc_instruction_round_trips(&states[0]) + proc_instruction_round_trips(&states[1]) + proc_instruction_round_trips(&states[2]), 1, "Buffered writes to one node must be pushed in a single round trip");
+}
+
+Test(csp_network, test_param_change_wakes_block) {
+	cr_assert(proc_runtime_init() == 0);
+	cr_assert(proc_store_init() == 0);
+
+	param_set_int8(&p_int8_1, 0);
+	param_set_int8(&p_int8_2, 0);
+	void (*callback)(param_t * param, int offset) = p_int8_1.callback;
+
+	// Poll periods well beyond the time the test waits for the run, so only the set hook can wake the block in time
+	proc_t proc = {
+		.instruction_count = 2,
+		.instructions = {
+			{.node = 0, .type = PROC_BLOCK, .instruction.block = {.param_a = {"p_int8_1", -1}, .op = OP_EQ, .param_b = {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = 3}, .min_period_ms = 5000, .max_period_ms = 5000, .timeout_ms = 20000}},
+			{.node = 0, .type = PROC_UNOP, .instruction.unop = {{"p_int8_1", -1}, OP_IDT, {"p_int8_2", -1}}},
+		},
+	};
+	cr_assert_eq(set_proc(&proc, 24, 1), 24);
+	cr_assert_eq(proc_runtime_run(24), 0);
+
+	usleep(300 * 1000);
+	cr_assert_eq(param_get_int8(&p_int8_2), 0, "The run must stay parked until the condition holds");
+
+	param_set_int8(&p_int8_1, 3);
+	for (int i = 0; i < 10 && param_get_int8(&p_int8_2) != 3; i++) {
+		usleep(50 * 1000);
+	}
+	cr_assert_eq(param_get_int8(&p_int8_2), 3, "Setting a watched parameter must wake the block before its next poll or recheck");
+
+	for (int i = 0; i < 10 && p_int8_1.callback != callback; i++) {
+		usleep(50 * 1000);
+	}
+	cr_assert(p_int8_1.callback == callback, "The parameter must be unwatched once no block waits on it");
+}
+
+int proc_instructions_run(proc_continuation_t * continuation);
+void proc_registers_free(proc_continuation_t * continuation);
+
+Test(csp_network, test_coroutine_yields_past_slice) {
+	cr_assert(proc_runtime_init() == 0);
+	cr_assert(proc_store_init() == 0);
+
+	// Two instructions per iteration, so the run takes four slices
+	const uint32_t count = 2 * PROC_COROUTINE_SLICE;
+	proc_operand_t one = {.kind = PROC_OPERAND_INT, .offset = -1, .value.i = 1};
+	proc_t proc = {
+		.instruction_count = 2,
+		.instructions = {
+			{.node = 0, .type = PROC_BINOP, .instruction.binop = {{"p_int32_1", -1}, OP_ADD, one, {"p_int32_1", -1}}},
+			{.node = 0, .type = PROC_LOOP, .instruction.loop = {.target = 0, .count = count}},
+		},
+	};
+	cr_assert_eq(set_proc(&proc, 25, 1), 25);
+
+	param_set_int32(&p_int32_1, 0);
+	proc_analysis_t * analysis = proc_analysis_acquire(25);
+	cr_assert(analysis != NULL);
+	proc_continuation_t continuation = {
+		.root_proc = analysis->proc,
+		.root_analysis = analysis,
+		.proc = analysis->proc,
+		.analysis = analysis,
+		.pc = 0,
+		.slot = 25};
+
+	int yields = 0;
+	int ret;
+	while ((ret = proc_instructions_run(&continuation)) == PROC_RUN_YIELDED) {
+		yields++;
+	}
+	cr_assert_eq(ret, 0);
+#if PROC_RUNTIME_COROUTINE
+	cr_assert_eq(yields, 2 * count / PROC_COROUTINE_SLICE - 1, "A coroutine must yield after every PROC_COROUTINE_SLICE instructions");
+#else
+	cr_assert_eq(yields, 0, "A run on its own thread must not yield");
+#endif
+	cr_assert_eq(param_get_int32(&p_int32_1), (int32_t)count, "A yielded run must continue where it left off");
+
+	proc_free(continuation.loops);
+	proc_registers_free(&continuation);
+	proc_analysis_release(analysis);
+
+	// Through the runtime, the yielded run is queued again until it completes
+	param_set_int32(&p_int32_1, 0);
+	cr_assert_eq(proc_runtime_run(25), 0);
+	for (int i = 0; i < 50 && param_get_int32(&p_int32_1) != (int32_t)count; i++) {
+		usleep(20 * 1000);
+	}
+	cr_assert_eq(param_get_int32(&p_int32_1), (int32_t)count, "A requeued run must be continued until it completes");
+}
@@ -8,11 +8,11 @@
 #include <csp_proc/proc_pack.h>
 
 TheoryDataPoints(proc_pack_unpack, test_pack_unpack_instruction_types) = {
-	DataPoints(proc_instruction_type_t, PROC_BLOCK, PROC_IFELSE, PROC_SET, PROC_UNOP, PROC_BINOP, PROC_CALL, PROC_NOOP),
+	DataPoints(proc_instruction_type_t, PROC_BLOCK, PROC_IFELSE, PROC_SET, PROC_UNOP, PROC_BINOP, PROC_CALL, PROC_NOOP, PROC_JUMP, PROC_LOOP, PROC_IF, PROC_ELSE, PROC_ENDIF, PROC_SWITCH),
 };
 
 Theory((proc_instruction_type_t type), proc_pack_unpack, test_pack_unpack_instruction_types) {
-	proc_t original_proc;
+	proc_t original_proc = {};
 	csp_packet_t packet;
 
 	original_proc.instruction_count = 1;
@@ -21,34 +21,65 @@ Theory((proc_instruction_type_t type), proc_pack_unpack, test_pack_unpack_instru
 
 	switch (type) {
 		case PROC_BLOCK:
-			original_proc.instructions[0].instruction.block.param_a = "param_a";
+			original_proc.instructions[0].instruction.block.param_a.name = "param_a";
+			original_proc.instructions[0].instruction.block.param_a.offset = -1;
 			original_proc.instructions[0].instruction.block.op = OP_EQ;
-			original_proc.instructions[0].instruction.block.param_b = "param_b";
+			original_proc.instructions[0].instruction.block.param_b.name = "param_b";
+			original_proc.instructions[0].instruction.block.param_b.offset = -1;
 			break;
 		case PROC_IFELSE:
-			original_proc.instructions[0].instruction.ifelse.param_a = "param_a";
+		case PROC_IF:
+			original_proc.instructions[0].instruction.ifelse.param_a.name = "param_a";
+			original_proc.instructions[0].instruction.ifelse.param_a.offset = -1;
 			original_proc.instructions[0].instruction.ifelse.op = OP_NEQ;
-			original_proc.instructions[0].instruction.ifelse.param_b = "param_b";
+			original_proc.instructions[0].instruction.ifelse.param_b.name = "param_b";
+			original_proc.instructions[0].instruction.ifelse.param_b.offset = -1;
 			break;
 		case PROC_SET:
-			original_proc.instructions[0].instruction.set.param = "param";
+			original_proc.instructions[0].instruction.set.param.name = "param";
+			original_proc.instructions[0].instruction.set.param.offset = -1;
 			original_proc.instructions[0].instruction.set.value = "value";
 			break;
 		case PROC_UNOP:
-			original_proc.instructions[0].instruction.unop.param = "param";
+			original_proc.instructions[0].instruction.unop.param.name = "param";
+			original_proc.instructions[0].instruction.unop.param.offset = -1;
 			original_proc.instructions[0].instruction.unop.op = OP_INC;
-			original_proc.instructions[0].instruction.unop.result = "result";
+			original_proc.instructions[0].instruction.unop.result.name = "result";
+			original_proc.instructions[0].instruction.unop.result.offset = -1;
 			break;
 		case PROC_BINOP:
-			original_proc.instructions[0].instruction.binop.param_a = "param_a";
+			original_proc.instructions[0].instruction.binop.param_a.name = "param_a";
+			original_proc.instructions[0].instruction.binop.param_a.offset = -1;
 			original_proc.instructions[0].instruction.binop.op = OP_ADD;
-			original_proc.instructions[0].instruction.binop.param_b = "param_b";
-			original_proc.instructions[0].instruction.binop.result = "result";
+			original_proc.instructions[0].instruction.binop.param_b.name = "param_b";
+			original_proc.instructions[0].instruction.binop.param_b.offset = -1;
+			original_proc.instructions[0].instruction.binop.result.name = "result";
+			original_proc.instructions[0].instruction.binop.result.offset = -1;
 			break;
 		case PROC_CALL:
 			original_proc.instructions[0].instruction.call.procedure_slot = 1;
 			break;
+		case PROC_JUMP:
+			original_proc.instructions[0].instruction.jump.target = -3;
+			original_proc.instructions[0].instruction.jump.relative = 1;
+			break;
+		case PROC_SWITCH: {
+			static proc_switch_case_t cases[] = {{-1, 0}, {3, 1}, {70000, 1}};
+			original_proc.instructions[0].instruction.switch_.param.name = "param";
+			original_proc.instructions[0].instruction.switch_.param.offset = 2;
+			original_proc.instructions[0].instruction.switch_.default_target = 1;
+			original_proc.instructions[0].instruction.switch_.case_count = 3;
+			original_proc.instructions[0].instruction.switch_.cases = cases;
+			break;
+		}
+		case PROC_LOOP:
+			original_proc.instructions[0].instruction.loop.target = 0;
+			original_proc.instructions[0].instruction.loop.count = 100000;
+			original_proc.instructions[0].instruction.loop.period_ms = 250;
+			break;
 		case PROC_NOOP:
+		case PROC_ELSE:
+		case PROC_ENDIF:
 			break;
 	}
 
@@ -67,75 +98,122 @@ Theory((proc_instruction_type_t type), proc_pack_unpack, test_pack_unpack_instru
 
 	switch (type) {
 		case PROC_BLOCK:
-			cr_assert(strcmp(original_proc.instructions[0].instruction.block.param_a, new_proc.instructions[0].instruction.block.param_a) == 0, "param_a does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.block.param_a.name, new_proc.instructions[0].instruction.block.param_a.name) == 0, "param_a does not match");
+			cr_assert(original_proc.instructions[0].instruction.block.param_a.offset == new_proc.instructions[0].instruction.block.param_a.offset, "param_a does not match");
 			cr_assert(original_proc.instructions[0].instruction.block.op == new_proc.instructions[0].instruction.block.op, "op does not match");
-			cr_assert(strcmp(original_proc.instructions[0].instruction.block.param_b, new_proc.instructions[0].instruction.block.param_b) == 0, "param_b does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.block.param_b.name, new_proc.instructions[0].instruction.block.param_b.name) == 0, "param_b does not match");
+			cr_assert(original_proc.instructions[0].instruction.block.param_b.offset == new_proc.instructions[0].instruction.block.param_b.offset, "param_b does not match");
 			break;
 		case PROC_IFELSE:
-			cr_assert(strcmp(original_proc.instructions[0].instruction.ifelse.param_a, new_proc.instructions[0].instruction.ifelse.param_a) == 0, "param_a does not match");
+		case PROC_IF:
+			cr_assert(strcmp(original_proc.instructions[0].instruction.ifelse.param_a.name, new_proc.instructions[0].instruction.ifelse.param_a.name) == 0, "param_a does not match");
+			cr_assert(original_proc.instructions[0].instruction.ifelse.param_a.offset == new_proc.instructions[0].instruction.ifelse.param_a.offset, "param_a does not match");
 			cr_assert(original_proc.instructions[0].instruction.ifelse.op == new_proc.instructions[0].instruction.ifelse.op, "op does not match");
-			cr_assert(strcmp(original_proc.instructions[0].instruction.ifelse.param_b, new_proc.instructions[0].instruction.ifelse.param_b) == 0, "param_b does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.ifelse.param_b.name, new_proc.instructions[0].instruction.ifelse.param_b.name) == 0, "param_b does not match");
+			cr_assert(original_proc.instructions[0].instruction.ifelse.param_b.offset == new_proc.instructions[0].instruction.ifelse.param_b.offset, "param_b does not match");
 			break;
 		case PROC_SET:
-			cr_assert(strcmp(original_proc.instructions[0].instruction.set.param, new_proc.instructions[0].instruction.set.param) == 0, "param does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.set.param.name, new_proc.instructions[0].instruction.set.param.name) == 0, "param does not match");
+			cr_assert(original_proc.instructions[0].instruction.set.param.offset == new_proc.instructions[0].instruction.set.param.offset, "param does not match");
 			cr_assert(strcmp(original_proc.instructions[0].instruction.set.value, new_proc.instructions[0].instruction.set.value) == 0, "value does not match");
 			break;
 		case PROC_UNOP:
-			cr_assert(strcmp(original_proc.instructions[0].instruction.unop.param, new_proc.instructions[0].instruction.unop.param) == 0, "param does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.unop.param.name, new_proc.instructions[0].instruction.unop.param.name) == 0, "param does not match");
+			cr_assert(original_proc.instructions[0].instruction.unop.param.offset == new_proc.instructions[0].instruction.unop.param.offset, "param does not match");
 			cr_assert(original_proc.instructions[0].instruction.unop.op == new_proc.instructions[0].instruction.unop.op, "op does not match");
-			cr_assert(strcmp(original_proc.instructions[0].instruction.unop.result, new_proc.instructions[0].instruction.unop.result) == 0, "result does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.unop.result.name, new_proc.instructions[0].instruction.unop.result.name) == 0, "result does not match");
+			cr_assert(original_proc.instructions[0].instruction.unop.result.offset == new_proc.instructions[0].instruction.unop.result.offset, "result does not match");
 			break;
 		case PROC_BINOP:
-			cr_assert(strcmp(original_proc.instructions[0].instruction.binop.param_a, new_proc.instructions[0].instruction.binop.param_a) == 0, "param_a does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.binop.param_a.name, new_proc.instructions[0].instruction.binop.param_a.name) == 0, "param_a does not match");
+			cr_assert(original_proc.instructions[0].instruction.binop.param_a.offset == new_proc.instructions[0].instruction.binop.param_a.offset, "param_a does not match");
 			cr_assert(original_proc.instructions[0].instruction.binop.op == new_proc.instructions[0].instruction.binop.op, "op does not match");
-			cr_assert(strcmp(original_proc.instructions[0].instruction.binop.param_b, new_proc.instructions[0].instruction.binop.param_b) == 0, "param_b does not match");
-			cr_assert(strcmp(original_proc.instructions[0].instruction.binop.result, new_proc.instructions[0].instruction.binop.result) == 0, "result does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.binop.param_b.name, new_proc.instructions[0].instruction.binop.param_b.name) == 0, "param_b does not match");
+			cr_assert(original_proc.instructions[0].instruction.binop.param_b.offset == new_proc.instructions[0].instruction.binop.param_b.offset, "param_b does not match");
+			cr_assert(strcmp(original_proc.instructions[0].instruction.binop.result.name, new_proc.instructions[0].instruction.binop.result.name) == 0, "result does not match");
+			cr_assert(original_proc.instructions[0].instruction.binop.result.offset == new_proc.instructions[0].instruction.binop.result.offset, "result does not match");
 			break;
 		case PROC_CALL:
 			cr_assert(original_proc.instructions[0].instruction.call.procedure_slot == new_proc.instructions[0].instruction.call.procedure_slot, "procedure_slot does not match");
 			break;
+		case PROC_JUMP:
+			cr_assert(original_proc.instructions[0].instruction.jump.target == new_proc.instructions[0].instruction.jump.target, "target does not match");
+			cr_assert(original_proc.instructions[0].instruction.jump.relative == new_proc.instructions[0].instruction.jump.relative, "relative does not match");
+			break;
+		case PROC_SWITCH:
+			cr_assert(strcmp(original_proc.instructions[0].instruction.switch_.param.name, new_proc.instructions[0].instruction.switch_.param.name) == 0, "param does not match");
+			cr_assert(original_proc.instructions[0].instruction.switch_.param.offset == new_proc.instructions[0].instruction.switch_.param.offset, "param does not match");
+			cr_assert(original_proc.instructions[0].instruction.switch_.default_target == new_proc.instructions[0].instruction.switch_.default_target, "default_target does not match");
+			cr_assert(original_proc.instructions[0].instruction.switch_.case_count == new_proc.instructions[0].instruction.switch_.case_count, "case_count does not match");
+			for (int j = 0; j < original_proc.instructions[0].instruction.switch_.case_count; j++) {
+				cr_assert(original_proc.instructions[0].instruction.switch_.cases[j].value == new_proc.instructions[0].instruction.switch_.cases[j].value, "case value does not match");
+				cr_assert(original_proc.instructions[0].instruction.switch_.cases[j].target == new_proc.instructions[0].instruction.switch_.cases[j].target, "case target does not match");
+			}
+			break;
+		case PROC_LOOP:
+			cr_assert(original_proc.instructions[0].instruction.loop.target == new_proc.instructions[0].instruction.loop.target, "target does not match");
+			cr_assert(original_proc.instructions[0].instruction.loop.count == new_proc.instructions[0].instruction.loop.count, "count does not match");
+			cr_assert(original_proc.instructions[0].instruction.loop.period_ms == new_proc.instructions[0].instruction.loop.period_ms, "period_ms does not match");
+			break;
 		case PROC_NOOP:
+		case PROC_ELSE:
+		case PROC_ENDIF:
 			break;
 	}
 }
 
 Test(proc_pack_unpack, test_pack_unpack_variety) {
-	proc_t original_proc;
+	proc_t original_proc = {};
 	csp_packet_t packet;
 
 	original_proc.instruction_count = 7;
 	original_proc.instructions[0].node = 1;
 	original_proc.instructions[0].type = PROC_BLOCK;
-	original_proc.instructions[0].instruction.block.param_a = "param_a";
+	original_proc.instructions[0].instruction.block.param_a.name = "param_a";
+	original_proc.instructions[0].instruction.block.param_a.offset = -1;
 	original_proc.instructions[0].instruction.block.op = OP_LE;
-	original_proc.instructions[0].instruction.block.param_b = "param_b";
+	original_proc.instructions[0].instruction.block.param_b.name = "param_b";
+	original_proc.instructions[0].instruction.block.param_b.offset = -1;
+	original_proc.instructions[0].instruction.block.min_period_ms = 500;
+	original_proc.instructions[0].instruction.block.max_period_ms = 30000;
+	original_proc.instructions[0].instruction.block.backoff_percent = 200;
+	original_proc.instructions[0].instruction.block.timeout_ms = 3600000;
+	original_proc.instructions[0].instruction.block.offload = 1;
 
 	original_proc.instructions[1].node = 253;
 	original_proc.instructions[1].type = PROC_SET;
-	original_proc.instructions[1].instruction.set.param = "param_";
+	original_proc.instructions[1].instruction.set.param.name = "param_";
+	original_proc.instructions[1].instruction.set.param.offset = -1;
 	original_proc.instructions[1].instruction.set.value = "1337.42";
 
 	original_proc.instructions[2].node = 395;
 	original_proc.instructions[2].type = PROC_UNOP;
-	original_proc.instructions[2].instruction.unop.param = "pa_ram";
+	original_proc.instructions[2].instruction.unop.param.name = "pa_ram";
+	original_proc.instructions[2].instruction.unop.param.offset = -1;
 	original_proc.instructions[2].instruction.unop.op = OP_IDT;
-	original_proc.instructions[2].instruction.unop.result = "result";
+	original_proc.instructions[2].instruction.unop.result.name = "result";
+	original_proc.instructions[2].instruction.unop.result.offset = -1;
 
 	original_proc.instructions[3].node = 4;
 	original_proc.instructions[3].type = PROC_BINOP;
-	original_proc.instructions[3].instruction.binop.param_a = "param[63]";
+	original_proc.instructions[3].instruction.binop.param_a.name = "param";
+	original_proc.instructions[3].instruction.binop.param_a.offset = 63;
 	original_proc.instructions[3].instruction.binop.op = OP_LSH;
-	original_proc.instructions[3].instruction.binop.param_b = "param[5]";
-	original_proc.instructions[3].instruction.binop.result = "result[0]";
+	original_proc.instructions[3].instruction.binop.param_b.name = "param";
+	original_proc.instructions[3].instruction.binop.param_b.offset = 5;
+	original_proc.instructions[3].instruction.binop.result.name = "result";
+	original_proc.instructions[3].instruction.binop.result.offset = 0;
 
 	original_proc.instructions[4].node = 79;
 	original_proc.instructions[4].type = PROC_NOOP;
 
 	original_proc.instructions[5].node = 65;
 	original_proc.instructions[5].type = PROC_IFELSE;
-	original_proc.instructions[5].instruction.ifelse.param_a = "param_a";
+	original_proc.instructions[5].instruction.ifelse.param_a.name = "param_a";
+	original_proc.instructions[5].instruction.ifelse.param_a.offset = -1;
 	original_proc.instructions[5].instruction.ifelse.op = OP_GT;
-	original_proc.instructions[5].instruction.ifelse.param_b = "param_b";
+	original_proc.instructions[5].instruction.ifelse.param_b.name = "param_b";
+	original_proc.instructions[5].instruction.ifelse.param_b.offset = -1;
 
 	original_proc.instructions[6].node = 1525;
 	original_proc.instructions[6].type = PROC_CALL;
@@ -157,32 +235,47 @@ Test(proc_pack_unpack, test_pack_unpack_variety) {
 
 		switch (original_proc.instructions[i].type) {
 			case PROC_BLOCK:
-				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_a, new_proc.instructions[i].instruction.block.param_a, "Block param_a does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_a.name, new_proc.instructions[i].instruction.block.param_a.name, "Block param_a does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.param_a.offset == new_proc.instructions[i].instruction.block.param_a.offset, "Block param_a does not match");
 				cr_assert(original_proc.instructions[i].instruction.block.op == new_proc.instructions[i].instruction.block.op, "Block op does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_b, new_proc.instructions[i].instruction.block.param_b, "Block param_b does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_b.name, new_proc.instructions[i].instruction.block.param_b.name, "Block param_b does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.param_b.offset == new_proc.instructions[i].instruction.block.param_b.offset, "Block param_b does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.min_period_ms == new_proc.instructions[i].instruction.block.min_period_ms, "Block min_period_ms does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.max_period_ms == new_proc.instructions[i].instruction.block.max_period_ms, "Block max_period_ms does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.backoff_percent == new_proc.instructions[i].instruction.block.backoff_percent, "Block backoff_percent does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.timeout_ms == new_proc.instructions[i].instruction.block.timeout_ms, "Block timeout_ms does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.offload == new_proc.instructions[i].instruction.block.offload, "Block offload does not match");
 				break;
 			case PROC_SET:
-				cr_assert_str_eq(original_proc.instructions[i].instruction.set.param, new_proc.instructions[i].instruction.set.param, "Set param does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.set.param.name, new_proc.instructions[i].instruction.set.param.name, "Set param does not match");
+				cr_assert(original_proc.instructions[i].instruction.set.param.offset == new_proc.instructions[i].instruction.set.param.offset, "Set param does not match");
 				cr_assert_str_eq(original_proc.instructions[i].instruction.set.value, new_proc.instructions[i].instruction.set.value, "Set value does not match");
 				break;
 			case PROC_UNOP:
-				cr_assert_str_eq(original_proc.instructions[i].instruction.unop.param, new_proc.instructions[i].instruction.unop.param, "Unop param does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.unop.param.name, new_proc.instructions[i].instruction.unop.param.name, "Unop param does not match");
+				cr_assert(original_proc.instructions[i].instruction.unop.param.offset == new_proc.instructions[i].instruction.unop.param.offset, "Unop param does not match");
 				cr_assert(original_proc.instructions[i].instruction.unop.op == new_proc.instructions[i].instruction.unop.op, "Unop op does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.unop.result, new_proc.instructions[i].instruction.unop.result, "Unop result does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.unop.result.name, new_proc.instructions[i].instruction.unop.result.name, "Unop result does not match");
+				cr_assert(original_proc.instructions[i].instruction.unop.result.offset == new_proc.instructions[i].instruction.unop.result.offset, "Unop result does not match");
 				break;
 			case PROC_BINOP:
-				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_a, new_proc.instructions[i].instruction.binop.param_a, "Binop param_a does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_a.name, new_proc.instructions[i].instruction.binop.param_a.name, "Binop param_a does not match");
+				cr_assert(original_proc.instructions[i].instruction.binop.param_a.offset == new_proc.instructions[i].instruction.binop.param_a.offset, "Binop param_a does not match");
 				cr_assert(original_proc.instructions[i].instruction.binop.op == new_proc.instructions[i].instruction.binop.op, "Binop op does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_b, new_proc.instructions[i].instruction.binop.param_b, "Binop param_b does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.result, new_proc.instructions[i].instruction.binop.result, "Binop result does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_b.name, new_proc.instructions[i].instruction.binop.param_b.name, "Binop param_b does not match");
+				cr_assert(original_proc.instructions[i].instruction.binop.param_b.offset == new_proc.instructions[i].instruction.binop.param_b.offset, "Binop param_b does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.result.name, new_proc.instructions[i].instruction.binop.result.name, "Binop result does not match");
+				cr_assert(original_proc.instructions[i].instruction.binop.result.offset == new_proc.instructions[i].instruction.binop.result.offset, "Binop result does not match");
 				break;
 			case PROC_CALL:
 				cr_assert(original_proc.instructions[i].instruction.call.procedure_slot == new_proc.instructions[i].instruction.call.procedure_slot, "Call procedure_slot does not match");
 				break;
 			case PROC_IFELSE:
-				cr_assert_str_eq(original_proc.instructions[i].instruction.ifelse.param_a, new_proc.instructions[i].instruction.ifelse.param_a, "Ifelse param_a does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.ifelse.param_a.name, new_proc.instructions[i].instruction.ifelse.param_a.name, "Ifelse param_a does not match");
+				cr_assert(original_proc.instructions[i].instruction.ifelse.param_a.offset == new_proc.instructions[i].instruction.ifelse.param_a.offset, "Ifelse param_a does not match");
 				cr_assert(original_proc.instructions[i].instruction.ifelse.op == new_proc.instructions[i].instruction.ifelse.op, "Ifelse op does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.ifelse.param_b, new_proc.instructions[i].instruction.ifelse.param_b, "Ifelse param_b does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.ifelse.param_b.name, new_proc.instructions[i].instruction.ifelse.param_b.name, "Ifelse param_b does not match");
+				cr_assert(original_proc.instructions[i].instruction.ifelse.param_b.offset == new_proc.instructions[i].instruction.ifelse.param_b.offset, "Ifelse param_b does not match");
 				break;
 			case PROC_NOOP:
 				break;
@@ -193,24 +286,130 @@ Test(proc_pack_unpack, test_pack_unpack_variety) {
 	}
 }
 
+Test(proc_pack_unpack, test_pack_unpack_immediates) {
+	proc_t original_proc = {};
+	csp_packet_t packet;
+
+	original_proc.instruction_count = 3;
+	original_proc.instructions[0].type = PROC_IFELSE;
+	original_proc.instructions[0].instruction.ifelse.param_a.name = "param_a";
+	original_proc.instructions[0].instruction.ifelse.param_a.offset = 3;
+	original_proc.instructions[0].instruction.ifelse.op = OP_GE;
+	original_proc.instructions[0].instruction.ifelse.param_b.kind = PROC_OPERAND_INT;
+	original_proc.instructions[0].instruction.ifelse.param_b.offset = -1;
+	original_proc.instructions[0].instruction.ifelse.param_b.value.i = -5;
+
+	original_proc.instructions[1].type = PROC_BINOP;
+	original_proc.instructions[1].instruction.binop.param_a.kind = PROC_OPERAND_FLOAT;
+	original_proc.instructions[1].instruction.binop.param_a.offset = -1;
+	original_proc.instructions[1].instruction.binop.param_a.value.f = 2.5;
+	original_proc.instructions[1].instruction.binop.op = OP_MUL;
+	original_proc.instructions[1].instruction.binop.param_b.name = "param_b";
+	original_proc.instructions[1].instruction.binop.param_b.offset = -1;
+	original_proc.instructions[1].instruction.binop.result.name = "result";
+	original_proc.instructions[1].instruction.binop.result.offset = -1;
+
+	original_proc.instructions[2].type = PROC_BLOCK;
+	original_proc.instructions[2].instruction.block.param_a.name = "param_a";
+	original_proc.instructions[2].instruction.block.param_a.offset = -1;
+	original_proc.instructions[2].instruction.block.op = OP_NEQ;
+	original_proc.instructions[2].instruction.block.param_b.kind = PROC_OPERAND_UINT;
+	original_proc.instructions[2].instruction.block.param_b.offset = -1;
+	original_proc.instructions[2].instruction.block.param_b.value.u = UINT64_MAX;
+
+	int pack_result = pack_proc_into_csp_packet(&original_proc, &packet);
+	cr_assert(pack_result == 0, "Packing failed");
+
+	proc_t new_proc;
+	int unpack_result = unpack_proc_from_csp_packet(&new_proc, &packet);
+	cr_assert(unpack_result == 0, "Unpacking failed");
+
+	proc_ifelse_t * ifelse = &new_proc.instructions[0].instruction.ifelse;
+	cr_assert(ifelse->param_a.kind == PROC_OPERAND_PARAM, "Parameter operand unpacked as immediate");
+	cr_assert_str_eq(ifelse->param_a.name, "param_a", "Ifelse param_a does not match");
+	cr_assert(ifelse->param_a.offset == 3, "Ifelse param_a does not match");
+	cr_assert(ifelse->param_b.kind == PROC_OPERAND_INT, "Ifelse param_b kind does not match");
+	cr_assert(ifelse->param_b.name == NULL, "Immediate has a name");
+	cr_assert(ifelse->param_b.value.i == -5, "Ifelse param_b value does not match");
+
+	proc_binop_t * binop = &new_proc.instructions[1].instruction.binop;
+	cr_assert(binop->param_a.kind == PROC_OPERAND_FLOAT, "Binop param_a kind does not match");
+	cr_assert(binop->param_a.value.f == 2.5, "Binop param_a value does not match");
+	cr_assert(binop->param_b.kind == PROC_OPERAND_PARAM, "Parameter operand unpacked as immediate");
+	cr_assert_str_eq(binop->param_b.name, "param_b", "Binop param_b does not match");
+	cr_assert_str_eq(binop->result.name, "result", "Binop result does not match");
+
+	proc_block_t * block = &new_proc.instructions[2].instruction.block;
+	cr_assert(block->param_b.kind == PROC_OPERAND_UINT, "Block param_b kind does not match");
+	cr_assert(block->param_b.value.u == UINT64_MAX, "Block param_b value does not match");
+}
+
+Test(proc_pack_unpack, test_pack_unpack_registers) {
+	proc_t original_proc = {};
+	csp_packet_t packet;
+
+	original_proc.instruction_count = 2;
+	original_proc.instructions[0].type = PROC_BINOP;
+	original_proc.instructions[0].instruction.binop.param_a.name = "param_a";
+	original_proc.instructions[0].instruction.binop.param_a.offset = -1;
+	original_proc.instructions[0].instruction.binop.op = OP_SUB;
+	original_proc.instructions[0].instruction.binop.param_b.name = "param_b";
+	original_proc.instructions[0].instruction.binop.param_b.offset = 2;
+	original_proc.instructions[0].instruction.binop.result.kind = PROC_OPERAND_REGISTER;
+	original_proc.instructions[0].instruction.binop.result.offset = -1;
+	original_proc.instructions[0].instruction.binop.result.value.u = 7;
+
+	original_proc.instructions[1].type = PROC_UNOP;
+	original_proc.instructions[1].instruction.unop.param.kind = PROC_OPERAND_REGISTER;
+	original_proc.instructions[1].instruction.unop.param.offset = -1;
+	original_proc.instructions[1].instruction.unop.param.value.u = 7;
+	original_proc.instructions[1].instruction.unop.op = OP_IDT;
+	original_proc.instructions[1].instruction.unop.result.name = "result";
+	original_proc.instructions[1].instruction.unop.result.offset = -1;
+
+	int pack_result = pack_proc_into_csp_packet(&original_proc, &packet);
+	cr_assert(pack_result == 0, "Packing failed");
+
+	proc_t new_proc;
+	int unpack_result = unpack_proc_from_csp_packet(&new_proc, &packet);
+	cr_assert(unpack_result == 0, "Unpacking failed");
+
+	proc_binop_t * binop = &new_proc.instructions[0].instruction.binop;
+	cr_assert_str_eq(binop->param_a.name, "param_a", "Binop param_a does not match");
+	cr_assert(binop->param_b.offset == 2, "Binop param_b does not match");
+	cr_assert(binop->result.kind == PROC_OPERAND_REGISTER, "Binop result kind does not match");
+	cr_assert(binop->result.name == NULL, "Register has a name");
+	cr_assert(binop->result.value.u == 7, "Binop result register does not match");
+
+	proc_unop_t * unop = &new_proc.instructions[1].instruction.unop;
+	cr_assert(unop->param.kind == PROC_OPERAND_REGISTER, "Unop param kind does not match");
+	cr_assert(unop->param.value.u == 7, "Unop param register does not match");
+	cr_assert_str_eq(unop->result.name, "result", "Unop result does not match");
+}
+
 Test(proc_pack_unpack, test_pack_does_not_mutate) {
-	proc_t original_proc, copy_proc;
+	proc_t original_proc = {}, copy_proc;
 	csp_packet_t packet;
 
 	original_proc.instruction_count = 2;
 
 	original_proc.instructions[0].node = 1;
 	original_proc.instructions[0].type = PROC_BLOCK;
-	original_proc.instructions[0].instruction.block.param_a = "param_a";
+	original_proc.instructions[0].instruction.block.param_a.name = "param_a";
+	original_proc.instructions[0].instruction.block.param_a.offset = -1;
 	original_proc.instructions[0].instruction.block.op = OP_LE;
-	original_proc.instructions[0].instruction.block.param_b = "param_b";
+	original_proc.instructions[0].instruction.block.param_b.name = "param_b";
+	original_proc.instructions[0].instruction.block.param_b.offset = -1;
 
 	original_proc.instructions[1].node = 4;
 	original_proc.instructions[1].type = PROC_BINOP;
-	original_proc.instructions[1].instruction.binop.param_a = "param[63]";
+	original_proc.instructions[1].instruction.binop.param_a.name = "param";
+	original_proc.instructions[1].instruction.binop.param_a.offset = 63;
 	original_proc.instructions[1].instruction.binop.op = OP_LSH;
-	original_proc.instructions[1].instruction.binop.param_b = "param[5]";
-	original_proc.instructions[1].instruction.binop.result = "result[0]";
+	original_proc.instructions[1].instruction.binop.param_b.name = "param";
+	original_proc.instructions[1].instruction.binop.param_b.offset = 5;
+	original_proc.instructions[1].instruction.binop.result.name = "result";
+	original_proc.instructions[1].instruction.binop.result.offset = 0;
 
 	// Create a copy of original_proc for later comparison
 	copy_proc = original_proc;
@@ -227,15 +426,20 @@ Test(proc_pack_unpack, test_pack_does_not_mutate) {
 
 		switch (original_proc.instructions[i].type) {
 			case PROC_BLOCK:
-				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_a, copy_proc.instructions[i].instruction.block.param_a, "Block param_a does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_a.name, copy_proc.instructions[i].instruction.block.param_a.name, "Block param_a does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.param_a.offset == copy_proc.instructions[i].instruction.block.param_a.offset, "Block param_a does not match");
 				cr_assert(original_proc.instructions[i].instruction.block.op == copy_proc.instructions[i].instruction.block.op, "Block op does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_b, copy_proc.instructions[i].instruction.block.param_b, "Block param_b does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.block.param_b.name, copy_proc.instructions[i].instruction.block.param_b.name, "Block param_b does not match");
+				cr_assert(original_proc.instructions[i].instruction.block.param_b.offset == copy_proc.instructions[i].instruction.block.param_b.offset, "Block param_b does not match");
 				break;
 			case PROC_BINOP:
-				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_a, copy_proc.instructions[i].instruction.binop.param_a, "Binop param_a does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_a.name, copy_proc.instructions[i].instruction.binop.param_a.name, "Binop param_a does not match");
+				cr_assert(original_proc.instructions[i].instruction.binop.param_a.offset == copy_proc.instructions[i].instruction.binop.param_a.offset, "Binop param_a does not match");
 				cr_assert(original_proc.instructions[i].instruction.binop.op == copy_proc.instructions[i].instruction.binop.op, "Binop op does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_b, copy_proc.instructions[i].instruction.binop.param_b, "Binop param_b does not match");
-				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.result, copy_proc.instructions[i].instruction.binop.result, "Binop result does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.param_b.name, copy_proc.instructions[i].instruction.binop.param_b.name, "Binop param_b does not match");
+				cr_assert(original_proc.instructions[i].instruction.binop.param_b.offset == copy_proc.instructions[i].instruction.binop.param_b.offset, "Binop param_b does not match");
+				cr_assert_str_eq(original_proc.instructions[i].instruction.binop.result.name, copy_proc.instructions[i].instruction.binop.result.name, "Binop result does not match");
+				cr_assert(original_proc.instructions[i].instruction.binop.result.offset == copy_proc.instructions[i].instruction.binop.result.offset, "Binop result does not match");
 				break;
 			default:
 				cr_assert(false, "Unknown instruction type");
@@ -1,6 +1,7 @@
 #include <criterion/criterion.h>
 #include <criterion/parameterized.h>
 #include <csp_proc_test/slash_test_harness.h>
+#include <csp_proc/proc_types.h>
 
 Test(proc_slash_commands, commands_parse) {
 	int result = proc_slash_command("proc new");
@@ -15,6 +16,15 @@ Test(proc_slash_commands, commands_parse) {
 	result = proc_slash_command("proc noop 3");
 	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc noop");
 
+	result = proc_slash_command("proc if a < b 2");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc if a < b");
+
+	result = proc_slash_command("proc else");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc else");
+
+	result = proc_slash_command("proc endif");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc endif");
+
 	result = proc_slash_command("proc set a 1 4");
 	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc set a 1");
 
@@ -27,6 +37,15 @@ Test(proc_slash_commands, commands_parse) {
 	result = proc_slash_command("proc call 1");
 	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc call 1");
 
+	result = proc_slash_command("proc loop -p 100 0 3");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc loop 0 3");
+
+	result = proc_slash_command("proc jump -r 2");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc jump -r 2");
+
+	result = proc_slash_command("proc switch -d 0 a 3:1 -2:0 7:2");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc switch a 3:1 -2:0 7:2");
+
 	result = proc_slash_command("proc pop 2");
 	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc pop");
 
@@ -51,3 +70,122 @@ Test(proc_slash_commands, commands_parse) {
 	// result = proc_slash_command("proc run 1");
 	// cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc run 1");
 }
+
+Test(proc_slash_commands, operand_array_index) {
+	extern proc_t * current_procedure;
+
+	int result = proc_slash_command("proc new");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc new");
+
+	result = proc_slash_command("proc binop a[3] + b c[12]");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc binop a[3] + b c[12]");
+
+	proc_binop_t * binop = &current_procedure->instructions[0].instruction.binop;
+	cr_assert_str_eq(binop->param_a.name, "a");
+	cr_assert_eq(binop->param_a.offset, 3);
+	cr_assert_str_eq(binop->param_b.name, "b");
+	cr_assert_eq(binop->param_b.offset, -1);
+	cr_assert_str_eq(binop->result.name, "c");
+	cr_assert_eq(binop->result.offset, 12);
+
+	result = proc_slash_command("proc set a[x] 1");
+	cr_assert_eq(result, SLASH_EINVAL, "Accepted invalid array index: proc set a[x] 1");
+
+	result = proc_slash_command("proc set a[2 1");
+	cr_assert_eq(result, SLASH_EINVAL, "Accepted invalid array index: proc set a[2 1");
+}
+
+Test(proc_slash_commands, operand_immediates) {
+	extern proc_t * current_procedure;
+
+	int result = proc_slash_command("proc new");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc new");
+
+	result = proc_slash_command("proc ifelse a >= -3");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc ifelse a >= -3");
+
+	result = proc_slash_command("proc binop 2.5 * b c");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc binop 2.5 * b c");
+
+	result = proc_slash_command("proc block a != 0x10");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc block a != 0x10");
+
+	proc_ifelse_t * ifelse = &current_procedure->instructions[0].instruction.ifelse;
+	cr_assert_eq(ifelse->param_a.kind, PROC_OPERAND_PARAM);
+	cr_assert_str_eq(ifelse->param_a.name, "a");
+	cr_assert_eq(ifelse->param_b.kind, PROC_OPERAND_INT);
+	cr_assert_eq(ifelse->param_b.value.i, -3);
+
+	proc_binop_t * binop = &current_procedure->instructions[1].instruction.binop;
+	cr_assert_eq(binop->param_a.kind, PROC_OPERAND_FLOAT);
+	cr_assert_float_eq(binop->param_a.value.f, 2.5, 1e-9);
+	cr_assert_eq(binop->result.kind, PROC_OPERAND_PARAM);
+
+	proc_block_t * block = &current_procedure->instructions[2].instruction.block;
+	cr_assert_eq(block->param_b.kind, PROC_OPERAND_UINT);
+	cr_assert_eq(block->param_b.value.u, 16);
+
+	result = proc_slash_command("proc ifelse a == 12x");
+	cr_assert_eq(result, SLASH_EINVAL, "Accepted invalid constant: proc ifelse a == 12x");
+}
+
+Test(proc_slash_commands, operand_registers) {
+	extern proc_t * current_procedure;
+
+	int result = proc_slash_command("proc new");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc new");
+
+	result = proc_slash_command("proc binop a - b $r15");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc binop a - b $r15");
+
+	result = proc_slash_command("proc ifelse $r15 < 0");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc ifelse $r15 < 0");
+
+	proc_binop_t * binop = &current_procedure->instructions[0].instruction.binop;
+	cr_assert_eq(binop->result.kind, PROC_OPERAND_REGISTER);
+	cr_assert_eq(binop->result.value.u, 15);
+	cr_assert_eq(current_procedure->instructions[1].instruction.ifelse.param_a.kind, PROC_OPERAND_REGISTER);
+
+	result = proc_slash_command("proc binop a - b r0");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc binop a - b r0");
+	cr_assert_eq(current_procedure->instructions[2].instruction.binop.result.kind, PROC_OPERAND_PARAM, "Registers must not shadow parameters");
+	cr_assert_str_eq(current_procedure->instructions[2].instruction.binop.result.name, "r0");
+
+	result = proc_slash_command("proc binop a - b $r16");
+	cr_assert_eq(result, SLASH_EINVAL, "Accepted invalid register: proc binop a - b $r16");
+
+	result = proc_slash_command("proc set $r0 1");
+	cr_assert_eq(result, SLASH_EINVAL, "Accepted register in set: proc set $r0 1");
+
+	result = proc_slash_command("proc block $r0 == 1");
+	cr_assert_eq(result, SLASH_EINVAL, "Accepted register in block: proc block $r0 == 1");
+}
+
+Test(proc_slash_commands, block_backoff_options) {
+	extern proc_t * current_procedure;
+
+	int result = proc_slash_command("proc new");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc new");
+
+	result = proc_slash_command("proc block -p 500 -m 30000 -b 200 -t 3600000 a == b 1");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc block -p 500 -m 30000 -b 200 -t 3600000 a == b 1");
+
+	proc_block_t * block = &current_procedure->instructions[0].instruction.block;
+	cr_assert_eq(block->min_period_ms, 500);
+	cr_assert_eq(block->max_period_ms, 30000);
+	cr_assert_eq(block->backoff_percent, 200);
+	cr_assert_eq(block->timeout_ms, 3600000);
+	cr_assert_eq(block->offload, 0);
+
+	result = proc_slash_command("proc block -o a == b 1");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc block -o a == b 1");
+	cr_assert_eq(current_procedure->instructions[1].instruction.block.offload, 1);
+
+	result = proc_slash_command("proc block a == b 1");
+	cr_assert_eq(result, SLASH_SUCCESS, "Failed on command: proc block a == b 1");
+
+	block = &current_procedure->instructions[2].instruction.block;
+	cr_assert_eq(block->min_period_ms, 0);
+	cr_assert_eq(block->backoff_percent, 0);
+	cr_assert_eq(block->timeout_ms, 0);
+}